@@ -0,0 +1,126 @@
+// alias_table.h - Walker/Vose alias method for O(1) weighted sampling.
+// AliasTable<N> can be built at compile time from constexpr weights;
+// DynamicAliasTable is the same structure sized at run time.
+// Sampling takes one 64-bit random value: the high half picks a column,
+// the low half decides between the column and its alias.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace alias_detail
+{
+
+__extension__ typedef unsigned __int128 u128;
+
+inline constexpr uint64_t ALWAYS = uint64_t{1} << 32; // threshold that always accepts
+
+// Integer Vose construction. scaled and work are caller-provided scratch of n
+// elements each. Returns false when all weights are zero.
+constexpr bool build(size_t n, const uint64_t *weights, uint64_t *threshold, uint32_t *alias, uint64_t *scaled,
+                     uint32_t *work)
+{
+  uint64_t total = 0;
+  for (size_t i = 0; i < n; ++i)
+    total += weights[i];
+  if (n == 0 || total == 0)
+    return false;
+
+  // small indices grow from the front of work, large ones from the back
+  size_t nsmall = 0, nlarge = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    scaled[i] = weights[i] * n;
+    alias[i] = static_cast<uint32_t>(i);
+    if (scaled[i] < total)
+      work[nsmall++] = static_cast<uint32_t>(i);
+    else
+      work[n - 1 - nlarge++] = static_cast<uint32_t>(i);
+  }
+
+  while (nsmall > 0 && nlarge > 0)
+  {
+    uint32_t s = work[--nsmall];
+    uint32_t l = work[n - nlarge]; // top of the large stack
+    threshold[s] = static_cast<uint64_t>((static_cast<u128>(scaled[s]) << 32) / total);
+    alias[s] = l;
+    scaled[l] = scaled[l] + scaled[s] - total;
+    if (scaled[l] < total)
+    {
+      --nlarge;
+      work[nsmall++] = l;
+    }
+  }
+  for (size_t k = 0; k < nlarge; ++k)
+    threshold[work[n - 1 - k]] = ALWAYS;
+  for (size_t k = 0; k < nsmall; ++k) // only rounding leftovers
+    threshold[work[k]] = ALWAYS;
+  return true;
+}
+
+constexpr size_t sample(size_t n, const uint64_t *threshold, const uint32_t *alias, uint64_t random)
+{
+  size_t column = static_cast<size_t>(((random >> 32) * n) >> 32);
+  return (random & 0xFFFFFFFFu) < threshold[column] ? column : alias[column];
+}
+
+} // namespace alias_detail
+
+template <size_t N>
+class AliasTable
+{
+public:
+  constexpr AliasTable() = default;
+
+  constexpr explicit AliasTable(const std::array<uint64_t, N> &weights)
+  {
+    std::array<uint64_t, N> scaled{};
+    std::array<uint32_t, N> work{};
+    valid_ = alias_detail::build(N, weights.data(), threshold_.data(), alias_.data(), scaled.data(), work.data());
+  }
+
+  // Index in [0, N) drawn with probability weight[i] / sum(weights).
+  constexpr size_t sample(uint64_t random) const
+  {
+    return alias_detail::sample(N, threshold_.data(), alias_.data(), random);
+  }
+
+  constexpr bool valid() const { return valid_; }
+
+private:
+  std::array<uint64_t, N> threshold_{};
+  std::array<uint32_t, N> alias_{};
+  bool valid_ = false;
+};
+
+class DynamicAliasTable
+{
+public:
+  DynamicAliasTable() = default;
+
+  explicit DynamicAliasTable(std::span<const uint64_t> weights)
+      : threshold_(weights.size()), alias_(weights.size())
+  {
+    std::vector<uint64_t> scaled(weights.size());
+    std::vector<uint32_t> work(weights.size());
+    valid_ = alias_detail::build(weights.size(), weights.data(), threshold_.data(), alias_.data(), scaled.data(),
+                                 work.data());
+  }
+
+  size_t sample(uint64_t random) const
+  {
+    return alias_detail::sample(threshold_.size(), threshold_.data(), alias_.data(), random);
+  }
+
+  bool valid() const { return valid_; }
+  size_t size() const { return threshold_.size(); }
+
+private:
+  std::vector<uint64_t> threshold_;
+  std::vector<uint32_t> alias_;
+  bool valid_ = false;
+};
@@ -0,0 +1,377 @@
+// async_log.h - low-overhead logger shared by crasher and the interposer.
+//
+// Each producing thread formats a timestamped record on its own stack and
+// copies it into a private SPSC byte ring; nothing is shared between
+// producers and no lock is taken. One background writer thread drains all
+// rings with batched writev() calls. Records that do not fit are dropped and
+// counted rather than stalling the producer. On SIGSEGV/SIGBUS/SIGABRT/
+// SIGILL/SIGFPE the rings are flushed with write() before the previous
+// handler runs, so the last lines before a crash are not lost; normal exit
+// flushes through atexit().
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <sys/uio.h>
+#include <unistd.h>
+
+class AsyncLog
+{
+public:
+  static constexpr size_t RING_BYTES = 64 * 1024; // per producing thread, power of two
+  static constexpr size_t MAX_RECORD = 1024;      // longer records are truncated
+
+  explicit AsyncLog(int fd) : fd_(fd), epoch_(std::chrono::steady_clock::now()) {}
+
+  // Loggers are meant to live for the whole process (see the users); threads
+  // may still be logging during static destruction, so nothing is torn down.
+  AsyncLog(const AsyncLog &) = delete;
+  AsyncLog &operator=(const AsyncLog &) = delete;
+
+  template <typename... Args>
+  void write(const Args &...args)
+  {
+    std::call_once(started_, [this] { start(); });
+
+    Record rec;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch_).count();
+    rec.append("[");
+    rec.append_padded(static_cast<uint64_t>(us / 1000000), 5, ' ');
+    rec.append(".");
+    rec.append_padded(static_cast<uint64_t>(us % 1000000), 6, '0');
+    rec.append("] ");
+    (rec.append_value(args), ...);
+    rec.finish();
+
+    if (Ring *ring = local_ring())
+      ring->push(rec.data, rec.len);
+  }
+
+  // Drain every ring synchronously (safe to call from any thread).
+  void flush() { drain(/*wait=*/true, /*in_signal=*/false); }
+
+  // Whether this process has the writer thread; once started it runs until
+  // exit, but a forked child does not inherit it.
+  bool writer_running() const { return writer_pid_.load(std::memory_order_acquire) == getpid(); }
+
+private:
+  struct Record
+  {
+    char data[MAX_RECORD];
+    size_t len = 0;
+
+    void append(std::string_view s)
+    {
+      size_t room = MAX_RECORD - 1 - len; // keep one byte for '\n'
+      size_t n = s.size() < room ? s.size() : room;
+      std::memcpy(data + len, s.data(), n);
+      len += n;
+    }
+
+    void append_padded(uint64_t value, int width, char pad)
+    {
+      char digits[24];
+      auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+      for (int i = static_cast<int>(end - digits); i < width; ++i)
+        append(std::string_view(&pad, 1));
+      append(std::string_view(digits, static_cast<size_t>(end - digits)));
+    }
+
+    template <typename T>
+    void append_value(const T &value)
+    {
+      using U = std::remove_cvref_t<T>;
+      if constexpr (std::is_same_v<U, bool>)
+        append(value ? "true" : "false");
+      else if constexpr (std::is_same_v<U, char>)
+        append(std::string_view(&value, 1));
+      else if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *>)
+        append(value ? std::string_view(value) : std::string_view("(null)"));
+      else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        append(std::string_view(value));
+      else if constexpr (std::is_enum_v<U>)
+        append_value(+static_cast<std::underlying_type_t<U>>(value)); // a number even for char enums
+      else if constexpr (std::is_integral_v<U>)
+      {
+        char digits[24];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value); // in its own type: no sign flip
+        append(std::string_view(digits, static_cast<size_t>(end - digits)));
+      }
+      else if constexpr (std::is_floating_point_v<U>)
+      {
+        char digits[32];
+        int n = std::snprintf(digits, sizeof(digits), "%g", static_cast<double>(value));
+        append(std::string_view(digits, n > 0 ? static_cast<size_t>(n) : 0));
+      }
+      else if constexpr (std::is_pointer_v<U>)
+      {
+        char digits[24];
+        int n = std::snprintf(digits, sizeof(digits), "%p", static_cast<const void *>(value));
+        append(std::string_view(digits, n > 0 ? static_cast<size_t>(n) : 0));
+      }
+      else
+        static_assert(!sizeof(T), "AsyncLog: unsupported argument type");
+    }
+
+    void finish() { data[len++] = '\n'; }
+  };
+
+  struct Ring
+  {
+    std::atomic<uint64_t> head{0}; // written by the producer
+    std::atomic<uint64_t> tail{0}; // written by the consumer
+    std::atomic<bool> owned{true};
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reported_drops = 0; // consumer only
+    Ring *next = nullptr;
+    char data[RING_BYTES];
+
+    void push(const char *src, size_t len)
+    {
+      uint64_t h = head.load(std::memory_order_relaxed);
+      uint64_t t = tail.load(std::memory_order_acquire);
+      if (RING_BYTES - (h - t) < len)
+      {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      size_t at = static_cast<size_t>(h & (RING_BYTES - 1));
+      size_t first = len < RING_BYTES - at ? len : RING_BYTES - at;
+      std::memcpy(data + at, src, first);
+      std::memcpy(data, src + first, len - first);
+      head.store(h + len, std::memory_order_release);
+    }
+  };
+
+  // Per-thread cache of (logger, ring) pairs; exiting threads hand their
+  // rings back so short-lived threads (curl's resolver threads) reuse them.
+  struct ThreadRings
+  {
+    std::array<std::pair<const AsyncLog *, Ring *>, 4> slots{};
+
+    ~ThreadRings()
+    {
+      for (auto &[owner, ring] : slots)
+        if (ring)
+          ring->owned.store(false, std::memory_order_release);
+    }
+  };
+
+  Ring *local_ring()
+  {
+    static thread_local ThreadRings rings;
+    for (auto &[owner, ring] : rings.slots)
+    {
+      if (owner == this)
+        return ring;
+      if (!owner)
+      {
+        owner = this;
+        ring = claim_ring();
+        return ring;
+      }
+    }
+    return nullptr; // more loggers than slots: drop
+  }
+
+  Ring *claim_ring()
+  {
+    for (Ring *r = rings_.load(std::memory_order_acquire); r; r = r->next)
+    {
+      bool expected = false;
+      if (r->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        return r;
+    }
+    Ring *r = new Ring;
+    r->next = rings_.load(std::memory_order_relaxed);
+    while (!rings_.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return r;
+  }
+
+  void start()
+  {
+    register_for_crash_flush(this);
+    std::thread([this] {
+      for (;;)
+      {
+        if (drain(/*wait=*/false, /*in_signal=*/false) == 0)
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    }).detach();
+    writer_pid_.store(getpid(), std::memory_order_release);
+  }
+
+  // Returns the number of bytes written. Only one consumer may run at a time:
+  // the writer thread skips a pass when busy, explicit flushes wait. In a
+  // signal handler the wait is bounded and the flush goes ahead regardless.
+  size_t drain(bool wait, bool in_signal)
+  {
+    if (consumer_busy_.test_and_set(std::memory_order_acquire))
+    {
+      if (!wait)
+        return 0;
+      for (long spins = 0; consumer_busy_.test_and_set(std::memory_order_acquire); ++spins)
+      {
+        if (in_signal && spins > 1000000)
+          break;
+        if (!in_signal)
+          std::this_thread::yield();
+      }
+    }
+
+    size_t written = 0;
+    constexpr size_t BATCH = 32;
+    iovec iov[BATCH * 2];
+    std::pair<Ring *, uint64_t> advance[BATCH];
+    size_t niov = 0, nring = 0;
+
+    auto write_batch = [&] {
+      written += write_all(iov, niov);
+      for (size_t i = 0; i < nring; ++i)
+        advance[i].first->tail.store(advance[i].second, std::memory_order_release);
+      niov = nring = 0;
+    };
+
+    for (Ring *r = rings_.load(std::memory_order_acquire); r; r = r->next)
+    {
+      uint64_t drops = r->dropped.load(std::memory_order_relaxed);
+      if (drops != r->reported_drops && !in_signal)
+      {
+        char note[64];
+        int n = std::snprintf(note, sizeof(note), "[log] %llu records dropped\n",
+                              static_cast<unsigned long long>(drops - r->reported_drops));
+        if (n > 0)
+          written += static_cast<size_t>(::write(fd_, note, static_cast<size_t>(n)));
+        r->reported_drops = drops;
+      }
+
+      uint64_t t = r->tail.load(std::memory_order_relaxed);
+      uint64_t h = r->head.load(std::memory_order_acquire);
+      if (h == t)
+        continue;
+      size_t at = static_cast<size_t>(t & (RING_BYTES - 1));
+      size_t len = static_cast<size_t>(h - t);
+      size_t first = len < RING_BYTES - at ? len : RING_BYTES - at;
+      iov[niov++] = iovec{r->data + at, first};
+      if (len > first)
+        iov[niov++] = iovec{r->data, len - first};
+      advance[nring++] = {r, h};
+      if (nring == BATCH)
+        write_batch();
+    }
+    if (nring)
+      write_batch();
+
+    consumer_busy_.clear(std::memory_order_release);
+    return written;
+  }
+
+  size_t write_all(iovec *iov, size_t niov)
+  {
+    size_t total = 0;
+    while (niov > 0)
+    {
+      ssize_t n = ::writev(fd_, iov, static_cast<int>(niov));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        break; // output gone; discard the batch
+      }
+      total += static_cast<size_t>(n);
+      size_t left = static_cast<size_t>(n);
+      while (niov > 0 && left >= iov->iov_len)
+      {
+        left -= iov->iov_len;
+        ++iov;
+        --niov;
+      }
+      if (niov > 0)
+      {
+        iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+        iov->iov_len -= left;
+      }
+    }
+    return total;
+  }
+
+  // ---- crash-time flush ----
+  static constexpr int CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGABRT, SIGILL, SIGFPE};
+
+  struct CrashState
+  {
+    std::array<std::atomic<AsyncLog *>, 4> loggers{};
+    struct sigaction previous[std::size(CRASH_SIGNALS)];
+    std::once_flag installed;
+  };
+
+  static CrashState &crash_state()
+  {
+    static CrashState state;
+    return state;
+  }
+
+  static void register_for_crash_flush(AsyncLog *log)
+  {
+    CrashState &state = crash_state();
+    for (auto &slot : state.loggers)
+    {
+      AsyncLog *expected = nullptr;
+      if (slot.compare_exchange_strong(expected, log))
+        break;
+    }
+    std::call_once(state.installed, [&state] {
+      std::atexit(flush_all);
+      struct sigaction sa;
+      std::memset(&sa, 0, sizeof(sa));
+      sa.sa_handler = on_crash_signal;
+      sigemptyset(&sa.sa_mask);
+      for (size_t i = 0; i < std::size(CRASH_SIGNALS); ++i)
+        sigaction(CRASH_SIGNALS[i], &sa, &state.previous[i]);
+    });
+  }
+
+  static void flush_all()
+  {
+    for (auto &slot : crash_state().loggers)
+      if (AsyncLog *log = slot.load(std::memory_order_acquire))
+        log->flush();
+  }
+
+  static void on_crash_signal(int sig)
+  {
+    CrashState &state = crash_state();
+    for (auto &slot : state.loggers)
+      if (AsyncLog *log = slot.load(std::memory_order_acquire))
+        log->drain(/*wait=*/true, /*in_signal=*/true);
+
+    // Hand the signal to whoever was installed before us (or the default
+    // action) and re-raise so the crash still produces a core/report.
+    for (size_t i = 0; i < std::size(CRASH_SIGNALS); ++i)
+      if (CRASH_SIGNALS[i] == sig)
+        sigaction(sig, &state.previous[i], nullptr);
+    raise(sig);
+  }
+
+  const int fd_;
+  const std::chrono::steady_clock::time_point epoch_;
+  std::once_flag started_;
+  std::atomic<pid_t> writer_pid_{0};
+  std::atomic<Ring *> rings_{nullptr};
+  std::atomic_flag consumer_busy_;
+};
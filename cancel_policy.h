@@ -0,0 +1,156 @@
+// cancel_policy.h - when crasher's progress callback aborts a transfer.
+// A CancelPolicy is parsed once from --abort. Every transfer gets its own
+// CancelPlan, drawn from the adding thread's generator when it is added, so
+// the callback reads only its own transfer plus a thread_local generator.
+//
+// Spec: "off", or comma-separated key=value entries, all optional:
+//   p=PCT                        share of transfers that get armed (default 100)
+//   bytes=MIN[-MAX]              downloaded at least this much (K, M, G suffixes, any case)
+//   ms=MIN[-MAX]                 at least this long since the transfer was added
+//   phase=dns|connect|tls|body   only while the transfer is in that phase
+//   dice=PCT                     chance per callback once the rest hold (default 100)
+// Ranges are drawn uniformly per transfer. An armed transfer aborts when all
+// of its triggers hold. The default, "bytes=100K,dice=20", is the original
+// behaviour: a 20% chance per callback once 100 KiB arrived.
+
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <random>
+#include <string_view>
+
+#include "spec_parser.h"
+
+enum class TransferPhase : uint8_t
+{
+  any, // no phase trigger
+  dns,
+  connect,
+  tls,
+  body,
+};
+
+inline constexpr const char *TRANSFER_PHASE_NAMES[] = {"any", "dns", "connect", "tls", "body"};
+inline constexpr size_t TRANSFER_PHASES = sizeof(TRANSFER_PHASE_NAMES) / sizeof(TRANSFER_PHASE_NAMES[0]);
+
+struct CancelPlan
+{
+  bool armed = false;
+  TransferPhase phase = TransferPhase::any;
+  int64_t bytes = 0;
+  int64_t after_us = 0;
+  uint32_t dice_pct = 100;
+
+  template <typename Rng>
+  bool roll(Rng &rng) const
+  {
+    return dice_pct >= 100 || std::uniform_int_distribution<uint32_t>(0, 99)(rng) < dice_pct;
+  }
+};
+
+class CancelPolicy
+{
+public:
+  // false if spec is malformed; the policy is then unchanged.
+  bool parse(std::string_view spec)
+  {
+    CancelPolicy p;
+    p.bytes_min_ = p.bytes_max_ = 0;
+    p.dice_pct_ = 100;
+    if (spec == "off")
+    {
+      p.armed_pct_ = 0;
+      *this = p;
+      return true;
+    }
+    bool ok = for_each_spec_item(spec, [&p](std::string_view key, std::string_view value) {
+      if (key == "p")
+        return parse_pct(value, p.armed_pct_);
+      if (key == "dice")
+        return parse_pct(value, p.dice_pct_);
+      if (key == "bytes")
+        return parse_range(value, true, p.bytes_min_, p.bytes_max_);
+      if (key == "ms")
+        return parse_range(value, false, p.ms_min_, p.ms_max_);
+      if (key == "phase")
+        return parse_phase(value, p.phase_);
+      return false;
+    });
+    if (!ok)
+      return false;
+    *this = p;
+    return true;
+  }
+
+  template <typename Rng>
+  CancelPlan plan(Rng &rng) const
+  {
+    CancelPlan c;
+    c.armed = armed_pct_ > 0 &&
+              (armed_pct_ >= 100 || std::uniform_int_distribution<uint32_t>(0, 99)(rng) < armed_pct_);
+    if (!c.armed)
+      return c;
+    c.phase = phase_;
+    c.bytes = draw(rng, bytes_min_, bytes_max_);
+    c.after_us = draw(rng, ms_min_, ms_max_) * 1000;
+    c.dice_pct = dice_pct_;
+    return c;
+  }
+
+private:
+  template <typename Rng>
+  static int64_t draw(Rng &rng, int64_t lo, int64_t hi)
+  {
+    return lo == hi ? lo : std::uniform_int_distribution<int64_t>(lo, hi)(rng);
+  }
+
+  static bool parse_pct(std::string_view value, uint32_t &out) { return parse_spec_number(value, out) && out <= 100; }
+
+  static bool parse_size(std::string_view value, bool suffixes, int64_t &out)
+  {
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (ec != std::errc{} || out < 0)
+      return false;
+    std::string_view rest(ptr, static_cast<size_t>(value.data() + value.size() - ptr));
+    int shift = 0;
+    if (suffixes && rest.size() == 1)
+    {
+      char unit = static_cast<char>(std::toupper(static_cast<unsigned char>(rest[0])));
+      shift = unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : -1;
+    }
+    else if (!rest.empty())
+      shift = -1;
+    if (shift < 0 || out > (INT64_MAX >> shift))
+      return false;
+    out <<= shift;
+    return true;
+  }
+
+  static bool parse_range(std::string_view value, bool suffixes, int64_t &lo, int64_t &hi)
+  {
+    size_t dash = value.find('-');
+    if (!parse_size(value.substr(0, dash), suffixes, lo))
+      return false;
+    hi = lo;
+    return dash == std::string_view::npos || (parse_size(value.substr(dash + 1), suffixes, hi) && hi >= lo);
+  }
+
+  static bool parse_phase(std::string_view value, TransferPhase &out)
+  {
+    for (size_t i = 1; i < TRANSFER_PHASES; ++i)
+      if (value == TRANSFER_PHASE_NAMES[i])
+      {
+        out = static_cast<TransferPhase>(i);
+        return true;
+      }
+    return false;
+  }
+
+  uint32_t armed_pct_ = 100;
+  uint32_t dice_pct_ = 20;
+  int64_t bytes_min_ = 100 * 1024, bytes_max_ = 100 * 1024;
+  int64_t ms_min_ = 0, ms_max_ = 0;
+  TransferPhase phase_ = TransferPhase::any;
+};
@@ -0,0 +1,330 @@
+// cpu_placement.h - where crasher's processes and threads run. Probes the
+// CPUs this process may use and their NUMA nodes, pins the calling thread,
+// hands each thread a page-aligned slot for its state that the thread itself
+// touches first (so the kernel backs it from that thread's node), and counts
+// a thread's migrations and context switches and the process' threads.
+// Topology and counters come from Linux sysfs, procfs, perf and getrusage;
+// elsewhere the topology is empty, so threads run unpinned, and the counters
+// stay 0.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sched.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#include "spec_parser.h"
+
+// "0-3,8" <-> {0, 1, 2, 3, 8}
+inline std::vector<int> parse_cpu_list(std::string_view text)
+{
+  std::vector<int> cpus;
+  while (!text.empty())
+  {
+    std::string_view item = next_spec_token(text, ",");
+    size_t dash = item.find('-');
+    int lo = 0, hi = 0;
+    if (!parse_spec_number(item.substr(0, dash), lo))
+      continue;
+    hi = lo;
+    if (dash != std::string_view::npos && !parse_spec_number(item.substr(dash + 1), hi))
+      continue;
+    for (int cpu = lo; cpu <= hi; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+inline std::string cpu_list(std::span<const int> cpus)
+{
+  std::string text;
+  for (size_t i = 0; i < cpus.size();)
+  {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+      ++j;
+    text += (text.empty() ? "" : ",") + std::to_string(cpus[i]);
+    if (j > i)
+      text += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return text.empty() ? "any" : text;
+}
+
+struct CpuTopology
+{
+  std::vector<int> cpus;               // allowed CPUs, node by node
+  std::vector<std::vector<int>> nodes; // allowed CPUs of each node that has any
+  std::vector<int> node_ids;           // sysfs number of nodes[i]
+
+  static CpuTopology probe()
+  {
+    CpuTopology t;
+    std::vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+          allowed.push_back(cpu);
+    std::vector<bool> placed(CPU_SETSIZE);
+    for (int node : parse_cpu_list(read_line("/sys/devices/system/node/online")))
+    {
+      std::vector<int> mine;
+      for (int cpu : parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")))
+        if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set) && !placed[cpu])
+        {
+          placed[cpu] = true;
+          mine.push_back(cpu);
+        }
+      if (!mine.empty())
+      {
+        t.nodes.push_back(std::move(mine));
+        t.node_ids.push_back(node);
+      }
+    }
+    std::vector<int> rest; // CPUs sysfs did not place, e.g. without NUMA support
+    for (int cpu : allowed)
+      if (!placed[cpu])
+        rest.push_back(cpu);
+    if (!rest.empty())
+    {
+      t.nodes.push_back(std::move(rest));
+      t.node_ids.push_back(t.node_ids.empty() ? 0 : -1);
+    }
+#endif
+    for (const std::vector<int> &node : t.nodes)
+      t.cpus.insert(t.cpus.end(), node.begin(), node.end());
+    return t;
+  }
+
+  // sysfs node number of cpu, -1 if unknown
+  int node_of(int cpu) const
+  {
+    for (size_t i = 0; i < nodes.size(); ++i)
+      for (int c : nodes[i])
+        if (c == cpu)
+          return node_ids[i];
+    return -1;
+  }
+
+private:
+  static std::string read_line(const std::string &path)
+  {
+    std::string line;
+    if (FILE *f = std::fopen(path.c_str(), "r"))
+    {
+      char buffer[4096] = {};
+      if (std::fgets(buffer, sizeof(buffer), f))
+        line = buffer;
+      std::fclose(f);
+    }
+    while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+      line.pop_back();
+    return line;
+  }
+};
+
+// Restricts the calling thread (and threads it creates later, such as
+// libcurl's resolver threads) to cpus. Empty cpus: no change.
+inline bool pin_current_thread(std::span<const int> cpus)
+{
+  if (cpus.empty())
+    return true;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+    CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+inline int current_cpu()
+{
+#ifdef __linux__
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+// Threads in this process, -1 if the platform cannot tell
+inline int count_threads()
+{
+#ifdef __linux__
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir)
+    return -1;
+  int n = 0;
+  while (dirent *entry = readdir(dir))
+    n += entry->d_name[0] != '.';
+  closedir(dir);
+  return n;
+#elif defined(__APPLE__)
+  thread_act_array_t threads;
+  mach_msg_type_number_t count = 0;
+  if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS)
+    return -1;
+  for (mach_msg_type_number_t i = 0; i < count; ++i)
+    mach_port_deallocate(mach_task_self(), threads[i]);
+  vm_deallocate(mach_task_self(), reinterpret_cast<vm_address_t>(threads), sizeof(*threads) * count);
+  return static_cast<int>(count);
+#else
+  return -1;
+#endif
+}
+
+// Page-aligned storage for one T per thread, left untouched until its thread
+// constructs its own T with emplace(). With the default first-touch policy
+// a pinned thread's state then lives on its own NUMA node.
+template <typename T>
+class FirstTouchSlots
+{
+public:
+  explicit FirstTouchSlots(size_t n) : size_(n), built_(n)
+  {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    stride_ = (sizeof(T) + page - 1) / page * page;
+    void *p = mmap(nullptr, stride_ * n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (n > 0 && p == MAP_FAILED)
+      throw std::bad_alloc();
+    base_ = static_cast<char *>(p);
+  }
+
+  ~FirstTouchSlots()
+  {
+    for (size_t i = 0; i < size_; ++i)
+      if (built_[i])
+        (*this)[i].~T();
+    if (size_ > 0)
+      munmap(base_, stride_ * size_);
+  }
+
+  FirstTouchSlots(const FirstTouchSlots &) = delete;
+  FirstTouchSlots &operator=(const FirstTouchSlots &) = delete;
+
+  // On the owning thread, once; the slot is read by others only after a join
+  T &emplace(size_t i)
+  {
+    built_[i] = 1;
+    return *new (base_ + i * stride_) T();
+  }
+
+  T &operator[](size_t i) { return *std::launder(reinterpret_cast<T *>(base_ + i * stride_)); }
+  size_t size() const { return size_; }
+
+private:
+  char *base_ = nullptr;
+  size_t stride_ = 0;
+  size_t size_;
+  std::vector<char> built_; // one byte per slot: threads set their own
+};
+
+// Scheduler activity of the calling thread between start() and stop(), both
+// called on that thread. Migrations come from a perf software counter, or
+// from /proc/thread-self/sched where perf is not permitted.
+class SchedCounters
+{
+public:
+  struct Sample
+  {
+    uint64_t migrations = 0;
+    uint64_t voluntary = 0;   // blocked: waits in poll, locks
+    uint64_t involuntary = 0; // preempted
+  };
+
+  SchedCounters() = default;
+  ~SchedCounters()
+  {
+    if (perf_fd_ >= 0)
+      close(perf_fd_);
+  }
+
+  SchedCounters(const SchedCounters &) = delete;
+  SchedCounters &operator=(const SchedCounters &) = delete;
+
+  void start()
+  {
+#ifdef __linux__
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+    attr.exclude_hv = 1;
+    perf_fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+#endif
+    base_ = now();
+  }
+
+  Sample stop()
+  {
+    Sample end = now();
+    return {end.migrations - base_.migrations, end.voluntary - base_.voluntary,
+            end.involuntary - base_.involuntary};
+  }
+
+private:
+  Sample now() const
+  {
+    Sample s;
+#ifdef __linux__
+    rusage usage{};
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+      s.voluntary = static_cast<uint64_t>(usage.ru_nvcsw);
+      s.involuntary = static_cast<uint64_t>(usage.ru_nivcsw);
+    }
+    uint64_t count = 0;
+    if (perf_fd_ >= 0 && read(perf_fd_, &count, sizeof(count)) == sizeof(count))
+      s.migrations = count;
+    else if (perf_fd_ < 0)
+      s.migrations = proc_migrations();
+#endif
+    return s;
+  }
+
+  static uint64_t proc_migrations()
+  {
+    uint64_t n = 0;
+    if (FILE *f = std::fopen("/proc/thread-self/sched", "r"))
+    {
+      char line[256];
+      while (std::fgets(line, sizeof(line), f))
+        if (std::strncmp(line, "se.nr_migrations", 16) == 0)
+        {
+          const char *colon = std::strchr(line, ':');
+          if (colon)
+            n = std::strtoull(colon + 1, nullptr, 10);
+          break;
+        }
+      std::fclose(f);
+    }
+    return n;
+  }
+
+  int perf_fd_ = -1;
+  Sample base_;
+};
@@ -0,0 +1,141 @@
+// crc32c.h - incremental CRC32C (Castagnoli) shared by crasher and origin.
+// Uses the SSE4.2 crc32 instruction on x86-64 and the ARMv8 CRC32 extension
+// on arm64 (always present on Apple silicon), eight bytes per instruction;
+// falls back to a byte-wise table elsewhere. The hardware path is picked
+// once at run time, so no special compiler flags are needed.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && (defined(__APPLE__) || defined(__ARM_FEATURE_CRC32))
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
+namespace crc32c_detail
+{
+
+inline const std::array<uint32_t, 256> &table()
+{
+  static const std::array<uint32_t, 256> t = [] {
+    std::array<uint32_t, 256> out{};
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+      out[i] = c;
+    }
+    return out;
+  }();
+  return t;
+}
+
+inline uint32_t update_portable(uint32_t crc, const unsigned char *p, size_t n)
+{
+  const auto &t = table();
+  while (n--)
+    crc = t[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(CRC32C_X86)
+__attribute__((target("sse4.2"))) inline uint32_t update_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+  uint64_t c = crc;
+  for (; n >= 8; n -= 8, p += 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word)); // curl's buffer has no alignment guarantee
+    c = _mm_crc32_u64(c, word);
+  }
+  uint32_t c32 = static_cast<uint32_t>(c);
+  for (; n > 0; --n)
+    c32 = _mm_crc32_u8(c32, *p++);
+  return c32;
+}
+
+inline bool have_hw()
+{
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+}
+#elif defined(CRC32C_ARM)
+__attribute__((target("crc"))) inline uint32_t update_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+  for (; n >= 8; n -= 8, p += 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  for (; n > 0; --n)
+    crc = __crc32cb(crc, *p++);
+  return crc;
+}
+
+inline bool have_hw() { return true; }
+#endif
+
+// a * b modulo the CRC32C polynomial, both bit-reflected
+inline uint32_t multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t product = 0;
+  for (uint32_t m = 1u << 31; m != 0; m >>= 1)
+  {
+    if (a & m)
+      product ^= b;
+    b = (b & 1) ? (b >> 1) ^ 0x82F63B78u : b >> 1;
+  }
+  return product;
+}
+
+// x^(8 * n) modulo the polynomial, i.e. the effect of n zero bytes
+inline uint32_t x8nmodp(uint64_t n)
+{
+  static const std::array<uint32_t, 64> x2n = [] { // x^(2^k)
+    std::array<uint32_t, 64> out{};
+    uint32_t p = 1u << 30; // x^1
+    for (uint32_t &entry : out)
+    {
+      entry = p;
+      p = multmodp(p, p);
+    }
+    return out;
+  }();
+  uint32_t p = 1u << 31; // x^0
+  for (size_t k = 3; n != 0; n >>= 1, ++k)
+    if (n & 1)
+      p = multmodp(x2n[k % 64], p);
+  return p;
+}
+
+} // namespace crc32c_detail
+
+// Feed n more bytes into a running CRC32C. Start with crc32c_init() and
+// read the result with crc32c_final().
+inline uint32_t crc32c_init() { return 0xFFFFFFFFu; }
+inline uint32_t crc32c_final(uint32_t state) { return state ^ 0xFFFFFFFFu; }
+
+inline uint32_t crc32c_update(uint32_t state, const void *data, size_t n)
+{
+  const auto *p = static_cast<const unsigned char *>(data);
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+  if (crc32c_detail::have_hw())
+    return crc32c_detail::update_hw(state, p, n);
+#endif
+  return crc32c_detail::update_portable(state, p, n);
+}
+
+// CRC32C of A followed by B, from crc32c_final() of each and B's length
+inline uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b)
+{
+  return crc32c_detail::multmodp(crc32c_detail::x8nmodp(length_b), crc_a) ^ crc_b;
+}
@@ -0,0 +1,494 @@
+// curl_alloc.h - the allocator behind curl_global_init_mem for --alloc.
+//
+// "pool" serves libcurl's malloc family from size classes. Each thread keeps
+// a short free list per class and trades batches of blocks with a central,
+// mutex-guarded list per class, which carves new blocks from mmap'd slabs and
+// never gives memory back. Requests above the largest class go to the system
+// allocator. A block can be freed by any thread (libcurl's resolver threads
+// allocate addrinfo copies that the worker frees); it joins the freeing
+// thread's list.
+//
+// "pool-debug" adds use-after-free checks that cost far less than ASan:
+// freed blocks are filled with POISON and held in the freeing thread's
+// quarantine for its next QUARANTINE frees before they can be reused. A
+// poisoned byte that changed by the time the block leaves quarantine or is
+// handed out again (a write after free), or a free of a block that is not
+// live (double or invalid free), prints the block and aborts. Reads after
+// free see the poison instead of stale data.
+//
+// Both modes count allocations and bytes per thread for the stats report.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <curl/curl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+#include "latency_histogram.h"
+
+enum class AllocMode
+{
+  system, // plain curl_global_init
+  pool,
+  pool_debug,
+};
+
+// Payload sizes: 16-byte steps to 64, then two classes per power of two
+struct AllocSizeClasses
+{
+  static constexpr size_t COUNT = 22;
+  static constexpr size_t MAX = 32768;
+
+  static constexpr size_t of(size_t size)
+  {
+    if (size <= 64)
+      return size <= 16 ? 0 : (size + 15) / 16 - 1;
+    size_t msb = static_cast<size_t>(std::bit_width(size - 1)); // size in (2^(msb-1), 2^msb]
+    size_t lower = size_t{1} << (msb - 1);
+    return 3 + 2 * (msb - 7) + (size <= lower + lower / 2 ? 1 : 2);
+  }
+
+  static constexpr size_t size(size_t index)
+  {
+    if (index < 4)
+      return 16 * (index + 1);
+    size_t power = size_t{64} << ((index - 3) / 2);
+    return (index - 3) % 2 ? power + power / 2 : power;
+  }
+};
+static_assert(AllocSizeClasses::size(AllocSizeClasses::COUNT - 1) == AllocSizeClasses::MAX &&
+              AllocSizeClasses::of(AllocSizeClasses::MAX) == AllocSizeClasses::COUNT - 1);
+static_assert(AllocSizeClasses::of(65) == 4 && AllocSizeClasses::size(4) == 96 && AllocSizeClasses::of(97) == 5 &&
+              AllocSizeClasses::size(5) == 128);
+
+class CurlAllocator
+{
+public:
+  static constexpr unsigned char POISON = 0xdd;
+  static constexpr unsigned char FRESH = 0xa5; // handed out, not yet written (pool-debug)
+  static constexpr size_t QUARANTINE = 512;    // per thread
+
+  struct Totals
+  {
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0; // requested by libcurl, over all allocations
+    uint64_t large = 0; // above the largest class, passed to malloc
+    uint64_t refills = 0; // batches taken from the central lists
+    uint64_t slab_bytes = 0; // mapped for small blocks so far
+  };
+
+  // curl_global_init or curl_global_init_mem with this allocator. Call once,
+  // before any other thread uses libcurl.
+  static CURLcode init(AllocMode mode, long flags)
+  {
+    if (mode == AllocMode::system)
+      return curl_global_init(flags);
+    central().debug = mode == AllocMode::pool_debug;
+    return curl_global_init_mem(flags, alloc, release, resize, duplicate, zeroed);
+  }
+
+  // Sum over every thread so far; approximate while threads are allocating.
+  static Totals totals()
+  {
+    Central &c = central();
+    std::lock_guard<std::mutex> lock(c.registry);
+    Totals t = c.retired.snapshot();
+    for (const ThreadCache *cache : c.live)
+      t = t + cache->counters.snapshot();
+    t.slab_bytes = c.slab_bytes.load(std::memory_order_relaxed);
+    return t;
+  }
+
+private:
+  static constexpr size_t CLASSES = AllocSizeClasses::COUNT;
+  static constexpr size_t MAX_SMALL = AllocSizeClasses::MAX;
+  static constexpr uint32_t LARGE = UINT32_MAX;
+  static constexpr size_t SLAB_BYTES = 256 * 1024;
+
+  static constexpr uint32_t LIVE = 0x4c495645; // "LIVE"
+  static constexpr uint32_t DEAD = 0x44454144; // "DEAD"
+
+  // Keeps the payload 16-byte aligned, like malloc
+  struct alignas(16) Header
+  {
+    uint64_t size;       // requested
+    uint32_t size_class; // LARGE for malloc'd blocks
+    uint32_t state;      // LIVE or DEAD
+  };
+  static_assert(sizeof(Header) == 16);
+
+  struct Link
+  {
+    Link *next;
+  };
+
+  static constexpr size_t class_of(size_t size) { return AllocSizeClasses::of(size); }
+  static constexpr size_t class_size(size_t index) { return AllocSizeClasses::size(index); }
+  static constexpr size_t block_bytes(size_t index) { return sizeof(Header) + class_size(index); }
+  // Blocks moved between a thread and the central list at a time
+  static constexpr size_t batch(size_t index)
+  {
+    size_t n = 32 * 1024 / block_bytes(index);
+    return n < 4 ? 4 : n > 64 ? 64 : n;
+  }
+
+  struct Counters
+  {
+    RelaxedCounter allocs, frees, bytes, large, refills;
+
+    Totals snapshot() const
+    {
+      return {allocs.load(), frees.load(), bytes.load(), large.load(), refills.load(), 0};
+    }
+  };
+
+  struct alignas(64) FreeList
+  {
+    std::mutex lock;
+    Link *head = nullptr;
+  };
+
+  struct ThreadCache;
+
+  // Leaked: resolver threads may free after static destruction has begun
+  struct Central
+  {
+    bool debug = false;
+    std::array<FreeList, CLASSES> lists;
+    std::atomic<uint64_t> slab_bytes{0};
+    std::mutex registry;
+    std::vector<ThreadCache *> live;
+    Counters retired; // under registry: threads that exited, calls after a thread's cache is gone
+  };
+
+  static Central &central()
+  {
+    static Central *c = new Central;
+    return *c;
+  }
+
+  struct ThreadCache
+  {
+    std::array<Link *, CLASSES> heads{};
+    std::array<size_t, CLASSES> counts{};
+    std::array<Header *, QUARANTINE> quarantine{}; // pool-debug: ring of recent frees
+    size_t quarantined = 0;
+    Counters counters;
+
+    ThreadCache()
+    {
+      Central &c = central();
+      std::lock_guard<std::mutex> lock(c.registry);
+      c.live.push_back(this);
+    }
+
+    ~ThreadCache()
+    {
+      for (Header *h : quarantine)
+        if (h)
+          recycle(*this, h);
+      for (size_t i = 0; i < CLASSES; ++i)
+        give_back(i, heads[i], counts[i]);
+      Central &c = central();
+      std::lock_guard<std::mutex> lock(c.registry);
+      std::erase(c.live, this);
+      Totals t = counters.snapshot();
+      c.retired.allocs.add(t.allocs);
+      c.retired.frees.add(t.frees);
+      c.retired.bytes.add(t.bytes);
+      c.retired.large.add(t.large);
+      c.retired.refills.add(t.refills);
+      cache_gone() = true;
+    }
+  };
+
+  static bool &cache_gone()
+  {
+    static thread_local constinit bool gone = false;
+    return gone;
+  }
+
+  // nullptr once this thread's cache has been destroyed (thread exit)
+  static ThreadCache *local()
+  {
+    if (cache_gone())
+      return nullptr;
+    static thread_local ThreadCache cache;
+    return &cache;
+  }
+
+  // After a thread's cache is gone its counts go to the shared totals
+  static void count_uncached(uint64_t allocs, uint64_t frees, uint64_t bytes, uint64_t large)
+  {
+    Central &c = central();
+    std::lock_guard<std::mutex> lock(c.registry);
+    c.retired.allocs.add(allocs);
+    c.retired.frees.add(frees);
+    c.retired.bytes.add(bytes);
+    c.retired.large.add(large);
+  }
+
+  static void *alloc(size_t size)
+  {
+    ThreadCache *cache = local();
+    if (cache)
+    {
+      cache->counters.allocs.add();
+      cache->counters.bytes.add(size);
+      if (size > MAX_SMALL)
+        cache->counters.large.add();
+    }
+    else
+      count_uncached(1, 0, size, size > MAX_SMALL);
+    Header *h = nullptr;
+    if (size > MAX_SMALL)
+    {
+      h = static_cast<Header *>(std::malloc(sizeof(Header) + size));
+      if (!h)
+        return nullptr;
+      h->size_class = LARGE;
+    }
+    else
+    {
+      size_t index = class_of(size);
+      h = cache ? pop_local(*cache, index) : pop_central(index);
+      if (!h)
+        return nullptr;
+      if (central().debug)
+        check_poison(h, sizeof(Link));
+    }
+    h->size = size;
+    h->state = LIVE;
+    if (central().debug)
+      std::memset(h + 1, FRESH, size);
+    return h + 1;
+  }
+
+  static void release(void *ptr)
+  {
+    if (!ptr)
+      return;
+    Header *h = static_cast<Header *>(ptr) - 1;
+    if (h->state != LIVE)
+      fail("double or invalid free", h);
+    h->state = DEAD;
+    ThreadCache *cache = local();
+    if (cache)
+      cache->counters.frees.add();
+    else
+      count_uncached(0, 1, 0, 0);
+    if (central().debug)
+      std::memset(h + 1, POISON, payload_bytes(h));
+    if (!cache)
+      return recycle_central(h);
+    if (!central().debug)
+      return recycle(*cache, h);
+    Header *&slot = cache->quarantine[cache->quarantined++ % QUARANTINE];
+    Header *evicted = slot;
+    slot = h;
+    if (evicted)
+    {
+      check_poison(evicted, 0);
+      recycle(*cache, evicted);
+    }
+  }
+
+  static void *resize(void *ptr, size_t size)
+  {
+    if (!ptr)
+      return alloc(size);
+    Header *h = static_cast<Header *>(ptr) - 1;
+    if (h->state != LIVE)
+      fail("realloc of a freed block", h);
+    if (!central().debug && h->size_class != LARGE && size <= class_size(h->size_class))
+    {
+      h->size = size; // still fits its class
+      return ptr;
+    }
+    void *moved = alloc(size);
+    if (!moved)
+      return nullptr;
+    std::memcpy(moved, ptr, h->size < size ? h->size : size);
+    release(ptr);
+    return moved;
+  }
+
+  static char *duplicate(const char *text)
+  {
+    size_t n = std::strlen(text) + 1;
+    auto *copy = static_cast<char *>(alloc(n));
+    if (copy)
+      std::memcpy(copy, text, n);
+    return copy;
+  }
+
+  static void *zeroed(size_t count, size_t size)
+  {
+    if (size && count > SIZE_MAX / size)
+      return nullptr;
+    void *p = alloc(count * size);
+    if (p)
+      std::memset(p, 0, count * size);
+    return p;
+  }
+
+  static size_t payload_bytes(const Header *h)
+  {
+    return h->size_class == LARGE ? h->size : class_size(h->size_class);
+  }
+
+  // Every payload byte from offset on must still be POISON
+  static void check_poison(Header *h, size_t offset)
+  {
+    auto *p = reinterpret_cast<const unsigned char *>(h + 1);
+    size_t n = payload_bytes(h);
+    for (size_t i = offset; i < n; ++i)
+      if (p[i] != POISON)
+        fail("write after free", h, ", byte " + std::to_string(i) + " is " + std::to_string(p[i]));
+  }
+
+  [[noreturn]] static void fail(const char *what, const Header *h, const std::string &detail = {})
+  {
+    std::fprintf(stderr, "[alloc] %s: block %p, %llu bytes requested%s\n", what, static_cast<const void *>(h + 1),
+                 static_cast<unsigned long long>(h->size), detail.c_str());
+    std::abort();
+  }
+
+  static void recycle(ThreadCache &cache, Header *h)
+  {
+    if (h->size_class == LARGE)
+      return std::free(h);
+    size_t index = h->size_class;
+    auto *link = reinterpret_cast<Link *>(h + 1);
+    link->next = cache.heads[index];
+    cache.heads[index] = link;
+    if (++cache.counts[index] < 2 * batch(index))
+      return;
+    // Hand the older half back so one thread cannot hoard a class
+    Link *keep = cache.heads[index];
+    for (size_t i = 1; i < batch(index); ++i)
+      keep = keep->next;
+    Link *rest = keep->next;
+    keep->next = nullptr;
+    give_back(index, rest, cache.counts[index] - batch(index));
+    cache.counts[index] = batch(index);
+  }
+
+  static void recycle_central(Header *h)
+  {
+    if (h->size_class == LARGE)
+      return std::free(h);
+    auto *link = reinterpret_cast<Link *>(h + 1);
+    link->next = nullptr;
+    give_back(h->size_class, link, 1);
+  }
+
+  // Splices a chain of n blocks onto the central list
+  static void give_back(size_t index, Link *chain, size_t n)
+  {
+    if (!chain || n == 0)
+      return;
+    Link *tail = chain;
+    while (tail->next)
+      tail = tail->next;
+    FreeList &list = central().lists[index];
+    std::lock_guard<std::mutex> lock(list.lock);
+    tail->next = list.head;
+    list.head = chain;
+  }
+
+  static Header *pop_local(ThreadCache &cache, size_t index)
+  {
+    if (!cache.heads[index])
+    {
+      cache.counters.refills.add();
+      cache.counts[index] = take(index, batch(index), cache.heads[index]);
+    }
+    Link *link = cache.heads[index];
+    if (!link)
+      return nullptr;
+    cache.heads[index] = link->next;
+    --cache.counts[index];
+    return header_of(link, index);
+  }
+
+  static Header *pop_central(size_t index)
+  {
+    Link *link = nullptr;
+    take(index, 1, link);
+    return link ? header_of(link, index) : nullptr;
+  }
+
+  static Header *header_of(Link *link, size_t index)
+  {
+    Header *h = reinterpret_cast<Header *>(link) - 1;
+    h->size_class = static_cast<uint32_t>(index);
+    if (central().debug)
+      std::memset(link, POISON, sizeof(Link)); // the link word is the one byte range not poisoned
+    return h;
+  }
+
+  // Up to n blocks into out as a chain, carving a new slab when the central
+  // list is empty; returns how many.
+  static size_t take(size_t index, size_t n, Link *&out)
+  {
+    FreeList &list = central().lists[index];
+    std::lock_guard<std::mutex> lock(list.lock);
+    if (!list.head)
+      carve(index, list);
+    size_t got = 0;
+    Link *tail = nullptr;
+    while (list.head && got < n)
+    {
+      Link *link = list.head;
+      list.head = link->next;
+      link->next = nullptr;
+      if (tail)
+        tail->next = link;
+      else
+        out = link;
+      tail = link;
+      ++got;
+    }
+    return got;
+  }
+
+  static void carve(size_t index, FreeList &list)
+  {
+    void *slab = mmap(nullptr, SLAB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED)
+      return;
+    Central &c = central();
+    c.slab_bytes.fetch_add(SLAB_BYTES, std::memory_order_relaxed);
+    size_t stride = block_bytes(index);
+    auto *base = static_cast<char *>(slab);
+    for (size_t offset = 0; offset + stride <= SLAB_BYTES; offset += stride)
+    {
+      auto *h = reinterpret_cast<Header *>(base + offset);
+      h->size_class = static_cast<uint32_t>(index);
+      h->state = DEAD;
+      if (c.debug)
+        std::memset(h + 1, POISON, class_size(index));
+      auto *link = reinterpret_cast<Link *>(h + 1);
+      link->next = list.head;
+      list.head = link;
+    }
+  }
+
+  friend Totals operator+(const Totals &a, const Totals &b)
+  {
+    return {a.allocs + b.allocs, a.frees + b.frees, a.bytes + b.bytes, a.large + b.large, a.refills + b.refills,
+            a.slab_bytes + b.slab_bytes};
+  }
+};
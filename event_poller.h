@@ -0,0 +1,136 @@
+// event_poller.h - minimal fd readiness poller: epoll on Linux, kqueue on macOS.
+// Header-only so both the stress program and companion tools can share it.
+
+#pragma once
+
+#include <cerrno>
+#include <span>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#error "event_poller.h requires epoll or kqueue"
+#endif
+
+class EventPoller
+{
+public:
+  // Interest / readiness bits
+  static constexpr unsigned READABLE = 1u << 0;
+  static constexpr unsigned WRITABLE = 1u << 1;
+  static constexpr unsigned ERROR = 1u << 2; // readiness only
+
+  struct Event
+  {
+    int fd;
+    unsigned what;
+  };
+
+  EventPoller()
+  {
+#if defined(__linux__)
+    fd_ = epoll_create1(EPOLL_CLOEXEC);
+#else
+    fd_ = kqueue();
+#endif
+  }
+
+  ~EventPoller()
+  {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  EventPoller(const EventPoller &) = delete;
+  EventPoller &operator=(const EventPoller &) = delete;
+
+  bool valid() const { return fd_ >= 0; }
+
+  // Register fd or replace its interest set.
+  bool set(int fd, unsigned interest)
+  {
+#if defined(__linux__)
+    epoll_event ev{};
+    ev.events = ((interest & READABLE) ? EPOLLIN : 0u) | ((interest & WRITABLE) ? EPOLLOUT : 0u);
+    ev.data.fd = fd;
+    if (epoll_ctl(fd_, EPOLL_CTL_MOD, fd, &ev) == 0)
+      return true;
+    return errno == ENOENT && epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    // Always EV_ADD both filters and toggle them, so no bookkeeping of what is
+    // currently registered is needed.
+    struct kevent changes[2];
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | ((interest & READABLE) ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | ((interest & WRITABLE) ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+    return kevent(fd_, changes, 2, nullptr, 0, nullptr) == 0;
+#endif
+  }
+
+  // Deregister fd. Errors are ignored: the fd may already be closed.
+  void remove(int fd)
+  {
+#if defined(__linux__)
+    epoll_ctl(fd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+    struct kevent changes[2];
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    kevent(fd_, &changes[0], 1, nullptr, 0, nullptr);
+    kevent(fd_, &changes[1], 1, nullptr, 0, nullptr);
+#endif
+  }
+
+  // Wait up to timeout_ms (-1 = forever). Returns the number of events written
+  // to out, 0 on timeout or EINTR.
+  int wait(std::span<Event> out, int timeout_ms)
+  {
+    constexpr int BATCH = 256;
+    int max = out.size() < BATCH ? static_cast<int>(out.size()) : BATCH;
+#if defined(__linux__)
+    epoll_event raw[BATCH];
+    int n = epoll_wait(fd_, raw, max, timeout_ms);
+    if (n < 0)
+      return 0;
+    for (int i = 0; i < n; ++i)
+    {
+      unsigned what = 0;
+      if (raw[i].events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))
+        what |= READABLE;
+      if (raw[i].events & EPOLLOUT)
+        what |= WRITABLE;
+      if (raw[i].events & EPOLLERR)
+        what |= ERROR;
+      out[i] = Event{raw[i].data.fd, what};
+    }
+    return n;
+#else
+    struct kevent raw[BATCH];
+    struct timespec ts;
+    struct timespec *tsp = nullptr;
+    if (timeout_ms >= 0)
+    {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      tsp = &ts;
+    }
+    int n = kevent(fd_, nullptr, 0, raw, max, tsp);
+    if (n < 0)
+      return 0;
+    for (int i = 0; i < n; ++i)
+    {
+      unsigned what = raw[i].filter == EVFILT_READ ? READABLE : WRITABLE;
+      if (raw[i].flags & EV_ERROR)
+        what |= ERROR;
+      out[i] = Event{static_cast<int>(raw[i].ident), what};
+    }
+    return n;
+#endif
+  }
+
+private:
+  int fd_ = -1;
+};
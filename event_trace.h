@@ -0,0 +1,155 @@
+// event_trace.h - compact binary record of a run's scheduling decisions:
+// every transfer added, cancelled or aborted, every completion and every
+// resolver fault decision, 24 bytes each after a fixed header. Records are
+// written in host byte order through one buffered, mutex-guarded writer
+// that worker and resolver threads share; crasher --replay feeds them back.
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class TraceEvent : uint8_t
+{
+  add = 1, // transfer = per-thread sequence, code = URL category, arg = URL index in it
+  cancel,  // random cancel of transfer
+  abort,   // progress callback aborted transfer after arg KiB
+  done,    // CURLMSG_DONE, code = CURLcode (truncated to 8 bits)
+  end,     // the thread reached its deadline
+  resolve, // fault decision: transfer = fnv1a32(host), code = error index + 1 (0 none), arg = delay ms
+};
+
+inline constexpr uint16_t TRACE_NO_THREAD = 0xffff; // resolver records
+inline constexpr size_t TRACE_MAX_CATEGORIES = 256; // add records keep the category in code
+
+struct TraceRecord
+{
+  uint64_t time_us; // since the round started
+  uint32_t transfer;
+  uint32_t arg;
+  uint16_t thread;
+  TraceEvent event;
+  uint8_t code;
+  uint32_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 24);
+
+struct TraceHeader
+{
+  char magic[8] = {'C', 'R', 'T', 'R', 'A', 'C', 'E', '\0'};
+  uint32_t version = 1;
+  uint32_t threads = 0;
+  uint64_t seed = 0;
+  uint64_t corpus_size = 0; // replay needs the same corpus to map URL indices
+};
+static_assert(sizeof(TraceHeader) == 32);
+
+class TraceWriter
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  // nullptr (with error set) if path cannot be created.
+  static std::unique_ptr<TraceWriter> create(const std::string &path, const TraceHeader &header, std::string &error)
+  {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f || std::fwrite(&header, sizeof(header), 1, f) != 1)
+    {
+      error = path + ": " + std::strerror(errno);
+      if (f)
+        std::fclose(f);
+      return nullptr;
+    }
+    return std::unique_ptr<TraceWriter>(new TraceWriter(f));
+  }
+
+  ~TraceWriter() { close(); }
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  // Time base for the records; set before any thread records.
+  void start(clock::time_point origin) { origin_ = origin; }
+
+  void record(TraceEvent event, uint16_t thread, uint32_t transfer, uint32_t arg = 0, uint8_t code = 0)
+  {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - origin_).count();
+    TraceRecord r{static_cast<uint64_t>(std::max<int64_t>(us, 0)), transfer, arg, thread, event, code, 0};
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_)
+      return; // a detached resolver thread after close()
+    buffer_.push_back(r);
+    ++records_;
+    if (buffer_.size() == BUFFER_RECORDS)
+      flush_locked();
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_)
+      return;
+    flush_locked();
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+
+  uint64_t records() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+  }
+
+private:
+  static constexpr size_t BUFFER_RECORDS = 4096;
+
+  explicit TraceWriter(FILE *f) : file_(f) { buffer_.reserve(BUFFER_RECORDS); }
+
+  void flush_locked()
+  {
+    if (!buffer_.empty())
+      std::fwrite(buffer_.data(), sizeof(TraceRecord), buffer_.size(), file_);
+    buffer_.clear();
+  }
+
+  mutable std::mutex mutex_;
+  FILE *file_;
+  std::vector<TraceRecord> buffer_;
+  uint64_t records_ = 0;
+  clock::time_point origin_ = clock::now();
+};
+
+// Read a whole trace; records come back in the order they were written,
+// which is time order per thread.
+inline bool load_trace(const std::string &path, TraceHeader &header, std::vector<TraceRecord> &records,
+                       std::string &error)
+{
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+  {
+    error = path + ": " + std::strerror(errno);
+    return false;
+  }
+  const TraceHeader expected;
+  bool ok = std::fread(&header, sizeof(header), 1, f) == 1 &&
+            std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+            header.version == expected.version;
+  if (ok)
+  {
+    TraceRecord r;
+    while (std::fread(&r, sizeof(r), 1, f) == 1)
+      records.push_back(r);
+  }
+  std::fclose(f);
+  if (!ok)
+    error = path + ": not a crasher trace";
+  return ok;
+}
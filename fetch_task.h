@@ -0,0 +1,315 @@
+// fetch_task.h - C++ coroutines on top of one CURLM. Task<T> is a lazy,
+// single-owner coroutine. Inside one, co_await scheduler.perform(easy) adds
+// the handle to the multi and suspends until its CURLMSG_DONE, and
+// co_await scheduler.sleep_for(d) until a deadline. The thread driving the
+// multi calls dispatch() after each drive step to resume the frames those
+// made ready. Destroying a Task destroys its frame, and the awaiter it is
+// suspended in removes its handle from the multi or drops its timer: that
+// is how a flow is cancelled. Single-threaded, like the multi handle.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <curl/curl.h>
+#include <exception>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Task;
+
+struct TaskPromiseBase
+{
+  std::coroutine_handle<> continuation; // the awaiting frame, resumed when this one finishes
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter
+  {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept
+    {
+      std::coroutine_handle<> next = self.promise().continuation;
+      return next ? next : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+  std::optional<T> value;
+
+  Task<T> get_return_object();
+  void return_value(T v) { value = std::move(v); }
+  T take() { return std::move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+  Task<void> get_return_object();
+  void return_void() {}
+  void take() {}
+};
+
+template <typename T = void>
+class Task
+{
+public:
+  using promise_type = TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+  explicit Task(Handle h) : h_(h) {}
+  Task(Task &&other) noexcept : h_(std::exchange(other.h_, {})), started_(other.started_) {}
+  Task &operator=(Task &&other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      h_ = std::exchange(other.h_, {});
+      started_ = other.started_;
+    }
+    return *this;
+  }
+  ~Task() { reset(); }
+
+  // Runs the task up to its first suspension; a later co_await only waits.
+  void start()
+  {
+    if (h_ && !started_)
+    {
+      started_ = true;
+      h_.resume();
+    }
+  }
+
+  bool done() const { return !h_ || h_.done(); }
+
+  // Destroys the frame wherever it is suspended
+  void reset()
+  {
+    if (h_)
+      h_.destroy();
+    h_ = {};
+    started_ = false;
+  }
+
+  auto operator co_await() noexcept
+  {
+    struct Awaiter
+    {
+      Task &task;
+      bool await_ready() const noexcept { return task.h_.done(); }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+      {
+        task.h_.promise().continuation = caller;
+        if (task.started_)
+          return std::noop_coroutine(); // already suspended elsewhere; it resumes us when it finishes
+        task.started_ = true;
+        return task.h_;
+      }
+      T await_resume() { return task.h_.promise().take(); }
+    };
+    return Awaiter{*this};
+  }
+
+private:
+  Handle h_;
+  bool started_ = false;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Runs tasks side by side; the results come back in order.
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks)
+{
+  for (Task<T> &t : tasks)
+    t.start();
+  std::vector<T> results;
+  results.reserve(tasks.size());
+  for (Task<T> &t : tasks)
+    results.push_back(co_await t);
+  co_return results;
+}
+
+class FetchScheduler
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit FetchScheduler(CURLM *multi) : multi_(multi) {}
+
+  // Cancels every flow still running; the multi must outlive this.
+  ~FetchScheduler() { cancel_all(); }
+
+  FetchScheduler(const FetchScheduler &) = delete;
+  FetchScheduler &operator=(const FetchScheduler &) = delete;
+
+  // co_await perform(easy) -> CURLcode. The handle is off the multi again
+  // when the caller resumes.
+  class Perform
+  {
+  public:
+    Perform(FetchScheduler &scheduler, CURL *easy) : scheduler_(scheduler), easy_(easy) {}
+    ~Perform()
+    {
+      if (!pending_)
+        return;
+      scheduler_.waiting_.erase(easy_);
+      curl_multi_remove_handle(scheduler_.multi_, easy_);
+    }
+    Perform(const Perform &) = delete;
+    Perform &operator=(const Perform &) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> caller)
+    {
+      if (curl_multi_add_handle(scheduler_.multi_, easy_) != CURLM_OK)
+      {
+        result_ = CURLE_FAILED_INIT;
+        return false;
+      }
+      caller_ = caller;
+      pending_ = true;
+      scheduler_.waiting_[easy_] = this;
+      return true;
+    }
+    CURLcode await_resume() const noexcept { return result_; }
+
+  private:
+    friend FetchScheduler;
+    FetchScheduler &scheduler_;
+    CURL *easy_;
+    std::coroutine_handle<> caller_;
+    bool pending_ = false;
+    CURLcode result_ = CURLE_OK;
+  };
+
+  class Sleep
+  {
+  public:
+    Sleep(FetchScheduler &scheduler, clock::time_point when) : scheduler_(scheduler), when_(when) {}
+    ~Sleep()
+    {
+      if (pending_)
+        scheduler_.timers_.erase(entry_);
+    }
+    Sleep(const Sleep &) = delete;
+    Sleep &operator=(const Sleep &) = delete;
+
+    bool await_ready() const noexcept { return when_ <= clock::now(); }
+    void await_suspend(std::coroutine_handle<> caller)
+    {
+      caller_ = caller;
+      pending_ = true;
+      entry_ = scheduler_.timers_.emplace(when_, this);
+    }
+    void await_resume() const noexcept {}
+
+  private:
+    friend FetchScheduler;
+    FetchScheduler &scheduler_;
+    clock::time_point when_;
+    std::coroutine_handle<> caller_;
+    bool pending_ = false;
+    std::multimap<clock::time_point, Sleep *>::iterator entry_;
+  };
+
+  Perform perform(CURL *easy) { return Perform(*this, easy); }
+  Sleep sleep_for(clock::duration d) { return Sleep(*this, clock::now() + d); }
+
+  // Starts a top-level task, owned by the scheduler until it finishes.
+  void spawn(Task<void> task)
+  {
+    roots_.push_back(std::move(task));
+    roots_.back().start();
+  }
+
+  size_t tasks() const { return roots_.size(); }
+  size_t in_flight() const { return waiting_.size(); }
+
+  // Destroys top-level task i, and whatever it is waiting on.
+  void cancel(size_t i)
+  {
+    Task<void> victim = std::move(roots_[i]);
+    roots_[i] = std::move(roots_.back());
+    roots_.pop_back();
+  }
+
+  void cancel_all()
+  {
+    while (!roots_.empty())
+      cancel(roots_.size() - 1);
+  }
+
+  // How long the driver may sleep: until the next timer, at most max_wait.
+  std::chrono::milliseconds next_wakeup(std::chrono::milliseconds max_wait) const
+  {
+    if (timers_.empty())
+      return max_wait;
+    return std::clamp(std::chrono::ceil<std::chrono::milliseconds>(timers_.begin()->first - clock::now()),
+                      std::chrono::milliseconds(0), max_wait);
+  }
+
+  // After each drive step: resumes frames whose transfers are done or whose
+  // timers expired, then frees the top-level tasks that finished.
+  void dispatch()
+  {
+    int msgs_left = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi_, &msgs_left))
+    {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      auto it = waiting_.find(msg->easy_handle);
+      if (it == waiting_.end())
+        continue;
+      Perform *p = it->second;
+      p->result_ = msg->data.result; // msg dies with the removal
+      waiting_.erase(it);
+      curl_multi_remove_handle(multi_, p->easy_);
+      p->pending_ = false;
+      p->caller_.resume();
+    }
+    for (clock::time_point now = clock::now(); !timers_.empty() && timers_.begin()->first <= now;)
+    {
+      Sleep *s = timers_.begin()->second;
+      timers_.erase(timers_.begin());
+      s->pending_ = false;
+      s->caller_.resume();
+    }
+    for (size_t i = 0; i < roots_.size();)
+      if (roots_[i].done())
+        cancel(i);
+      else
+        ++i;
+  }
+
+private:
+  CURLM *multi_;
+  std::unordered_map<CURL *, Perform *> waiting_;
+  std::multimap<clock::time_point, Sleep *> timers_;
+  std::vector<Task<void>> roots_;
+};
@@ -1,14 +1,23 @@
-// hook_getaddrinfo.cpp - interpose getaddrinfo using fishhook on macOS
-// Build as part of resolver_interpose dylib.
+// hook_getaddrinfo.cpp - fault-injection core of the resolver_interpose
+// library. The platform backend (interpose_fishhook.cpp on macOS,
+// interpose_elf.cpp on Linux) routes getaddrinfo here.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <charconv>
 #include <chrono>
-#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <netdb.h>
 #include <random>
-#include <sstream>
+#include <semaphore>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <utility>
@@ -20,33 +29,27 @@
 #define EAI_CANCELED -4000 // Custom value that doesn't conflict with standard ones
 #endif
 
-extern "C"
-{
-#include "fishhook.h"
-}
-
-using getaddrinfo_fn = int (*)(const char *, const char *, const struct addrinfo *, struct addrinfo **);
-static getaddrinfo_fn real_gai = nullptr;
-static std::mutex gai_mutex;
-
-#ifdef MYAPP_LOGGING_ENABLED
-// Thread-safe logging for interposer (outputs to stderr)
-static std::mutex interposer_log_mutex;
+#include "alias_table.h"
+#include "prng.h"
+#include "resolver_interpose.h"
 
-template <typename... Args>
-void log_interposer(Args &&...args)
-{
-  std::ostringstream stream;
-  (stream << ... << std::forward<Args>(args));
+getaddrinfo_fn real_gai = nullptr;
+freeaddrinfo_fn real_freeaddrinfo = nullptr;
 
-  std::lock_guard<std::mutex> lock(interposer_log_mutex);
-  std::cerr << stream.str() << std::endl;
-}
-#else  // MYAPP_LOGGING_ENABLED
-// Empty inline function when logging is disabled
-template <typename... Args>
-inline void log_interposer(Args &&...) {}
-#endif // MYAPP_LOGGING_ENABLED
+// Concurrency control for the real resolver, configured once in init():
+//   RESOLVER_INTERPOSE_SERIAL=1      one lookup at a time for the whole call,
+//                                    injected delay included (legacy behaviour)
+//   RESOLVER_INTERPOSE_GAI_LIMIT=N   at most N concurrent real_gai calls
+//   RESOLVER_INTERPOSE_GAI_SHARDS=N  at most one real_gai call per host shard
+// Fault decisions and injected delays never take a lock unless SERIAL is set.
+static constexpr size_t MAX_GAI_SHARDS = 256;
+static std::mutex gai_mutex; // only used in serial mode
+static bool serial_mode = false;
+// Leaked on purpose: detached resolver threads may still be in the hook
+// during static destruction.
+static std::counting_semaphore<> *gai_limit = nullptr;
+static std::mutex *gai_shards = nullptr;
+static size_t gai_shard_count = 0;
 
 static consteval int ErrorCodeMax()
 {
@@ -106,71 +109,373 @@ static consteval int TOTAL_ERROR_WEIGHT()
   }
   return total;
 }
+static_assert(TOTAL_ERROR_WEIGHT() > 0, "ERROR_CODES needs at least one non-zero weight");
+static_assert(ERROR_CODES.size() <= MAX_ERROR_CODES, "raise MAX_ERROR_CODES");
 
-static int hook_getaddrinfo(const char *node, const char *service,
-                            const struct addrinfo *hints,
-                            struct addrinfo **res)
+size_t error_code_count() { return ERROR_CODES.size(); }
+const char *error_code_name(size_t index) { return ERROR_CODES[index].name; }
+
+int error_code_index(int code)
 {
-  const std::lock_guard<std::mutex> lock(gai_mutex);
-  static thread_local std::mt19937 rng{std::random_device{}()};
-  static thread_local std::uniform_int_distribution<int> dice(0, 99); // 0-99 for percentages
-  static thread_local std::uniform_int_distribution<int> error_dice(1, TOTAL_ERROR_WEIGHT());
-  int pick = dice(rng);
-  log_interposer("\t[getaddrinfo] host ", (node ? node : "(null)"), " pick=", pick);
+  for (size_t i = 0; i < ERROR_CODES.size(); ++i)
+    if (ERROR_CODES[i].code == code)
+      return static_cast<int>(i);
+  return -1;
+}
 
-  int result;
-  if (pick < 40)
-  { // 40% probability of failure with various error codes
-    // Select an error code based on weighted probability
-    int error_pick = error_dice(rng);
-    int cumulative_weight = 0;
+// What a hooked call does: fail with an error from ERROR_CODES, sleep then
+// resolve, or resolve right away.
+enum class Outcome : uint8_t
+{
+  fail,
+  delay,
+  fast,
+};
 
-    const ErrorCode *selected_error = nullptr;
+static constexpr std::array<const char *, 3> OUTCOME_NAMES = {"fail", "delay", "fast"};
 
-    for (const auto &err : ERROR_CODES)
-    {
-      cumulative_weight += err.weight;
-      if (error_pick <= cumulative_weight)
-      {
-        selected_error = &err;
-        break;
-      }
-    }
+// Fault distribution sampled in O(1) per call. The default is built at
+// compile time; RESOLVER_INTERPOSE_PROFILE (inline) or
+// RESOLVER_INTERPOSE_PROFILE_FILE (path) override it once in init(), e.g.
+//   fail=40,delay=40,fast=20,delay_ms=100-199,EAI_AGAIN=30,EAI_NONAME=0
+// Entries may be separated by commas, semicolons or whitespace; '#' starts a
+// comment. Error codes not mentioned keep their ERROR_CODES weight.
+struct FaultProfile
+{
+  std::array<uint64_t, 3> outcome_weights;
+  std::array<uint64_t, ERROR_CODES.size()> error_weights;
+  AliasTable<3> outcomes;
+  AliasTable<ERROR_CODES.size()> errors;
+  int delay_min_ms;
+  int delay_max_ms;
+};
 
-    if (!selected_error)
-    {
-      // Fallback in case of calculation error
-      selected_error = &ERROR_CODES[0]; // Default to EAI_AGAIN
-    }
+static consteval FaultProfile default_profile()
+{
+  FaultProfile p{};
+  p.outcome_weights = {40, 40, 20};
+  for (size_t i = 0; i < ERROR_CODES.size(); ++i)
+    p.error_weights[i] = static_cast<uint64_t>(ERROR_CODES[i].weight);
+  p.outcomes = AliasTable<3>(p.outcome_weights);
+  p.errors = AliasTable<ERROR_CODES.size()>(p.error_weights);
+  // Historical behaviour: 100 + (0..99) % 300, i.e. 100-199 ms
+  p.delay_min_ms = 100;
+  p.delay_max_ms = 199;
+  return p;
+}
 
-    log_interposer("\t[getaddrinfo] returning ", selected_error->name, ": ", selected_error->description);
-    result = selected_error->code;
+static constinit FaultProfile fault_profile = default_profile();
+
+static size_t env_size(const char *name, size_t fallback)
+{
+  const char *value = std::getenv(name);
+  if (!value || !*value)
+    return fallback;
+  char *end = nullptr;
+  unsigned long long parsed = std::strtoull(value, &end, 10);
+  return (end && *end == '\0') ? static_cast<size_t>(parsed) : fallback;
+}
+
+// Call the real resolver honouring the configured concurrency cap and host
+// sharding. Both are optional; with neither set the call is fully concurrent.
+static int call_real_gai(const char *node, const char *service,
+                         const struct addrinfo *hints,
+                         struct addrinfo **res)
+{
+  std::unique_lock<std::mutex> shard_lock;
+  if (gai_shard_count > 0)
+  {
+    size_t shard = std::hash<std::string_view>{}(node ? node : "") % gai_shard_count;
+    shard_lock = std::unique_lock<std::mutex>(gai_shards[shard]);
   }
-  else
+
+  if (!gai_limit)
+    return real_gai(node, service, hints, res);
+
+  gai_limit->acquire();
+  int result = real_gai(node, service, hints, res);
+  gai_limit->release();
+  return result;
+}
+
+// Apply one "key=value" profile entry; returns false if it is not understood.
+static bool apply_profile_entry(FaultProfile &p, std::string_view key, std::string_view value)
+{
+  auto number = [](std::string_view text, auto &out) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+  };
+
+  if (key == "delay_ms")
+  {
+    size_t dash = value.find('-');
+    int lo = 0, hi = 0;
+    if (dash == std::string_view::npos || !number(value.substr(0, dash), lo) ||
+        !number(value.substr(dash + 1), hi) || lo < 0 || hi < lo)
+      return false;
+    p.delay_min_ms = lo;
+    p.delay_max_ms = hi;
+    return true;
+  }
+
+  uint64_t weight = 0;
+  if (!number(value, weight))
+    return false;
+  for (size_t i = 0; i < OUTCOME_NAMES.size(); ++i)
   {
-    if (pick < 80)
+    if (key == OUTCOME_NAMES[i])
     {
-      int ms = 100 + dice(rng) % 300; // 100-300 ms
-      log_interposer("\t[getaddrinfo] delay ", ms, " ms for host ", (node ? node : "(null)"));
-      std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+      p.outcome_weights[i] = weight;
+      return true;
     }
-    else
+  }
+  for (size_t i = 0; i < ERROR_CODES.size(); ++i)
+  {
+    if (key == ERROR_CODES[i].name)
     {
-      log_interposer("\t[getaddrinfo] fast resolve for host ", (node ? node : "(null)"));
+      p.error_weights[i] = weight;
+      return true;
     }
+  }
+  return false;
+}
 
-    // Protect the real getaddrinfo call with a mutex to avoid concurrent calls
-    // which might lead to heap-use-after-free in curl's threaded resolver
-    result = real_gai(node, service, hints, res);
+// Parse a profile spec over the defaults. Invalid entries are logged and
+// skipped; a distribution that ends up all-zero keeps its default.
+static FaultProfile parse_profile(std::string_view spec)
+{
+  FaultProfile p = default_profile();
+  for_each_spec_entry(spec, [&](std::string_view entry, std::string_view key, std::string_view value) {
+    if (value.empty() || !apply_profile_entry(p, key, value))
+      log_interposer("[profile] ignoring invalid entry '", entry, "'");
+  });
+
+  AliasTable<3> outcomes(p.outcome_weights);
+  AliasTable<ERROR_CODES.size()> errors(p.error_weights);
+  const FaultProfile defaults = default_profile();
+  if (outcomes.valid())
+    p.outcomes = outcomes;
+  else
+    p.outcome_weights = defaults.outcome_weights;
+  if (errors.valid())
+    p.errors = errors;
+  else
+    p.error_weights = defaults.error_weights;
+  return p;
+}
+
+static std::string read_file(const char *path)
+{
+  std::string text;
+  if (FILE *f = std::fopen(path, "r"))
+  {
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+      text.append(buf, n);
+    std::fclose(f);
+  }
+  else
+  {
+    log_interposer("[profile] cannot read ", path);
+  }
+  return text;
+}
+
+// Reproducible decisions. A thread's generator is (re)seeded on its first
+// draw after resolver_interpose_seed, from the seed and the order in which
+// threads drew first, so a seeded run repeats its decisions as long as
+// lookups start in the same order. Unseeded threads use a random seed.
+static std::atomic<uint64_t> seed_epoch{0}; // 0 = unseeded
+static std::atomic<uint64_t> seed_value{0};
+static std::atomic<uint64_t> seeded_threads{0};
+
+static Xoshiro256ss &fault_rng()
+{
+  struct State
+  {
+    Xoshiro256ss rng{random_seed()};
+    uint64_t epoch = 0;
+  };
+  static thread_local State state;
+  uint64_t epoch = seed_epoch.load(std::memory_order_acquire);
+  if (state.epoch != epoch)
+  {
+    uint64_t ordinal = seeded_threads.fetch_add(1, std::memory_order_relaxed);
+    state.rng = Xoshiro256ss(derive_seed(seed_value.load(std::memory_order_relaxed), ordinal));
+    state.epoch = epoch;
   }
+  return state.rng;
+}
+
+extern "C" void resolver_interpose_seed(uint64_t seed)
+{
+  seed_value.store(seed, std::memory_order_relaxed);
+  seeded_threads.store(0, std::memory_order_relaxed);
+  seed_epoch.fetch_add(1, std::memory_order_release);
+  log_interposer("[seed] ", seed);
+}
+
+static std::atomic<resolver_observer_fn> observer{nullptr};
+static std::atomic<void *> observer_ctx{nullptr};
+
+extern "C" void resolver_interpose_observe(resolver_observer_fn fn, void *ctx)
+{
+  observer_ctx.store(ctx, std::memory_order_relaxed);
+  observer.store(fn, std::memory_order_release);
+}
+
+// Scripted decisions per host hash, consumed in order (crasher --replay).
+// The map is leaked like the other pools: resolver threads may outlive it.
+static std::mutex script_mutex;
+static std::atomic<bool> script_active{false};
+
+static std::unordered_map<uint32_t, std::deque<FaultDecision>> &script()
+{
+  static auto *queues = new std::unordered_map<uint32_t, std::deque<FaultDecision>>();
+  return *queues;
+}
+
+extern "C" void resolver_interpose_script(const uint32_t *host_hash, const int *error_index, const int *delay_ms,
+                                          size_t count)
+{
+  std::lock_guard<std::mutex> lock(script_mutex);
+  for (size_t i = 0; i < count; ++i)
+  {
+    int index = error_index[i] >= 0 && static_cast<size_t>(error_index[i]) < ERROR_CODES.size() ? error_index[i] : -1;
+    int error = index >= 0 ? ERROR_CODES[static_cast<size_t>(index)].code : 0;
+    script()[host_hash[i]].push_back(FaultDecision{error, index, error ? 0 : std::max(delay_ms[i], 0)});
+  }
+  script_active.store(!script().empty(), std::memory_order_release);
+  log_interposer("[script] ", count, " decisions for ", script().size(), " hosts");
+}
+
+static bool next_scripted(const char *node, FaultDecision &out)
+{
+  std::lock_guard<std::mutex> lock(script_mutex);
+  auto it = script().find(fnv1a32(node ? node : ""));
+  if (it == script().end() || it->second.empty())
+    return false;
+  out = it->second.front();
+  it->second.pop_front();
+  return true;
+}
+
+static FaultDecision draw_fault(const char *node)
+{
+  Xoshiro256ss &rng = fault_rng();
+  const FaultProfile &profile = fault_profile;
+  auto outcome = static_cast<Outcome>(profile.outcomes.sample(rng()));
+  log_interposer("\t[getaddrinfo] host ", (node ? node : "(null)"), " outcome=", OUTCOME_NAMES[size_t(outcome)]);
+
+  if (outcome == Outcome::fail)
+  {
+    size_t index = profile.errors.sample(rng());
+    const ErrorCode *selected_error = &ERROR_CODES[index];
+    log_interposer("\t[getaddrinfo] returning ", selected_error->name, ": ", selected_error->description);
+    return {selected_error->code, static_cast<int>(index), 0};
+  }
+  if (outcome == Outcome::delay)
+  {
+    int span = profile.delay_max_ms - profile.delay_min_ms + 1;
+    int ms = profile.delay_min_ms + static_cast<int>(rng() % static_cast<uint64_t>(span));
+    log_interposer("\t[getaddrinfo] delay ", ms, " ms for host ", (node ? node : "(null)"));
+    return {0, -1, ms};
+  }
+  log_interposer("\t[getaddrinfo] fast resolve for host ", (node ? node : "(null)"));
+  return {0, -1, 0};
+}
+
+uint64_t fault_random() { return fault_rng()(); }
+
+FaultDecision decide_fault(const char *node)
+{
+  FaultDecision fault{};
+  if (!script_active.load(std::memory_order_acquire) || !next_scripted(node, fault))
+    fault = draw_fault(node);
+  telemetry_fault(node, fault);
+  if (resolver_observer_fn fn = observer.load(std::memory_order_acquire))
+    fn(observer_ctx.load(std::memory_order_relaxed), node, fault.error_index, fault.delay_ms);
+  return fault;
+}
+
+int hook_getaddrinfo(const char *node, const char *service,
+                     const struct addrinfo *hints,
+                     struct addrinfo **res)
+{
+  std::unique_lock<std::mutex> serial_lock;
+  if (serial_mode)
+    serial_lock = std::unique_lock<std::mutex>(gai_mutex);
+
+  FaultDecision fault = decide_fault(node);
+  if (fault.error != 0)
+    return fault.error;
+  if (fault.delay_ms > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(fault.delay_ms));
+
+  auto start = std::chrono::steady_clock::now();
+  int result;
+  // Synthetic answers never touch the system resolver, so the concurrency
+  // cap and sharding (which protect it) do not apply.
+  if (synthetic_enabled())
+    result = synthetic_getaddrinfo(node, service, hints, res);
+  // Serial mode keeps the historical whole-call mutex, which was added to
+  // avoid concurrent calls that might lead to heap-use-after-free in curl's
+  // threaded resolver. Otherwise only the optional cap/sharding applies.
+  else if (serial_mode)
+    result = real_gai(node, service, hints, res);
+  else
+    result = call_real_gai(node, service, hints, res);
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  telemetry_resolve(node, static_cast<uint64_t>(us.count()), result);
   return result;
 }
 
+void hook_freeaddrinfo(struct addrinfo *ai)
+{
+  if (!ai || synthetic_freeaddrinfo(ai))
+    return;
+  real_freeaddrinfo(ai);
+}
+
 __attribute__((constructor)) static void init()
 {
   const std::lock_guard<std::mutex> lock(gai_mutex);
-  log_interposer("[fishhook] Initializing getaddrinfo interposer (constructor)");
-  struct rebinding rebindings[1];
-  rebindings[0] = {"getaddrinfo", (void *)hook_getaddrinfo, (void **)&real_gai};
-  rebind_symbols(rebindings, 1);
+  log_interposer("[interpose] Initializing getaddrinfo interposer (constructor)");
+
+  serial_mode = env_size("RESOLVER_INTERPOSE_SERIAL", 0) != 0;
+  if (size_t limit = env_size("RESOLVER_INTERPOSE_GAI_LIMIT", 0); limit > 0)
+  {
+    limit = std::min<size_t>(limit, std::counting_semaphore<>::max());
+    gai_limit = new std::counting_semaphore<>(static_cast<std::ptrdiff_t>(limit));
+  }
+  gai_shard_count = std::min(env_size("RESOLVER_INTERPOSE_GAI_SHARDS", 0), MAX_GAI_SHARDS);
+  if (gai_shard_count > 0)
+    gai_shards = new std::mutex[gai_shard_count];
+  log_interposer("[interpose] serial=", serial_mode, " gai_limit=", (gai_limit ? "on" : "off"),
+                 " gai_shards=", gai_shard_count);
+
+  // RESOLVER_INTERPOSE_SEED=N: reproducible fault decisions (see fault_rng)
+  if (const char *text = std::getenv("RESOLVER_INTERPOSE_SEED"); text && *text)
+  {
+    uint64_t seed = 0;
+    auto [ptr, ec] = std::from_chars(text, text + std::strlen(text), seed);
+    if (ec == std::errc{} && *ptr == '\0')
+      resolver_interpose_seed(seed);
+    else
+      log_interposer("[seed] ignoring invalid RESOLVER_INTERPOSE_SEED '", text, "'");
+  }
+
+  if (const char *spec = std::getenv("RESOLVER_INTERPOSE_PROFILE"); spec && *spec)
+    fault_profile = parse_profile(spec);
+  else if (const char *path = std::getenv("RESOLVER_INTERPOSE_PROFILE_FILE"); path && *path)
+    fault_profile = parse_profile(read_file(path));
+  log_interposer("[profile] fail=", fault_profile.outcome_weights[0], " delay=", fault_profile.outcome_weights[1],
+                 " fast=", fault_profile.outcome_weights[2], " delay_ms=", fault_profile.delay_min_ms, "-",
+                 fault_profile.delay_max_ms);
+
+  synthetic_configure();
+  socket_faults_configure();
+  telemetry_configure();
+  install_hooks();
 }
@@ -0,0 +1,195 @@
+// interpose_elf.cpp - Linux backend for resolver_interpose. The library
+// exports getaddrinfo, freeaddrinfo, (on glibc) getaddrinfo_a and the
+// socket calls of socket_faults.cpp itself; loaded with LD_PRELOAD it comes
+// first in symbol lookup, and the real implementations are found behind it
+// with dlsym(RTLD_NEXT).
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <dlfcn.h>
+#include <mutex>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "resolver_interpose.h"
+
+#ifdef __GLIBC__
+using getaddrinfo_a_fn = int (*)(int, struct gaicb **, int, struct sigevent *);
+static getaddrinfo_a_fn real_gai_a = nullptr;
+#endif
+
+// Other libraries' constructors may resolve names before ours has run, so
+// every exported entry point makes sure the real symbols are known.
+static void resolve_real()
+{
+  static std::once_flag once;
+  std::call_once(once, [] {
+    real_gai = reinterpret_cast<getaddrinfo_fn>(dlsym(RTLD_NEXT, "getaddrinfo"));
+    real_freeaddrinfo = reinterpret_cast<freeaddrinfo_fn>(dlsym(RTLD_NEXT, "freeaddrinfo"));
+    real_socket = reinterpret_cast<socket_fn>(dlsym(RTLD_NEXT, "socket"));
+    real_connect = reinterpret_cast<connect_fn>(dlsym(RTLD_NEXT, "connect"));
+    real_recv = reinterpret_cast<recv_fn>(dlsym(RTLD_NEXT, "recv"));
+    real_read = reinterpret_cast<read_fn>(dlsym(RTLD_NEXT, "read"));
+    real_send = reinterpret_cast<send_fn>(dlsym(RTLD_NEXT, "send"));
+    real_write = reinterpret_cast<write_fn>(dlsym(RTLD_NEXT, "write"));
+    real_close = reinterpret_cast<close_fn>(dlsym(RTLD_NEXT, "close"));
+#ifdef __GLIBC__
+    // Part of libc since glibc 2.34, of libanl before; absent if neither
+    // is loaded, in which case nobody can call it through us either.
+    real_gai_a = reinterpret_cast<getaddrinfo_a_fn>(dlsym(RTLD_NEXT, "getaddrinfo_a"));
+#endif
+  });
+}
+
+void install_hooks()
+{
+  resolve_real();
+  log_interposer("[elf] real getaddrinfo=", reinterpret_cast<void *>(real_gai),
+                 " freeaddrinfo=", reinterpret_cast<void *>(real_freeaddrinfo));
+}
+
+extern "C" int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                           struct addrinfo **res)
+{
+  resolve_real();
+  return hook_getaddrinfo(node, service, hints, res);
+}
+
+extern "C" void freeaddrinfo(struct addrinfo *ai) noexcept
+{
+  resolve_real();
+  hook_freeaddrinfo(ai);
+}
+
+// The socket calls run for every descriptor in the process, so past the
+// once_flag check they are a single branch when socket faults are off.
+extern "C" int socket(int domain, int type, int protocol) noexcept
+{
+  resolve_real();
+  return hook_socket(domain, type, protocol);
+}
+
+extern "C" int connect(int fd, const struct sockaddr *addr, socklen_t length)
+{
+  resolve_real();
+  return hook_connect(fd, addr, length);
+}
+
+extern "C" ssize_t recv(int fd, void *buf, size_t length, int flags)
+{
+  resolve_real();
+  return hook_recv(fd, buf, length, flags);
+}
+
+extern "C" ssize_t read(int fd, void *buf, size_t length)
+{
+  resolve_real();
+  return hook_read(fd, buf, length);
+}
+
+extern "C" ssize_t send(int fd, const void *buf, size_t length, int flags)
+{
+  resolve_real();
+  return hook_send(fd, buf, length, flags);
+}
+
+extern "C" ssize_t write(int fd, const void *buf, size_t length)
+{
+  resolve_real();
+  return hook_write(fd, buf, length);
+}
+
+extern "C" int close(int fd)
+{
+  resolve_real();
+  return hook_close(fd);
+}
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 34)
+// What libc does when a GAI_NOWAIT batch completes, for a batch that never
+// reached it: a queued signal, or the function on a new detached thread.
+static void notify_batch_done(const struct sigevent *sig)
+{
+  if (!sig)
+    return;
+  if (sig->sigev_notify == SIGEV_SIGNAL)
+    sigqueue(getpid(), sig->sigev_signo, sig->sigev_value);
+  else if (sig->sigev_notify == SIGEV_THREAD && sig->sigev_notify_function)
+  {
+    auto *attr = static_cast<pthread_attr_t *>(sig->sigev_notify_attributes);
+    int detached = PTHREAD_CREATE_JOINABLE;
+    if (attr)
+      pthread_attr_getdetachstate(attr, &detached);
+    using notify_fn = void (*)(union sigval);
+    auto run = [](void *arg) -> void * {
+      auto *call = static_cast<std::pair<notify_fn, union sigval> *>(arg);
+      call->first(call->second);
+      delete call;
+      return nullptr;
+    };
+    auto *call = new std::pair<notify_fn, union sigval>(sig->sigev_notify_function, sig->sigev_value);
+    pthread_t thread;
+    if (pthread_create(&thread, attr, run, call) != 0)
+      delete call;
+    else if (detached == PTHREAD_CREATE_JOINABLE)
+      pthread_detach(thread);
+  }
+}
+#endif
+
+// Before 2.34 libanl's worker threads call the exported getaddrinfo, so the
+// faults are already injected per lookup and the batch passes straight
+// through. From 2.34 the lookup is internal to libc and bypasses us; draw
+// one decision per request here instead. Injected failures are completed
+// on the spot (gai_error() reads the request's __return field) and left
+// out of the batch handed to libc. Delays only apply in GAI_WAIT mode, as
+// a GAI_NOWAIT caller must never block. If every request failed, libc gets
+// nothing and the caller's sigevent is delivered here.
+extern "C" int getaddrinfo_a(int mode, struct gaicb *list[], int ent, struct sigevent *sig)
+{
+  resolve_real();
+  if (!real_gai_a)
+  {
+    errno = ENOSYS;
+    return EAI_SYSTEM;
+  }
+#if __GLIBC_PREREQ(2, 34)
+  std::vector<struct gaicb *> batch(list, list + std::max(ent, 0));
+  int delay_ms = 0;
+  bool faulted = false, forwarded = false;
+  for (struct gaicb *&req : batch)
+  {
+    if (!req)
+      continue;
+    FaultDecision fault = decide_fault(req->ar_name);
+    if (fault.error != 0)
+    {
+      req->ar_result = nullptr;
+      req->__return = fault.error;
+      req = nullptr; // libc skips null entries
+      faulted = true;
+    }
+    forwarded = forwarded || req != nullptr;
+    delay_ms = std::max(delay_ms, fault.delay_ms);
+  }
+  if (faulted && !forwarded)
+  {
+    if (mode == GAI_NOWAIT)
+      notify_batch_done(sig);
+    return 0;
+  }
+  if (mode == GAI_WAIT && delay_ms > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+  return real_gai_a(mode, batch.data(), ent, sig);
+#else
+  return real_gai_a(mode, list, ent, sig);
+#endif
+}
+#endif // __GLIBC__
@@ -0,0 +1,29 @@
+// interpose_fishhook.cpp - macOS backend for resolver_interpose. fishhook
+// rewrites the lazy and non-lazy symbol pointers of every loaded Mach-O
+// image, so the hooks apply when the dylib is injected with
+// DYLD_INSERT_LIBRARIES. The socket calls are rebound in the same batch; they
+// pass straight through unless RESOLVER_INTERPOSE_SOCKET is set.
+
+extern "C"
+{
+#include "fishhook.h"
+}
+
+#include "resolver_interpose.h"
+
+void install_hooks()
+{
+  struct rebinding rebindings[] = {
+      {"getaddrinfo", (void *)hook_getaddrinfo, (void **)&real_gai},
+      {"freeaddrinfo", (void *)hook_freeaddrinfo, (void **)&real_freeaddrinfo},
+      {"socket", (void *)hook_socket, (void **)&real_socket},
+      {"connect", (void *)hook_connect, (void **)&real_connect},
+      {"recv", (void *)hook_recv, (void **)&real_recv},
+      {"read", (void *)hook_read, (void **)&real_read},
+      {"send", (void *)hook_send, (void **)&real_send},
+      {"write", (void *)hook_write, (void **)&real_write},
+      {"close", (void *)hook_close, (void **)&real_close},
+  };
+  rebind_symbols(rebindings, sizeof(rebindings) / sizeof(rebindings[0]));
+  log_interposer("[fishhook] rebound getaddrinfo, freeaddrinfo, socket, connect, recv, read, send, write, close");
+}
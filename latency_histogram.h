@@ -0,0 +1,151 @@
+// latency_histogram.h - single-writer HDR-style histogram and counter.
+// Each instance is written by exactly one thread with relaxed atomic
+// load/store (no RMW, no locks); any thread may read or merge it at any time.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic counter owned by one writer thread.
+class RelaxedCounter
+{
+public:
+  void add(uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  uint64_t load() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// Log-linear buckets: exact below 128, then 64 sub-buckets per power of two,
+// i.e. under 1.6% relative error, up to 2^MAX_BITS (values above are clamped).
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned SUB_BITS = 7;
+  static constexpr unsigned MAX_BITS = 40;
+  static constexpr uint64_t LINEAR = uint64_t{1} << SUB_BITS; // 128
+  static constexpr uint64_t HALF = LINEAR / 2;                // 64
+  static constexpr size_t BUCKETS = LINEAR + (MAX_BITS - SUB_BITS) * HALF;
+
+  void record(uint64_t value)
+  {
+    std::atomic<uint64_t> &slot = counts_[index_of(value)];
+    slot.store(slot.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total_.add();
+    if (value > max_.load(std::memory_order_relaxed))
+      max_.store(value, std::memory_order_relaxed);
+  }
+
+  // Not single-writer safe against concurrent record() on *this; call from
+  // the owning thread or after the writer has finished.
+  void merge(const LatencyHistogram &other)
+  {
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+      uint64_t n = other.counts_[i].load(std::memory_order_relaxed);
+      if (n)
+        counts_[i].store(counts_[i].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    total_.add(other.count());
+    if (other.max() > max())
+      max_.store(other.max(), std::memory_order_relaxed);
+  }
+
+  // Sparse form for shipping a histogram to another process: count, max, the
+  // number of non-empty buckets, then an (index, count) pair for each one.
+  // put(uint64_t) takes each word in turn.
+  template <typename Put>
+  void encode(Put &&put) const
+  {
+    uint64_t used = 0;
+    for (const auto &slot : counts_)
+      used += slot.load(std::memory_order_relaxed) != 0;
+    put(count());
+    put(max());
+    put(used);
+    for (size_t i = 0; i < BUCKETS; ++i)
+      if (uint64_t n = counts_[i].load(std::memory_order_relaxed))
+      {
+        put(i);
+        put(n);
+      }
+  }
+
+  // Adds an encode()d histogram, read through get(uint64_t &) -> bool. Same
+  // threading rule as merge(). False if the words run out or are malformed,
+  // in which case *this may hold part of them.
+  template <typename Get>
+  bool merge_encoded(Get &&get)
+  {
+    uint64_t total = 0, highest = 0, used = 0;
+    if (!get(total) || !get(highest) || !get(used))
+      return false;
+    for (uint64_t i = 0; i < used; ++i)
+    {
+      uint64_t index = 0, n = 0;
+      if (!get(index) || !get(n) || index >= BUCKETS)
+        return false;
+      counts_[index].store(counts_[index].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    total_.add(total);
+    if (highest > max())
+      max_.store(highest, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t count() const { return total_.load(); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  // Upper bound of the bucket holding the q-th quantile (q in [0, 1]).
+  uint64_t percentile(double q) const
+  {
+    uint64_t total = count();
+    if (total == 0)
+      return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total) + 0.5);
+    rank = rank == 0 ? 1 : (rank > total ? total : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += counts_[i].load(std::memory_order_relaxed);
+      if (seen >= rank)
+      {
+        uint64_t upper = highest_equivalent(i);
+        return upper < max() ? upper : max();
+      }
+    }
+    return max();
+  }
+
+private:
+  static size_t index_of(uint64_t value)
+  {
+    if (value < LINEAR)
+      return static_cast<size_t>(value);
+    unsigned msb = static_cast<unsigned>(std::bit_width(value)) - 1;
+    if (msb >= MAX_BITS)
+      return BUCKETS - 1;
+    uint64_t mantissa = value >> (msb - SUB_BITS + 1); // in [HALF, LINEAR)
+    return static_cast<size_t>(LINEAR + (msb - SUB_BITS) * HALF + (mantissa - HALF));
+  }
+
+  static uint64_t highest_equivalent(size_t index)
+  {
+    if (index < LINEAR)
+      return index;
+    size_t rel = index - LINEAR;
+    unsigned msb = static_cast<unsigned>(rel / HALF) + SUB_BITS;
+    uint64_t mantissa = HALF + rel % HALF;
+    unsigned shift = msb - SUB_BITS + 1;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+  RelaxedCounter total_;
+  std::atomic<uint64_t> max_{0};
+};
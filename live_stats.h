@@ -0,0 +1,202 @@
+// live_stats.h - the --live endpoint: Prometheus text exposition built by
+// MetricsText, served over plain HTTP by LiveEndpoint from the thread that
+// samples the workers. One request at a time, answered with the latest
+// snapshot and closed; any path but /metrics or / gets a 404. Addresses are
+// numeric so opening the endpoint never goes through getaddrinfo, which the
+// resolver interposer would fault and count.
+//
+// Spec: "PORT", "HOST:PORT" or "[V6]:PORT" with a numeric HOST (default any
+// address), or "unix:PATH" for a Unix socket (curl --unix-socket PATH).
+
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "socket_util.h"
+
+class MetricsText
+{
+public:
+  // Starts a metric family; its samples follow
+  void family(std::string_view name, std::string_view type, std::string_view help)
+  {
+    text_.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    text_.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+  }
+
+  // labels as written inside the braces: worker="3"
+  void sample(std::string_view name, double value, std::string_view labels = {})
+  {
+    text_.append(name);
+    if (!labels.empty())
+      text_.append("{").append(labels).append("}");
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text_.append(" ").append(ec == std::errc{} ? std::string_view(buffer, end - buffer) : "0").append("\n");
+  }
+
+  const std::string &str() const { return text_; }
+
+private:
+  std::string text_;
+};
+
+class LiveEndpoint
+{
+public:
+  LiveEndpoint() = default;
+  ~LiveEndpoint() { close_all(); }
+
+  LiveEndpoint(const LiveEndpoint &) = delete;
+  LiveEndpoint &operator=(const LiveEndpoint &) = delete;
+
+  // false with error set if spec is malformed or cannot be bound
+  bool open(std::string_view spec, std::string &error)
+  {
+    close_all();
+    if (spec.starts_with("unix:"))
+      fd_ = open_unix(spec.substr(5), error);
+    else
+      fd_ = open_tcp(spec, error);
+    return fd_ >= 0;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+
+  // Answers requests with body until deadline
+  void serve_until(std::chrono::steady_clock::time_point deadline, const std::string &body)
+  {
+    for (auto now = std::chrono::steady_clock::now(); fd_ >= 0 && now < deadline;
+         now = std::chrono::steady_clock::now())
+    {
+      pollfd p{fd_, POLLIN, 0};
+      auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+      if (poll(&p, 1, static_cast<int>(wait.count())) <= 0)
+        continue;
+      int client = cloexec_accept(fd_);
+      if (client < 0)
+        continue;
+      answer(client, body);
+      ::close(client);
+    }
+  }
+
+private:
+  // For the whole exchange, so a slow scraper does not hold up sampling longer
+  static constexpr std::chrono::milliseconds REQUEST_TIMEOUT{200};
+
+  static void answer(int client, const std::string &body)
+  {
+    // Read up to the end of the request head; only its first line matters
+    const auto deadline = std::chrono::steady_clock::now() + REQUEST_TIMEOUT;
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      pollfd p{client, POLLIN, 0};
+      if (left.count() <= 0 || poll(&p, 1, static_cast<int>(left.count())) <= 0)
+        return;
+      ssize_t n = read(client, buffer, sizeof(buffer));
+      if (n <= 0)
+        return;
+      request.append(buffer, static_cast<size_t>(n));
+    }
+    std::string_view line(request);
+    line = line.substr(0, line.find("\r\n"));
+    std::string_view path = line.substr(line.find(' ') + 1);
+    path = path.substr(0, path.find(' '));
+    path = path.substr(0, path.find('?'));
+    bool found = line.starts_with("GET ") && (path == "/metrics" || path == "/");
+    std::string response = found ? "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 : "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+    const std::string_view payload = found ? std::string_view(body) : "not found\n";
+    response.append("Content-Length: ").append(std::to_string(payload.size())).append("\r\n");
+    response.append("Connection: close\r\n\r\n").append(payload);
+    for (size_t sent = 0; sent < response.size();)
+    {
+      // Each send may block only for what is left of the deadline
+      auto left = std::chrono::ceil<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0)
+        return;
+      timeval limit{static_cast<time_t>(left.count() / 1000000), static_cast<suseconds_t>(left.count() % 1000000)};
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+      ssize_t n = send(client, response.data() + sent, response.size() - sent, SEND_NOSIGNAL);
+      if (n <= 0)
+        return;
+      sent += static_cast<size_t>(n);
+    }
+  }
+
+  static int open_tcp(std::string_view spec, std::string &error)
+  {
+    sockaddr_storage address{};
+    socklen_t length = 0;
+    if (!parse_numeric_address(spec, address, length, error))
+      return -1;
+    return bind_listen(spec, address.ss_family, reinterpret_cast<sockaddr *>(&address), length, error);
+  }
+
+  int open_unix(std::string_view path, std::string &error)
+  {
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+      error = "unix:" + std::string(path) + ": bad socket path";
+      return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    unlink(address.sun_path); // a previous run's socket
+    int fd = bind_listen("unix:" + std::string(path), AF_UNIX, reinterpret_cast<sockaddr *>(&address),
+                         sizeof(address), error);
+    if (fd >= 0)
+      unix_path_ = path;
+    return fd;
+  }
+
+  static int bind_listen(std::string_view spec, int family, const sockaddr *address, socklen_t length,
+                         std::string &error)
+  {
+    int fd = cloexec_socket(family, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+      error = std::string(spec) + ": " + std::strerror(errno);
+      return -1;
+    }
+    int one = 1;
+    if (family != AF_UNIX)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, address, length) != 0 || listen(fd, 16) != 0)
+    {
+      error = std::string(spec) + ": " + std::strerror(errno);
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  void close_all()
+  {
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+    if (!unix_path_.empty())
+      unlink(unix_path_.c_str());
+    unix_path_.clear();
+  }
+
+  int fd_ = -1;
+  std::string unix_path_;
+};
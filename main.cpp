@@ -1,32 +1,82 @@
 // Stress-test program: spawns multiple threads, each with its own CURLM handle.
 // Each thread continuously queues new transfers, randomly cancels some in-flight
-// handles, and runs its own poll/perform loop.
+// handles, and drives its multi handle either with a poll/perform loop or with
+// curl_multi_socket_action over epoll/kqueue (--engine=socket). With
+// --io-threads the threads become producers handing jobs to a few I/O
+// threads that own the multi handles instead. With --procs a coordinator
+// forks worker processes that each run all of this and report back to it.
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <charconv>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <curl/curl.h>
+#include <dlfcn.h>
+#include <deque>
+#include <fcntl.h>
 #include <iostream>
+#include <latch>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <poll.h>
 #include <random>
 #include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#include "async_log.h"
+#include "cancel_policy.h"
+#include "cpu_placement.h"
+#include "crc32c.h"
+#include "curl_alloc.h"
+#include "event_poller.h"
+#include "event_trace.h"
+#include "fetch_task.h"
+#include "latency_histogram.h"
+#include "live_stats.h"
+#include "mpsc_queue.h"
+#include "prng.h"
+#include "proc_wire.h"
+#include "results_file.h"
+#include "retry_policy.h"
+#include "share_locks.h"
+#include "socket_util.h"
+#include "spec_parser.h"
+#include "teardown_bench.h"
+#include "timer_wheel.h"
+#include "url_corpus.h"
 
 // Thread-safe logging
 #ifdef MYAPP_LOGGING_ENABLED
-std::mutex cout_mutex;
+// Never destroyed: curl threads may still log while statics are torn down.
+static AsyncLog &app_log()
+{
+  static AsyncLog *log = new AsyncLog(STDOUT_FILENO);
+  return *log;
+}
 
 template <typename... Args>
 void log(Args &&...args)
 {
-  std::ostringstream stream;
-  (stream << ... << std::forward<Args>(args));
-
-  std::lock_guard<std::mutex> lock(cout_mutex);
-  std::cout << stream.str() << std::endl;
+  app_log().write(args...);
 }
 #else  // MYAPP_LOGGING_ENABLED
 // Empty inline function when logging is disabled
@@ -34,18 +84,402 @@ template <typename... Args>
 inline void log(Args &&...) {}
 #endif // MYAPP_LOGGING_ENABLED
 
-// Discard body callback — we do not need the payload
-static size_t sink(char * /*ptr*/, size_t size, size_t nmemb, void *)
+enum class Engine
+{
+  poll,   // curl_multi_perform + curl_multi_poll
+  socket, // curl_multi_socket_action + epoll/kqueue
+};
+
+enum class UrlSet
+{
+  internet, // all_test_urls
+  local,    // local_test_paths against --origin (see origin_server.cpp)
+};
+
+enum class BodyMode
+{
+  discard, // count bytes only
+  crc32c,  // checksum in place over curl's buffer, verify against X-Body-CRC32C
+  ring,    // copy into a preallocated per-worker mmap'd ring
+};
+
+enum class LoadMode
+{
+  closed,  // refill to per_multi as transfers finish
+  fixed,   // open loop, evenly spaced starts at --rate
+  poisson, // open loop, exponential inter-arrival times at --rate
+  ramp,    // open loop, rate moves linearly from --rate to --rate-end
+};
+
+enum class HttpVersion
+{
+  curl_default, // whatever the libcurl build prefers
+  v1_1,
+  v2,       // h2 over TLS via ALPN, HTTP/1.1 for http://
+  v2_prior, // h2 everywhere, http:// with prior knowledge (h2c)
+  v3,       // QUIC, falling back to TCP if the handshake fails
+};
+
+enum class PinMode
+{
+  off,  // the scheduler places every thread
+  cpu,  // thread i on the i-th allowed CPU, node by node
+  node, // thread i on every allowed CPU of node i % nodes
+};
+
+// --flow: what each coroutine task does per iteration (off = the flat loop)
+enum class FlowKind
+{
+  off,
+  single, // one fetch
+  chain,  // follow redirects hop by hop
+  fanout, // FLOW_FANOUT fetches side by side, then join
+  retry,  // refetch failures with jittered exponential backoff
+  mix,    // one of the above at random
+};
+
+enum class SweepAxis
+{
+  threads,
+  per_multi,
+};
+
+// Caches a round's CURLSH can hold (Options::share)
+constexpr unsigned SHARE_DNS = 1;
+constexpr unsigned SHARE_CONNECT = 2; // curl documents this as unsafe across threads
+constexpr unsigned SHARE_SSL = 4;
+
+// Run configuration, filled from CRASHER_* environment variables and then
+// from command-line flags (flags win). See OPTION_SPECS for the full list.
+struct Options
+{
+  Engine engine = Engine::poll;
+  int threads = 16;
+  size_t per_multi = 5;                         // in-flight transfers per CURLM
+  size_t max_inflight = 0;                      // process-wide budget, 0 = unlimited
+  std::optional<std::chrono::seconds> duration; // unset = random 1-30 s per thread
+  SweepAxis sweep_axis = SweepAxis::threads;
+  std::vector<size_t> sweep; // concurrency levels, empty = single run
+  bool easy_pool = true;     // recycle easy handles instead of init/cleanup per transfer
+  UrlSet url_set = UrlSet::internet;
+  std::vector<std::string> origins = {"http://127.0.0.1:8080", "https://127.0.0.1:8443"};
+  std::string cainfo; // CA bundle for the local origin's self-signed certificate
+  BodyMode body = BodyMode::discard;
+  size_t body_ring_mb = 16; // per worker, BodyMode::ring
+  unsigned share = 0; // SHARE_* bits: one CURLSH across all workers, 0 = isolated
+  ShareLockKind share_lock = ShareLockKind::rwlock;
+  LoadMode load = LoadMode::closed;
+  double rate = 0;     // open loop: process-wide transfer starts per second
+  double rate_end = 0; // LoadMode::ramp: rate at the end of the run
+  HttpVersion http = HttpVersion::curl_default;
+  long max_host_connections = 0; // CURLMOPT_MAX_HOST_CONNECTIONS, 0 = unlimited
+  long max_streams = 100;        // CURLMOPT_MAX_CONCURRENT_STREAMS per connection
+  int io_threads = 0;            // handoff mode: threads owning the multis, 0 = each worker owns one
+  std::string url_file;          // corpus file replacing the built-in URL set
+  std::string url_weights;       // "category=W,..." for UrlCorpus::finalize
+  std::optional<uint64_t> seed;  // every random stream derives from it; unset = random
+  std::string trace_file;        // record the round's events
+  std::string replay_file;       // drive the round from a recorded trace
+  CancelPolicy abort;            // progress_cb's per-transfer abort triggers
+  RetryPolicy retry;             // re-adding failed transfers, per-host breakers
+  int procs = 0;                 // worker processes under a coordinator, 0 = run in this process
+  std::string listen;            // coordinator: accept --report-to connections here
+  int expect_hosts = 0;          // coordinator: remote hosts to wait for
+  std::string report_to;         // send this host's process reports to a remote coordinator
+  PinMode pin = PinMode::off;    // worker and I/O thread affinity
+  AllocMode alloc = AllocMode::system; // libcurl's malloc family, see curl_alloc.h
+  std::string results_file;            // machine-readable results, see results_file.h
+  FlowKind flow = FlowKind::off;       // coroutine flows per worker instead of the flat loop
+  bool quick_exit = true;              // CURLOPT_QUICK_EXIT on every handle
+  TeardownPlan teardown;               // shutdown benchmark instead of a stress run
+  std::string live;                    // --live: "on" prints only, else also serves this address
+
+  // HTTP/2 and HTTP/3 put many transfers on one connection
+  bool multiplex() const
+  {
+    return http == HttpVersion::v2 || http == HttpVersion::v2_prior || http == HttpVersion::v3;
+  }
+};
+
+// Process-wide cap on in-flight transfers shared by all workers.
+class InflightBudget
+{
+public:
+  explicit InflightBudget(size_t limit) : limit_(limit) {}
+
+  bool try_acquire()
+  {
+    if (limit_ == 0)
+      return true;
+    if (in_flight_.fetch_add(1, std::memory_order_relaxed) < limit_)
+      return true;
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void release()
+  {
+    if (limit_ != 0)
+      in_flight_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+private:
+  const size_t limit_;
+  std::atomic<size_t> in_flight_{0};
+};
+
+// Fixed-size anonymous mapping that body bytes are copied into, wrapping
+// around. Preallocated (and pre-faulted) so the hot path never allocates.
+class BodyRing
+{
+public:
+  explicit BodyRing(size_t bytes) : size_(bytes)
+  {
+    if (size_ == 0)
+      return;
+    void *p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+      size_ = 0;
+      return;
+    }
+    base_ = static_cast<char *>(p);
+    std::memset(base_, 0, size_);
+  }
+
+  ~BodyRing()
+  {
+    if (base_)
+      munmap(base_, size_);
+  }
+
+  BodyRing(const BodyRing &) = delete;
+  BodyRing &operator=(const BodyRing &) = delete;
+
+  void write(const char *data, size_t n)
+  {
+    while (n > 0 && size_ > 0)
+    {
+      size_t piece = std::min(n, size_ - offset_);
+      std::memcpy(base_ + offset_, data, piece);
+      offset_ = (offset_ + piece) % size_;
+      data += piece;
+      n -= piece;
+    }
+  }
+
+private:
+  char *base_ = nullptr;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+struct HandoffJob;
+
+// Per-transfer state. The handle's CURLOPT_PRIVATE, WRITEDATA, HEADERDATA
+// and XFERINFODATA all point at its Transfer.
+struct Transfer
+{
+  CURL *easy = nullptr;
+  const char *url = nullptr;
+  std::chrono::steady_clock::time_point start{};
+  std::chrono::steady_clock::time_point intended{}; // open loop: scheduled start; else == start
+  curl_off_t bytes = 0;
+  size_t index = 0;           // position in TransferTable's active list
+  BodyRing *ring = nullptr;   // BodyMode::ring
+  uint32_t crc = 0;           // running CRC32C state, BodyMode::crc32c
+  bool has_expected = false;  // origin sent X-Body-CRC32C
+  uint32_t expected_crc = 0;
+  HandoffJob *job = nullptr; // handoff mode: the producer's request
+  uint32_t trace_id = 0;     // per-thread add sequence, for --trace/--replay
+  uint16_t thread = 0;       // worker that added it
+  CancelPlan cancel;         // progress_cb's abort triggers, drawn when added
+  bool aborted = false;      // progress_cb returned 1 ...
+  TransferPhase abort_phase = TransferPhase::any; // ... while the transfer was in this phase
+  curl_socket_t socket = CURL_SOCKET_BAD;         // latest socket opened for it, see sockopt_cb
+  UrlCorpus::Pick pick{};                          // --retry: what to add again
+  uint32_t attempt = 1;                            // --retry: tries so far, this one included
+  bool probe = false;                              // --retry: carries its host's half-open breaker probe
+  std::chrono::steady_clock::time_point requested{}; // --retry: first try's start
+};
+
+// --trace: the round's event log, or nullptr. Set before workers start.
+static TraceWriter *event_trace = nullptr;
+
+// Every random decision of a run comes from one of these streams. With
+// --seed, stream (kind, id) is derive_seed(seed, kind << 32 | id), so each
+// thread's decisions repeat from run to run.
+enum class RngStream : uint64_t
+{
+  round,    // per-thread run lengths
+  control,  // random cancellation, open-loop arrivals
+  urls,     // corpus sampling
+  progress, // progress_cb aborts
+  io,       // handoff I/O threads' cancellation
+  resolver, // resolver_interpose fault decisions
+  proc,     // --procs: each worker process' own run seed
+  retry,    // --retry backoff jitter, apart from control so retries leave cancels alone
+};
+
+struct Options;
+static uint64_t stream_seed(const Options &opts, RngStream kind, uint64_t id);
+
+// progress_cb runs on the thread driving the transfer's multi (and plans are
+// drawn there when transfers are added); each worker reseeds this generator
+// when it starts.
+static Xoshiro256ss &progress_rng()
+{
+  static thread_local Xoshiro256ss rng{random_seed()};
+  return rng;
+}
+
+// Slot-indexed set of in-flight transfers with O(1) add, remove and random
+// pick. Transfer objects have stable addresses (deque storage, recycled via a
+// free list); removal swaps the last active entry into the freed position.
+class TransferTable
+{
+public:
+  Transfer &add(CURL *easy, const char *url)
+  {
+    Transfer *t = nullptr;
+    if (!free_.empty())
+    {
+      t = free_.back();
+      free_.pop_back();
+    }
+    else
+    {
+      t = &storage_.emplace_back();
+    }
+    *t = Transfer{};
+    t->easy = easy;
+    t->url = url;
+    t->start = std::chrono::steady_clock::now();
+    t->intended = t->start;
+    t->index = active_.size();
+    t->crc = crc32c_init();
+    active_.push_back(t);
+    return *t;
+  }
+
+  void remove(Transfer &t)
+  {
+    Transfer *last = active_.back();
+    active_[t.index] = last;
+    last->index = t.index;
+    active_.pop_back();
+    t.easy = nullptr;
+    free_.push_back(&t);
+  }
+
+  static Transfer &of(CURL *easy)
+  {
+    Transfer *t = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, &t);
+    return *t;
+  }
+
+  Transfer &operator[](size_t i) { return *active_[i]; }
+  size_t size() const { return active_.size(); }
+  bool empty() const { return active_.empty(); }
+
+private:
+  std::deque<Transfer> storage_;
+  std::vector<Transfer *> active_;
+  std::vector<Transfer *> free_;
+};
+
+// Body consumers, one per BodyMode. All work on curl's buffer in place.
+
+// Discard body callback — we do not need the payload, only its size
+static size_t sink(char * /*ptr*/, size_t size, size_t nmemb, void *userdata)
 {
+  static_cast<Transfer *>(userdata)->bytes += static_cast<curl_off_t>(size * nmemb);
   return size * nmemb;
 }
 
-// Progress callback that randomly aborts after >1MB downloaded
+static size_t sink_crc32c(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  auto *t = static_cast<Transfer *>(userdata);
+  size_t n = size * nmemb;
+  t->crc = crc32c_update(t->crc, ptr, n);
+  t->bytes += static_cast<curl_off_t>(n);
+  return n;
+}
+
+static size_t sink_ring(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  auto *t = static_cast<Transfer *>(userdata);
+  size_t n = size * nmemb;
+  t->ring->write(ptr, n);
+  t->bytes += static_cast<curl_off_t>(n);
+  return n;
+}
+
+// Picks up the checksum the local origin advertises for the body.
+static size_t header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+  auto *t = static_cast<Transfer *>(userdata);
+  size_t n = size * nitems;
+  constexpr std::string_view name = "x-body-crc32c:";
+  std::string_view line(buffer, n);
+  if (line.size() > name.size() &&
+      std::equal(name.begin(), name.end(), line.begin(),
+                 [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); }))
+  {
+    std::string_view value = line.substr(name.size());
+    while (!value.empty() && value.front() == ' ')
+      value.remove_prefix(1);
+    uint32_t crc = 0;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), crc, 16);
+    t->has_expected = ec == std::errc{};
+    t->expected_crc = crc;
+  }
+  else if (line.starts_with("HTTP/"))
+  {
+    t->has_expected = false; // new response (redirect, 100-continue)
+  }
+  return n;
+}
+
+static int sockopt_cb(void *clientp, curl_socket_t fd, curlsocktype /*purpose*/)
+{
+  static_cast<Transfer *>(clientp)->socket = fd;
+  return CURL_SOCKOPT_OK;
+}
+
+// Where a transfer is in its life, from the timers libcurl has set so far
+// (each stays 0 until its phase completes) and its socket. libcurl stamps
+// the connect and TLS timers together once the whole connection is up, so a
+// TLS handshake shows as a socket with a peer on a connection not yet up. A
+// stream multiplexed onto a live connection goes straight to body.
+static TransferPhase current_phase(const Transfer &t, curl_off_t dlnow)
+{
+  curl_off_t at = 0;
+  if (dlnow > 0)
+    return TransferPhase::body;
+  curl_easy_getinfo(t.easy, CURLINFO_PRETRANSFER_TIME_T, &at);
+  if (at != 0)
+    return TransferPhase::body;
+  curl_easy_getinfo(t.easy, CURLINFO_CONNECT_TIME_T, &at);
+  if (at != 0)
+    return TransferPhase::body;
+  curl_easy_getinfo(t.easy, CURLINFO_NAMELOOKUP_TIME_T, &at);
+  if (at == 0 && t.socket == CURL_SOCKET_BAD)
+    return TransferPhase::dns; // a numeric host can resolve in under 1 us
+  sockaddr_storage peer{};
+  socklen_t length = sizeof(peer);
+  if (t.socket != CURL_SOCKET_BAD && std::string_view(t.url).starts_with("https:") &&
+      getpeername(t.socket, reinterpret_cast<sockaddr *>(&peer), &length) == 0)
+    return TransferPhase::tls;
+  return TransferPhase::connect;
+}
+
 static int progress_cb(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
                        curl_off_t /*ultotal*/, curl_off_t /*ulnow*/)
 {
-  // clientp now points to the C-string (const char*) of the URL
-  const char *url_cstr = static_cast<const char *>(clientp);
+  auto *t = static_cast<Transfer *>(clientp);
+  const char *url_cstr = t->url;
 
   // Log progress for debugging
   if (dlnow > 0 && dltotal > 0)
@@ -53,240 +487,3694 @@ static int progress_cb(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
     log("[progress] ", url_cstr, " downloaded ", dlnow / 1024, "/", dltotal / 1024, " KiB");
   }
 
-  if (dlnow < 100 * 1024)
+  const CancelPlan &plan = t->cancel;
+  if (!plan.armed || dlnow < plan.bytes)
+    return 0;
+  if (plan.after_us > 0 &&
+      std::chrono::steady_clock::now() - t->start < std::chrono::microseconds(plan.after_us))
+    return 0;
+  TransferPhase phase = plan.phase == TransferPhase::any ? TransferPhase::any : current_phase(*t, dlnow);
+  if (phase != plan.phase)
+    return 0;
+  if (!plan.roll(progress_rng()))
     return 0;
+  if (phase == TransferPhase::any)
+    phase = current_phase(*t, dlnow);
+
+  log("[cancel] Aborting ", url_cstr, " in ", TRANSFER_PHASE_NAMES[static_cast<size_t>(phase)], " after ",
+      dlnow / 1024, " KiB");
+  t->aborted = true;
+  t->abort_phase = phase;
+  if (event_trace)
+    event_trace->record(TraceEvent::abort, t->thread, t->trace_id,
+                        static_cast<uint32_t>(std::min<curl_off_t>(dlnow / 1024, UINT32_MAX)),
+                        static_cast<uint8_t>(phase));
+  return 1;
+}
+
+// Options shared by every transfer; per-transfer ones are set in add_easy.
+static void apply_common_options(CURL *easy, const Options &opts, CURLSH *share)
+{
+  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 1);
+  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 2);
+  if (!opts.cainfo.empty())
+    curl_easy_setopt(easy, CURLOPT_CAINFO, opts.cainfo.c_str());
+  switch (opts.body)
+  {
+  case BodyMode::discard:
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink);
+    break;
+  case BodyMode::crc32c:
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink_crc32c);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_cb);
+    break;
+  case BodyMode::ring:
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink_ring);
+    break;
+  }
 
-  static std::mt19937 rng{std::random_device{}()};
-  static std::uniform_int_distribution<int> dice(0, 4); // 20% chance
-  bool abort = dice(rng) == 0;
-  if (abort)
+  // Critical options to tickle the crash, unless the cache is shared
+  if (share)
+    curl_easy_setopt(easy, CURLOPT_SHARE, share);
+  if (!(opts.share & SHARE_DNS))
+    curl_easy_setopt(easy, CURLOPT_DNS_CACHE_TIMEOUT, 0L); // disable DNS cache
+  if (!(opts.share & SHARE_CONNECT) && !opts.multiplex())
+    curl_easy_setopt(easy, CURLOPT_FORBID_REUSE, 1L); // fresh conn each time
+  curl_easy_setopt(easy, CURLOPT_QUICK_EXIT, opts.quick_exit ? 1L : 0L); // suspected factor
+
+  switch (opts.http)
   {
-    log("[cancel] Aborting download of ", url_cstr, " after ", dlnow / 1024, " KiB");
-    return 1;
+  case HttpVersion::curl_default:
+    break;
+  case HttpVersion::v1_1:
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_1_1));
+    break;
+  case HttpVersion::v2:
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+    break;
+  case HttpVersion::v2_prior:
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE));
+    break;
+  case HttpVersion::v3:
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_3));
+    break;
   }
-  return 0;
+  // Wait for a connection that can take another stream rather than opening
+  // a new one per transfer while the first handshake is still running
+  if (opts.multiplex())
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+
+  curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, progress_cb);
+  curl_easy_setopt(easy, CURLOPT_SOCKOPTFUNCTION, sockopt_cb);
 }
 
-static CURL *add_easy(CURLM *multi, std::string_view url_sv, bool enable_cancel = false)
+// Per-worker source of easy handles. With pooling enabled, finished handles
+// are kept and recycled with curl_easy_reset; fresh ones are duplicated from a
+// prebuilt template. With pooling disabled every transfer gets curl_easy_init
+// and every release curl_easy_cleanup, as the reproducer originally did.
+class EasyPool
 {
-  log("[queue] ", url_sv);
-  CURL *easy = curl_easy_init();
+public:
+  struct Stats
+  {
+    uint64_t created = 0;
+    uint64_t reused = 0;
+    std::chrono::nanoseconds setup{0};    // acquire: init/dup or reset + options
+    std::chrono::nanoseconds teardown{0}; // release: cleanup (pool off only)
+  };
 
-  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 1);
-  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 2);
-  curl_easy_setopt(easy, CURLOPT_URL, url_sv.data());
-  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, sink);
+  EasyPool(const Options &opts, CURLSH *share) : opts_(opts), share_(share), enabled_(opts.easy_pool)
+  {
+    if (enabled_)
+    {
+      template_ = curl_easy_init();
+      apply_common_options(template_, opts_, share_);
+    }
+  }
+
+  ~EasyPool()
+  {
+    for (CURL *e : idle_)
+      curl_easy_cleanup(e);
+    if (template_)
+      curl_easy_cleanup(template_);
+  }
+
+  EasyPool(const EasyPool &) = delete;
+  EasyPool &operator=(const EasyPool &) = delete;
+
+  CURL *acquire()
+  {
+    auto start = std::chrono::steady_clock::now();
+    CURL *easy = nullptr;
+    if (!enabled_)
+    {
+      easy = curl_easy_init();
+      apply_common_options(easy, opts_, share_);
+      ++stats_.created;
+    }
+    else if (!idle_.empty())
+    {
+      easy = idle_.back();
+      idle_.pop_back();
+      curl_easy_reset(easy);
+      apply_common_options(easy, opts_, share_);
+      ++stats_.reused;
+    }
+    else
+    {
+      easy = curl_easy_duphandle(template_);
+      ++stats_.created;
+    }
+    stats_.setup += std::chrono::steady_clock::now() - start;
+    return easy;
+  }
+
+  // The handle must already be removed from its multi handle.
+  void release(CURL *easy)
+  {
+    if (enabled_)
+    {
+      idle_.push_back(easy);
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    curl_easy_cleanup(easy);
+    stats_.teardown += std::chrono::steady_clock::now() - start;
+  }
+
+  const Stats &stats() const { return stats_; }
+
+private:
+  const Options &opts_;
+  CURLSH *const share_;
+  const bool enabled_;
+  CURL *template_ = nullptr;
+  std::vector<CURL *> idle_;
+  Stats stats_;
+};
+
+// A transfer set up but not yet added to a multi handle. url must outlive
+// it. progress_cb only runs for transfers whose cancel plan is armed.
+static Transfer &prepare_easy(EasyPool &pool, TransferTable &transfers, BodyRing *ring, const char *url,
+                              const CancelPlan &cancel = {})
+{
+  log("[queue] ", url);
+  CURL *easy = pool.acquire();
+  Transfer &t = transfers.add(easy, url);
+  t.ring = ring;
 
-  // Critical options to tickle the crash
-  curl_easy_setopt(easy, CURLOPT_DNS_CACHE_TIMEOUT, 0L); // disable DNS cache
-  curl_easy_setopt(easy, CURLOPT_FORBID_REUSE, 1L);      // fresh conn each time
-  curl_easy_setopt(easy, CURLOPT_QUICK_EXIT, 1L);        // suspected factor
+  curl_easy_setopt(easy, CURLOPT_URL, t.url);
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, &t);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, &t);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, &t);
+  curl_easy_setopt(easy, CURLOPT_SOCKOPTDATA, &t);
 
-  if (enable_cancel)
+  if (cancel.armed)
   {
-    // Always enable progress monitoring
+    t.cancel = cancel;
     curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, progress_cb);
-    // Pass the persistent pointer to the URL string (now url_sv.data(), which is const char*)
-    // clientp for progress_cb will be const char*
-    curl_easy_setopt(easy, CURLOPT_XFERINFODATA, (void *)url_sv.data()); // Cast to void*
+    curl_easy_setopt(easy, CURLOPT_XFERINFODATA, &t);
   }
+  return t;
+}
 
-  curl_multi_add_handle(multi, easy);
-  return easy;
+// url lives in the UrlCorpus for the whole run.
+static Transfer &add_easy(CURLM *multi, EasyPool &pool, TransferTable &transfers, BodyRing *ring, const char *url,
+                          const CancelPlan &cancel = {})
+{
+  Transfer &t = prepare_easy(pool, transfers, ring, url, cancel);
+  curl_multi_add_handle(multi, t.easy);
+  return t;
 }
 
-// Worker owning its own CURLM handle
-static void worker_thread(int id, std::span<const std::string_view> urls, std::chrono::seconds duration)
+// Detach a transfer from the multi handle and give its easy handle back.
+static void finish_easy(CURLM *multi, EasyPool &pool, TransferTable &transfers, Transfer &t)
 {
-  CURLM *multi = curl_multi_init();
-  std::vector<CURL *> handles;
+  CURL *easy = t.easy;
+  curl_multi_remove_handle(multi, easy);
+  transfers.remove(t);
+  pool.release(easy);
+}
 
-  std::mt19937 rng{std::random_device{}()};
-  std::uniform_int_distribution<int> pick10(0, 9);
-  std::uniform_int_distribution<size_t> url_pick(0, urls.size() - 1);
+// What a driver last heard from curl about its multi, read by --live
+struct alignas(64) WorkerGauges
+{
+  std::atomic<int> running{0}; // transfers still running, from curl_multi_perform / socket_action
+  std::atomic<int> numfds{0};  // descriptors with events, from curl_multi_poll / the poller
+};
 
-  auto deadline = std::chrono::steady_clock::now() + duration;
-  int running = 0;
+// Classic engine: curl_multi_perform followed by a fixed-tick curl_multi_poll.
+class PollDriver
+{
+public:
+  explicit PollDriver(CURLM *multi, WorkerGauges *gauges = nullptr) : multi_(multi), gauges_(gauges) {}
 
-  while (std::chrono::steady_clock::now() < deadline)
+  void drive(std::chrono::milliseconds max_wait = std::chrono::milliseconds(200))
   {
-    // keep up to 5 concurrent transfers
-    while (handles.size() < 5)
+    int running = 0;
+    curl_multi_perform(multi_, &running);
+    int numfds = 0;
+    curl_multi_poll(multi_, nullptr, 0, static_cast<int>(max_wait.count()), &numfds);
+    if (gauges_)
     {
-      const std::string_view &u = urls[url_pick(rng)];
-      handles.push_back(add_easy(multi, u, true));
+      gauges_->running.store(running, std::memory_order_relaxed);
+      gauges_->numfds.store(numfds, std::memory_order_relaxed);
     }
+  }
 
-    // Perform transfers
-    curl_multi_perform(multi, &running);
-    int numfds = 0;
-    curl_multi_poll(multi, nullptr, 0, 200, &numfds);
+private:
+  CURLM *multi_;
+  WorkerGauges *gauges_;
+};
 
-    // Reap finished
-    int msgs_left = 0;
-    while (CURLMsg *msg = curl_multi_info_read(multi, &msgs_left))
+// Event-driven engine: curl tells us which sockets to watch and when its next
+// timer fires; we wait on epoll/kqueue and hand readiness back through
+// curl_multi_socket_action. Cancellation latency follows curl's timers.
+class SocketDriver
+{
+public:
+  explicit SocketDriver(CURLM *multi, WorkerGauges *gauges = nullptr) : multi_(multi), gauges_(gauges)
+  {
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, socket_cb);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timer_cb);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+  }
+
+  ~SocketDriver()
+  {
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, nullptr);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, nullptr);
+  }
+
+  SocketDriver(const SocketDriver &) = delete;
+  SocketDriver &operator=(const SocketDriver &) = delete;
+
+  // max_wait bounds the sleep so the worker loop still gets to add and cancel
+  // transfers when curl has nothing scheduled.
+  void drive(std::chrono::milliseconds max_wait = std::chrono::milliseconds(200))
+  {
+    auto now = std::chrono::steady_clock::now();
+    auto wait = max_wait;
+    if (timer_armed_)
+      wait = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(timer_deadline_ - now),
+                        std::chrono::milliseconds(0), max_wait);
+
+    std::array<EventPoller::Event, 64> events;
+    int n = poller_.wait(events, static_cast<int>(wait.count()));
+    int running = 0;
+    for (int i = 0; i < n; ++i)
     {
-      if (msg->msg == CURLMSG_DONE)
-      {
-        CURL *e = msg->easy_handle;
-        curl_multi_remove_handle(multi, e);
-        curl_easy_cleanup(e);
-        handles.erase(std::remove(handles.begin(), handles.end(), e), handles.end());
-      }
+      int mask = 0;
+      if (events[i].what & EventPoller::READABLE)
+        mask |= CURL_CSELECT_IN;
+      if (events[i].what & EventPoller::WRITABLE)
+        mask |= CURL_CSELECT_OUT;
+      if (events[i].what & EventPoller::ERROR)
+        mask |= CURL_CSELECT_ERR;
+      curl_multi_socket_action(multi_, events[i].fd, mask, &running);
     }
 
-    // Random cancellation
-    if (!handles.empty() && pick10(rng) == 0)
+    bool acted = n > 0;
+    if (timer_armed_ && std::chrono::steady_clock::now() >= timer_deadline_)
     {
-      size_t idx = rng() % handles.size();
-      CURL *e = handles[idx];
-      log("[cancel] thread ", id, " removing handle");
-      curl_multi_remove_handle(multi, e);
-      curl_easy_cleanup(e);
-      handles.erase(handles.begin() + idx);
+      timer_armed_ = false;
+      curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+      acted = true;
+    }
+    if (gauges_)
+    {
+      if (acted) // running is only reported by a socket_action call
+        gauges_->running.store(running, std::memory_order_relaxed);
+      gauges_->numfds.store(std::max(n, 0), std::memory_order_relaxed);
     }
   }
 
-  // Cleanup remaining
-  for (CURL *e : handles)
+private:
+  static int socket_cb(CURL * /*easy*/, curl_socket_t s, int what, void *userp, void * /*socketp*/)
   {
-    curl_multi_remove_handle(multi, e);
-    curl_easy_cleanup(e);
+    auto *self = static_cast<SocketDriver *>(userp);
+    switch (what)
+    {
+    case CURL_POLL_REMOVE:
+      self->poller_.remove(s);
+      break;
+    case CURL_POLL_IN:
+      self->poller_.set(s, EventPoller::READABLE);
+      break;
+    case CURL_POLL_OUT:
+      self->poller_.set(s, EventPoller::WRITABLE);
+      break;
+    case CURL_POLL_INOUT:
+      self->poller_.set(s, EventPoller::READABLE | EventPoller::WRITABLE);
+      break;
+    default:
+      break;
+    }
+    return 0;
   }
-  curl_multi_cleanup(multi);
-  log("[thread] ", id, " finished");
-}
 
-// All URLs for stress testing organized by category
-static constexpr std::array<std::string_view, 68> all_test_urls = {
-    // Small files (< 1MB)
-    "https://cdn.kernel.org/pub/linux/kernel/v6.x/sha256sums.asc",
-    "https://raw.githubusercontent.com/curl/curl/master/README",
-    "https://speed.hetzner.de/100KB.bin",
-    "https://speed.hetzner.de/1MB.bin",
+  static int timer_cb(CURLM * /*multi*/, long timeout_ms, void *userp)
+  {
+    auto *self = static_cast<SocketDriver *>(userp);
+    self->timer_armed_ = timeout_ms >= 0;
+    if (self->timer_armed_)
+      self->timer_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    return 0;
+  }
 
-    // Medium files (1-10MB)
-    "https://speed.hetzner.de/10MB.bin",
-    "https://www.learningcontainer.com/wp-content/uploads/2020/05/sample-5mb.pdf",
-    "https://proof.ovh.net/files/5Mb.dat",
+  CURLM *multi_;
+  WorkerGauges *gauges_;
+  EventPoller poller_;
+  bool timer_armed_ = false;
+  std::chrono::steady_clock::time_point timer_deadline_{};
+};
 
-    // Large files (> 10MB) - use with caution as they might slow down tests
-    "https://speed.hetzner.de/100MB.bin",
-    "https://proof.ovh.net/files/100Mb.dat",
+// resolver_interpose's failure slots: up to its MAX_ERROR_CODES EAI codes,
+// then "other"
+inline constexpr size_t RESOLVER_FAILURE_SLOTS = 17;
 
-    // Specific file types
-    "https://www.w3.org/WAI/ER/tests/xhtml/testfiles/resources/pdf/dummy.pdf",
-    "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/04/file_example_MP4_480_1_5MG.mp4",
-    "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/11/file_example_MP3_700KB.mp3",
-    "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/10/file_example_PNG_500kB.png",
+// Per-worker counters and histograms. Only the owning worker writes them;
+// they are merged once the worker has joined.
+struct WorkerStats
+{
+  RelaxedCounter completed; // CURLMSG_DONE, any result
+  RelaxedCounter failed;    // CURLMSG_DONE with result != CURLE_OK
+  RelaxedCounter cancelled; // removed mid-flight by the random cancel
+  RelaxedCounter bytes;
+  RelaxedCounter body_verified;   // CRC32C matched X-Body-CRC32C
+  RelaxedCounter body_mismatched; // CRC32C differed: corrupted body
+  RelaxedCounter body_unverified; // completed OK without a checksum to compare
+  std::array<RelaxedCounter, CURL_LAST> results; // CURLMSG_DONE by CURLcode
+  LatencyHistogram dns_us;     // start -> name resolved
+  LatencyHistogram connect_us; // name resolved -> TCP connected
+  LatencyHistogram tls_us;     // TCP connected -> TLS handshake done
+  LatencyHistogram total_us;   // whole transfer
+  // open loop only
+  RelaxedCounter scheduled;         // starts generated by the arrival schedule
+  RelaxedCounter unstarted;         // still waiting for a slot when the run ended
+  LatencyHistogram start_lag_us;    // scheduled -> actually added to the multi
+  LatencyHistogram from_intended_us; // scheduled start -> CURLMSG_DONE
+  // handoff mode only
+  RelaxedCounter wakeups;           // curl_multi_wakeup calls by producers
+  RelaxedCounter handoff_cancelled; // jobs posted back cancelled: not in complete_us or round_trip_us
+  LatencyHistogram submit_us;       // producer push -> handle added by the I/O thread
+  LatencyHistogram complete_us;     // I/O thread post -> producer pop
+  LatencyHistogram round_trip_us;   // producer push -> producer has the result
+  std::array<RelaxedCounter, 4> http_versions; // HTTP/1.x, 2, 3, no response
+  std::array<RelaxedCounter, TRANSFER_PHASES> aborts; // progress_cb aborts by phase
+  RelaxedCounter new_connections;              // CURLINFO_NUM_CONNECTS: transfers that opened one
+  RelaxedCounter replay_events;                // --replay: adds and cancels applied
+  RelaxedCounter replay_diverged;              // --replay: ones that no longer applied
+  RelaxedCounter migrations;                   // the thread moved to another CPU
+  RelaxedCounter voluntary_switches;           // it blocked (poll, locks, queues)
+  RelaxedCounter involuntary_switches;         // it was preempted
+  RelaxedCounter curl_allocs;                  // --alloc=pool*: libcurl malloc family calls in the round
+  RelaxedCounter curl_frees;
+  RelaxedCounter curl_alloc_bytes;             // requested
+  RelaxedCounter curl_large_allocs;            // above the largest size class
+  RelaxedCounter curl_refills;                 // batches moved from the central lists to threads
+  RelaxedCounter curl_slab_bytes;              // mapped by the pool when the round ended
+  RelaxedCounter flows;                        // --flow: iterations that ran to the end
+  RelaxedCounter flows_cancelled;              // destroyed mid-flight by the random cancel
+  RelaxedCounter flow_redirects;               // hops followed by chain flows
+  RelaxedCounter flow_retries;                 // refetches by retry flows
+  // --retry only
+  RelaxedCounter requests;                     // first tries
+  RelaxedCounter retries;                      // later tries added
+  RelaxedCounter retry_recovered;              // requests that succeeded on a retry
+  RelaxedCounter retry_exhausted;              // retryable failures out of tries
+  RelaxedCounter retry_dropped;                // retries pending at the end or turned away by a breaker
+  RelaxedCounter breaker_rejected;             // new requests not started: their host's breaker was open
+  RelaxedCounter breaker_trips;                // breakers opened
+  RelaxedCounter breaker_probes;               // half-open probes let through
+  std::array<RelaxedCounter, FAILURE_CLASSES> failure_classes; // CURLMSG_DONE by classify_failure
+  std::array<RelaxedCounter, RESOLVER_FAILURE_SLOTS> resolver_failures; // round's, from resolver_interpose
+  LatencyHistogram request_us;                 // first try's start -> last try's end
+  EasyPool::Stats pool;
+  WorkerGauges gauges; // live values for --live, not merged
 
-    // HTTPS with redirects
-    "https://bit.ly/3y0UWGJ",
-    "https://httpbin.org/redirect/3",
+  void record_done(const Transfer &t, CURLcode result)
+  {
+    CURL *easy = t.easy;
+    completed.add();
+    if (t.aborted)
+      aborts[static_cast<size_t>(t.abort_phase)].add();
+    if (result != CURLE_OK)
+      failed.add();
+    if (result >= 0 && result < CURL_LAST)
+      results[result].add();
 
-    // Server with special behavior
-    "https://httpbin.org/delay/2",
-    "https://httpbin.org/status/429",
-    "https://httpbin.org/status/500",
-    "https://httpbin.org/status/404",
+    curl_off_t namelookup = 0, connect = 0, appconnect = 0, total = 0;
+    curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+    // Phases that never happened (failed resolve, plain HTTP) report 0
+    if (namelookup > 0)
+      dns_us.record(static_cast<uint64_t>(namelookup));
+    if (connect > namelookup && namelookup > 0)
+      connect_us.record(static_cast<uint64_t>(connect - namelookup));
+    if (appconnect > connect && connect > 0)
+      tls_us.record(static_cast<uint64_t>(appconnect - connect));
+    total_us.record(static_cast<uint64_t>(total));
 
-    // IPv6 enabled servers
-    "https://ipv6.google.com/",
-    "https://ipv6.cloudflare-dns.com/",
+    long version = 0, connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_HTTP_VERSION, &version);
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    switch (version)
+    {
+    case CURL_HTTP_VERSION_1_0:
+    case CURL_HTTP_VERSION_1_1: http_versions[0].add(); break;
+    case CURL_HTTP_VERSION_2_0: http_versions[1].add(); break;
+    case CURL_HTTP_VERSION_3: http_versions[2].add(); break;
+    default: http_versions[3].add(); break;
+    }
+    new_connections.add(static_cast<uint64_t>(connects));
+  }
 
-    // Popular CDNs
-    "https://ajax.googleapis.com/ajax/libs/jquery/3.6.0/jquery.min.js",
-    "https://cdnjs.cloudflare.com/ajax/libs/jquery/3.6.0/jquery.min.js",
-    "https://cdn.jsdelivr.net/npm/bootstrap@5.1.3/dist/css/bootstrap.min.css",
-    "https://unpkg.com/react@17/umd/react.production.min.js",
+  void verify_body(const Transfer &t, CURLcode result)
+  {
+    if (result != CURLE_OK)
+      return; // partial bodies cannot be checked
+    if (!t.has_expected)
+      body_unverified.add();
+    else if (crc32c_final(t.crc) == t.expected_crc)
+      body_verified.add();
+    else
+    {
+      body_mismatched.add();
+      log("[body] CRC32C mismatch for ", t.url, " after ", t.bytes, " bytes");
+    }
+  }
 
-    // Cloud storage providers
-    "https://storage.googleapis.com/pub-tools-public-publication-data/pdf/1e476f4d97eecc7f3673d74cbce0387a15a8ab53.pdf",
-    "https://download.microsoft.com/download/9/3/F/93FCF1E7-E6A4-478B-96E7-D4B285925B00/GUID-4.pdf",
-    "https://aws.amazon.com/lambda/resources/",
-    "https://dl.fbaipublications.com/fasttext/vectors-crawl/cc.en.300.bin.gz",
+  void merge(const WorkerStats &other)
+  {
+    completed.add(other.completed.load());
+    failed.add(other.failed.load());
+    cancelled.add(other.cancelled.load());
+    bytes.add(other.bytes.load());
+    body_verified.add(other.body_verified.load());
+    body_mismatched.add(other.body_mismatched.load());
+    body_unverified.add(other.body_unverified.load());
+    for (size_t i = 0; i < results.size(); ++i)
+      results[i].add(other.results[i].load());
+    dns_us.merge(other.dns_us);
+    connect_us.merge(other.connect_us);
+    tls_us.merge(other.tls_us);
+    total_us.merge(other.total_us);
+    scheduled.add(other.scheduled.load());
+    unstarted.add(other.unstarted.load());
+    start_lag_us.merge(other.start_lag_us);
+    from_intended_us.merge(other.from_intended_us);
+    wakeups.add(other.wakeups.load());
+    handoff_cancelled.add(other.handoff_cancelled.load());
+    submit_us.merge(other.submit_us);
+    complete_us.merge(other.complete_us);
+    round_trip_us.merge(other.round_trip_us);
+    for (size_t i = 0; i < http_versions.size(); ++i)
+      http_versions[i].add(other.http_versions[i].load());
+    for (size_t i = 0; i < aborts.size(); ++i)
+      aborts[i].add(other.aborts[i].load());
+    new_connections.add(other.new_connections.load());
+    replay_events.add(other.replay_events.load());
+    replay_diverged.add(other.replay_diverged.load());
+    migrations.add(other.migrations.load());
+    voluntary_switches.add(other.voluntary_switches.load());
+    involuntary_switches.add(other.involuntary_switches.load());
+    curl_allocs.add(other.curl_allocs.load());
+    curl_frees.add(other.curl_frees.load());
+    curl_alloc_bytes.add(other.curl_alloc_bytes.load());
+    curl_large_allocs.add(other.curl_large_allocs.load());
+    curl_refills.add(other.curl_refills.load());
+    curl_slab_bytes.add(other.curl_slab_bytes.load());
+    flows.add(other.flows.load());
+    flows_cancelled.add(other.flows_cancelled.load());
+    flow_redirects.add(other.flow_redirects.load());
+    flow_retries.add(other.flow_retries.load());
+    requests.add(other.requests.load());
+    retries.add(other.retries.load());
+    retry_recovered.add(other.retry_recovered.load());
+    retry_exhausted.add(other.retry_exhausted.load());
+    retry_dropped.add(other.retry_dropped.load());
+    breaker_rejected.add(other.breaker_rejected.load());
+    breaker_trips.add(other.breaker_trips.load());
+    breaker_probes.add(other.breaker_probes.load());
+    for (size_t i = 0; i < failure_classes.size(); ++i)
+      failure_classes[i].add(other.failure_classes[i].load());
+    for (size_t i = 0; i < resolver_failures.size(); ++i)
+      resolver_failures[i].add(other.resolver_failures[i].load());
+    request_us.merge(other.request_us);
+    pool.created += other.pool.created;
+    pool.reused += other.pool.reused;
+    pool.setup += other.pool.setup;
+    pool.teardown += other.pool.teardown;
+  }
 
-    // Government sites
-    "https://www.nasa.gov/wp-content/themes/nasa/assets/images/nasa-logo.svg",
-    "https://www.whitehouse.gov/",
-    "https://www.parliament.uk/",
-    "https://europa.eu/european-union/index_en",
+  // Flat form for --procs reports, every field in declaration order.
+  void encode(WireWriter &out) const
+  {
+    for_each_field(*this, [&](const auto &field) {
+      using Field = std::decay_t<decltype(field)>;
+      if constexpr (std::is_same_v<Field, RelaxedCounter>)
+        out.put(field.load());
+      else if constexpr (std::is_same_v<Field, LatencyHistogram>)
+        field.encode([&](uint64_t word) { out.put(word); });
+      else if constexpr (std::is_same_v<Field, uint64_t>)
+        out.put(field);
+      else
+        out.put(static_cast<uint64_t>(field.count()));
+    });
+  }
 
-    // University sites
-    "https://www.ox.ac.uk/",
-    "https://www.harvard.edu/",
-    "https://www.stanford.edu/",
-    "https://www.mit.edu/",
+  // Adds another process' encode()d stats; false if the words do not match.
+  bool merge_encoded(WireReader &in)
+  {
+    bool ok = true;
+    auto get = [&](uint64_t &word) { return ok = ok && in.get(word); };
+    for_each_field(*this, [&](auto &field) {
+      using Field = std::decay_t<decltype(field)>;
+      if constexpr (std::is_same_v<Field, LatencyHistogram>)
+        ok = ok && field.merge_encoded(get);
+      else if (uint64_t word = 0; get(word))
+      {
+        if constexpr (std::is_same_v<Field, RelaxedCounter>)
+          field.add(word);
+        else if constexpr (std::is_same_v<Field, uint64_t>)
+          field += word;
+        else
+          field += std::chrono::nanoseconds(word);
+      }
+    });
+    return ok;
+  }
 
-    // Different file types
-    "https://www.w3.org/TR/PNG/iso_8859-1.txt",
-    "https://www.w3.org/People/mimasa/test/imgformat/img/w3c_home.jpg",
-    "https://filesamples.com/samples/document/csv/sample1.csv",
-    "https://filesamples.com/samples/code/json/sample1.json",
+private:
+  template <typename Self, typename Visit>
+  static void for_each_field(Self &s, Visit &&visit)
+  {
+    for (auto *counter : {&s.completed, &s.failed, &s.cancelled, &s.bytes, &s.body_verified, &s.body_mismatched,
+                          &s.body_unverified})
+      visit(*counter);
+    for (auto &counter : s.results)
+      visit(counter);
+    for (auto *histogram : {&s.dns_us, &s.connect_us, &s.tls_us, &s.total_us})
+      visit(*histogram);
+    visit(s.scheduled);
+    visit(s.unstarted);
+    visit(s.start_lag_us);
+    visit(s.from_intended_us);
+    visit(s.wakeups);
+    visit(s.handoff_cancelled);
+    for (auto *histogram : {&s.submit_us, &s.complete_us, &s.round_trip_us})
+      visit(*histogram);
+    for (auto &counter : s.http_versions)
+      visit(counter);
+    for (auto &counter : s.aborts)
+      visit(counter);
+    visit(s.new_connections);
+    visit(s.replay_events);
+    visit(s.replay_diverged);
+    for (auto *counter : {&s.migrations, &s.voluntary_switches, &s.involuntary_switches, &s.curl_allocs, &s.curl_frees,
+                          &s.curl_alloc_bytes, &s.curl_large_allocs, &s.curl_refills, &s.curl_slab_bytes, &s.flows,
+                          &s.flows_cancelled, &s.flow_redirects, &s.flow_retries, &s.requests, &s.retries,
+                          &s.retry_recovered, &s.retry_exhausted, &s.retry_dropped, &s.breaker_rejected,
+                          &s.breaker_trips, &s.breaker_probes})
+      visit(*counter);
+    for (auto &counter : s.failure_classes)
+      visit(counter);
+    for (auto &counter : s.resolver_failures)
+      visit(counter);
+    visit(s.request_us);
+    visit(s.pool.created);
+    visit(s.pool.reused);
+    visit(s.pool.setup);
+    visit(s.pool.teardown);
+  }
+};
 
-    // Redirects and special cases
-    "https://httpstat.us/200",
-    "https://httpstat.us/301",
-    "https://httpstat.us/400",
-    "https://httpstat.us/503",
+// Intended start times for one worker's share of the open-loop rate.
+// Arrivals are a pure function of the clock and the worker's RNG, never of
+// how fast transfers complete, so a slow server cannot lower offered load.
+class ArrivalSchedule
+{
+public:
+  using clock = std::chrono::steady_clock;
 
-    // International domains
-    "https://www.bbc.co.uk/",
-    "https://www.tagesschau.de/",
-    "https://www.nhk.or.jp/",
-    "https://www.rtve.es/",
+  ArrivalSchedule(const Options &opts, double share, clock::time_point start, std::chrono::seconds duration)
+      : mode_(opts.load), rate_(opts.rate * share), rate_end_(opts.rate_end * share), start_(start),
+        length_s_(std::chrono::duration<double>(duration).count()), next_(start)
+  {
+  }
 
-    // Media streaming and large files
-    "https://commondatastorage.googleapis.com/gtv-videos-bucket/sample/BigBuckBunny.mp4", // Large file
-    "https://commondatastorage.googleapis.com/gtv-videos-bucket/sample/TearsOfSteel.mp4", // Large file
+  clock::time_point peek() const { return next_; }
 
-    // API endpoints with different response types
-    "https://api.chucknorris.io/jokes/random",
-    "https://cat-fact.herokuapp.com/facts/random",
-    "https://api.publicapis.org/entries",
-    "https://jsonplaceholder.typicode.com/posts",
+  // Consume the current arrival and compute the one after it.
+  template <typename Rng>
+  void pop(Rng &rng)
+  {
+    double t = std::chrono::duration<double>(next_ - start_).count();
+    double gap = 0;
+    switch (mode_)
+    {
+    case LoadMode::poisson:
+      gap = std::exponential_distribution<double>(rate_)(rng);
+      break;
+    case LoadMode::ramp:
+    {
+      // Next arrival where the integral of the linear rate reaches one:
+      // r*dt + k*dt^2/2 = 1 with r = rate(t) and slope k.
+      double k = (rate_end_ - rate_) / length_s_;
+      double r = rate_ + k * t;
+      double disc = r * r + 2 * k;
+      if (std::abs(k) < 1e-12)
+        gap = r > 0 ? 1 / r : std::numeric_limits<double>::infinity();
+      else
+        gap = disc >= 0 ? (std::sqrt(disc) - r) / k : std::numeric_limits<double>::infinity();
+      break;
+    }
+    default:
+      gap = 1 / rate_;
+      break;
+    }
+    if (!std::isfinite(gap) || gap < 0 || t + gap > length_s_)
+      next_ = clock::time_point::max(); // rate fell to zero or past the end
+    else
+      next_ += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(gap));
+  }
 
-    // Different network challenges
-    "https://deelay.me/1000/https://example.com", // 1 second delay
-    "https://deelay.me/3000/https://example.com", // 3 second delay
+private:
+  LoadMode mode_;
+  double rate_;
+  double rate_end_;
+  clock::time_point start_;
+  double length_s_;
+  clock::time_point next_;
+};
 
-    // Health check endpoints
-    "https://status.github.com/api/status.json",
-    "https://www.githubstatus.com/",
-    "https://status.cloud.google.com/",
-    "https://status.aws.amazon.com/",
+static uint64_t micros(std::chrono::steady_clock::duration d)
+{
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  return us > 0 ? static_cast<uint64_t>(us) : 0;
+}
 
-    // Additional variety for volume testing
-    "https://archive.org/download/BigBuckBunny_124/Content/big_buck_bunny_720p_surround.mp4",
-    "https://cdn.shopify.com/s/files/1/0155/7645/products/cover_efa16558-4f83-4c39-941a-193fa9bc6854_large.jpg",
-    "https://soundhelix.com/examples/mp3/SoundHelix-Song-1.mp3",
-    "https://fonts.googleapis.com/css?family=Roboto:300,400,500,700",
-    "https://www.php.net/distributions/php-8.0.0.tar.gz",
-    "https://www.python.org/ftp/python/3.9.7/Python-3.9.7.tar.xz",
-    "https://nodejs.org/dist/v14.17.6/node-v14.17.6.tar.gz"};
+static uint64_t stream_seed(const Options &opts, RngStream kind, uint64_t id)
+{
+  return opts.seed ? derive_seed(*opts.seed, static_cast<uint64_t>(kind) << 32 | id) : random_seed();
+}
 
-int main()
+// Add, reap and randomly cancel transfers on one multi handle until the
+// deadline, letting Driver move the transfers along.
+template <typename Driver>
+static void run_transfers(int id, const Options &opts, CURLM *multi, Driver &driver, EasyPool &pool,
+                          const UrlCorpus &corpus, std::chrono::seconds duration,
+                          size_t per_multi, double rate_share, InflightBudget &budget, WorkerStats &stats)
 {
-  curl_global_init(CURL_GLOBAL_DEFAULT);
+  using clock = std::chrono::steady_clock;
+  std::unique_ptr<BodyRing> ring;
+  if (opts.body == BodyMode::ring)
+    ring = std::make_unique<BodyRing>(opts.body_ring_mb << 20);
+  TransferTable transfers;
 
-  // Logging URL count for verification
-  log("Using ", std::size(all_test_urls), " URLs for stress testing");
+  Xoshiro256ss rng{stream_seed(opts, RngStream::control, static_cast<uint64_t>(id))};
+  std::uniform_int_distribution<int> pick10(0, 9);
+  Xoshiro256ss url_rng{stream_seed(opts, RngStream::urls, static_cast<uint64_t>(id))};
+  const auto thread = static_cast<uint16_t>(id);
+  uint32_t next_trace_id = 0;
+  auto start_transfer = [&](UrlCorpus::Pick pick) -> Transfer & {
+    Transfer &t = add_easy(multi, pool, transfers, ring.get(), pick.url, opts.abort.plan(progress_rng()));
+    t.trace_id = next_trace_id++;
+    t.thread = thread;
+    t.pick = pick;
+    t.requested = t.start;
+    if (event_trace)
+      event_trace->record(TraceEvent::add, thread, t.trace_id, pick.index, static_cast<uint8_t>(pick.category));
+    return t;
+  };
 
-  // Use span over array directly
-  const int num_threads = 16;
-  static std::mt19937 rng{std::random_device{}()};
-  static std::uniform_int_distribution<int> dice(1, 30);
-  std::vector<std::thread> threads;
-  for (int i = 0; i < num_threads; ++i)
+  auto begin = clock::now();
+  auto deadline = begin + duration;
+
+  // --retry: failed requests wait in the queue for their backoff, then in
+  // ready for a slot, ahead of new requests. New requests to a host whose
+  // breaker is open are not started; a retry meeting one gives up.
+  struct PendingRetry
   {
-    threads.emplace_back(worker_thread, i, std::span(all_test_urls), std::chrono::seconds(dice(rng)));
-  }
+    UrlCorpus::Pick pick;
+    uint32_t attempt;
+    clock::time_point requested;
+    clock::time_point intended;
+  };
+  const RetryPolicy &retry = opts.retry;
+  RetryQueue<PendingRetry> retry_queue;
+  std::deque<PendingRetry> ready;
+  CircuitBreaker breaker(retry);
+  Xoshiro256ss backoff_rng{stream_seed(opts, RngStream::retry, static_cast<uint64_t>(id))};
+  using Admission = CircuitBreaker::Admission;
+  auto admit = [&](const char *url) {
+    return breaker.enabled() ? breaker.allow(url_host(url), clock::now()) : Admission::allowed;
+  };
+  auto start_request = [&](UrlCorpus::Pick pick) -> Transfer * {
+    Admission admission = admit(pick.url);
+    if (admission == Admission::rejected)
+    {
+      stats.breaker_rejected.add();
+      return nullptr;
+    }
+    if (retry.enabled())
+      stats.requests.add();
+    Transfer &t = start_transfer(pick);
+    t.probe = admission == Admission::probe;
+    return &t;
+  };
+  auto start_retries = [&] {
+    retry_queue.pop_due(clock::now(), [&](PendingRetry r) { ready.push_back(r); });
+    while (!ready.empty() && transfers.size() < per_multi && budget.try_acquire())
+    {
+      PendingRetry r = ready.front();
+      ready.pop_front();
+      Admission admission = admit(r.pick.url);
+      if (admission == Admission::rejected)
+      {
+        stats.retry_dropped.add();
+        budget.release();
+        continue;
+      }
+      stats.retries.add();
+      Transfer &t = start_transfer(r.pick);
+      t.probe = admission == Admission::probe;
+      t.attempt = r.attempt;
+      t.requested = r.requested;
+      t.intended = r.intended;
+    }
+  };
 
-  for (auto &t : threads)
-    t.join();
+  // Open loop: the schedule feeds a timer wheel one revolution ahead; due
+  // arrivals queue in order until per_multi and the budget have room, and
+  // the time they wait there is the start lag.
+  const bool open_loop = opts.load != LoadMode::closed;
+  ArrivalSchedule schedule(opts, rate_share, begin, duration);
+  TimerWheel<UrlCorpus::Pick> arrivals(std::chrono::milliseconds(1), 1024, begin);
+  std::deque<std::pair<clock::time_point, UrlCorpus::Pick>> due;
 
+  while (clock::now() < deadline)
+  {
+    auto max_wait = std::chrono::milliseconds(200);
+    if (open_loop)
+    {
+      auto now = clock::now();
+      while (schedule.peek() <= now + arrivals.horizon() / 2)
+      {
+        arrivals.schedule(schedule.peek(), corpus.pick(url_rng));
+        stats.scheduled.add();
+        schedule.pop(rng);
+      }
+      arrivals.advance(now, [&](clock::time_point when, UrlCorpus::Pick pick) { due.emplace_back(when, pick); });
+      start_retries();
+      while (!due.empty() && transfers.size() < per_multi && budget.try_acquire())
+      {
+        if (Transfer *t = start_request(due.front().second))
+        {
+          t->intended = due.front().first;
+          stats.start_lag_us.record(micros(t->start - t->intended));
+        }
+        else
+        {
+          budget.release(); // shed: the arrival is not offered again
+        }
+        due.pop_front();
+      }
+      // with a backlog, only a finishing transfer can make progress
+      if (due.empty())
+        if (auto next = arrivals.next_deadline())
+          max_wait = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(*next - clock::now()),
+                                std::chrono::milliseconds(0), max_wait);
+    }
+    else
+    {
+      // keep up to per_multi concurrent transfers, within the global budget
+      start_retries();
+      while (transfers.size() < per_multi && budget.try_acquire())
+        if (!start_request(corpus.pick(url_rng)))
+        {
+          budget.release();
+          break; // its host is held back; try again after the next drive
+        }
+    }
+    if (auto next = retry_queue.next_deadline())
+      max_wait = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(*next - clock::now()),
+                            std::chrono::milliseconds(0), max_wait);
+
+    // Perform transfers
+    driver.drive(max_wait);
+
+    // Reap finished
+    int msgs_left = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi, &msgs_left))
+    {
+      if (msg->msg == CURLMSG_DONE)
+      {
+        Transfer &t = TransferTable::of(msg->easy_handle);
+        stats.record_done(t, msg->data.result);
+        if (event_trace)
+          event_trace->record(TraceEvent::done, thread, t.trace_id, 0, static_cast<uint8_t>(msg->data.result));
+        bool again = false;
+        if (retry.enabled())
+        {
+          auto now = clock::now();
+          FailureClass failure = classify_failure(msg->data.result);
+          stats.failure_classes[static_cast<size_t>(failure)].add();
+          if (breaker.enabled())
+            breaker.record(url_host(t.url), failure, now, t.probe);
+          again = retry.retries(failure, t.attempt) && now < deadline;
+          if (again)
+            retry_queue.push(now + retry.backoff(t.attempt, backoff_rng),
+                             {t.pick, t.attempt + 1, t.requested, t.intended});
+          else
+          {
+            stats.request_us.record(micros(now - t.requested));
+            if (failure == FailureClass::none && t.attempt > 1)
+              stats.retry_recovered.add();
+            else if (retry.retries(failure, 1) && t.attempt >= retry.attempts())
+              stats.retry_exhausted.add();
+          }
+        }
+        if (open_loop && !again)
+          stats.from_intended_us.record(micros(clock::now() - t.intended));
+        if (opts.body == BodyMode::crc32c)
+          stats.verify_body(t, msg->data.result);
+        stats.bytes.add(static_cast<uint64_t>(t.bytes));
+        finish_easy(multi, pool, transfers, t);
+        budget.release();
+      }
+    }
+
+    // Random cancellation
+    if (!transfers.empty() && pick10(rng) == 0)
+    {
+      Transfer &t = transfers[rng() % transfers.size()];
+      log("[cancel] thread ", id, " removing handle");
+      stats.cancelled.add();
+      stats.bytes.add(static_cast<uint64_t>(t.bytes));
+      if (event_trace)
+        event_trace->record(TraceEvent::cancel, thread, t.trace_id);
+      if (breaker.enabled())
+        breaker.abandon(url_host(t.url), t.probe);
+      finish_easy(multi, pool, transfers, t);
+      budget.release();
+    }
+  }
+  stats.unstarted.add(due.size() + arrivals.size());
+  stats.retry_dropped.add(retry_queue.size() + ready.size());
+  stats.breaker_trips.add(breaker.trips());
+  stats.breaker_probes.add(breaker.probes());
+  if (event_trace)
+    event_trace->record(TraceEvent::end, thread, next_trace_id);
+
+  // Cleanup remaining
+  while (!transfers.empty())
+  {
+    finish_easy(multi, pool, transfers, transfers[transfers.size() - 1]);
+    budget.release();
+  }
+}
+
+// --replay: drive one thread's recorded events instead of random choices.
+// Adds and cancels happen at their recorded offsets, recorded progress
+// aborts fire at the same byte count and phase, and nothing else is cancelled. The
+// network is live, so a cancel whose transfer has already finished (or an
+// add whose URL the corpus lacks) is counted as diverged and skipped.
+template <typename Driver>
+static void replay_transfers(int id, const Options &opts, CURLM *multi, Driver &driver, EasyPool &pool,
+                             const UrlCorpus &corpus, std::span<const TraceRecord> events, WorkerStats &stats)
+{
+  using clock = std::chrono::steady_clock;
+  std::unique_ptr<BodyRing> ring;
+  if (opts.body == BodyMode::ring)
+    ring = std::make_unique<BodyRing>(opts.body_ring_mb << 20);
+  TransferTable transfers;
+  std::unordered_map<uint32_t, Transfer *> live; // trace id -> in-flight transfer
+  std::unordered_map<uint32_t, CancelPlan> aborts;
+  for (const TraceRecord &e : events)
+    if (e.event == TraceEvent::abort)
+    {
+      CancelPlan &plan = aborts[e.transfer];
+      plan.armed = true;
+      plan.bytes = static_cast<int64_t>(e.arg) * 1024;
+      if (e.code < TRANSFER_PHASES)
+        plan.phase = static_cast<TransferPhase>(e.code);
+    }
+
+  auto begin = clock::now();
+  auto at = [&](const TraceRecord &e) { return begin + std::chrono::microseconds(e.time_us); };
+  size_t next = 0;
+  bool ended = false;
+  while (!ended)
+  {
+    auto now = clock::now();
+    for (; next < events.size() && at(events[next]) <= now && !ended; ++next)
+    {
+      const TraceRecord &e = events[next];
+      switch (e.event)
+      {
+      case TraceEvent::add:
+      {
+        const char *url = corpus.at(e.code, e.arg);
+        if (!url)
+        {
+          stats.replay_diverged.add();
+          break;
+        }
+        auto abort = aborts.find(e.transfer);
+        Transfer &t = add_easy(multi, pool, transfers, ring.get(), url,
+                               abort != aborts.end() ? abort->second : CancelPlan{});
+        t.trace_id = e.transfer;
+        t.thread = static_cast<uint16_t>(id);
+        live[e.transfer] = &t;
+        stats.replay_events.add();
+        break;
+      }
+      case TraceEvent::cancel:
+        if (auto it = live.find(e.transfer); it != live.end())
+        {
+          Transfer &t = *it->second;
+          live.erase(it);
+          stats.cancelled.add();
+          stats.bytes.add(static_cast<uint64_t>(t.bytes));
+          finish_easy(multi, pool, transfers, t);
+          stats.replay_events.add();
+        }
+        else
+        {
+          stats.replay_diverged.add();
+        }
+        break;
+      case TraceEvent::end:
+        ended = true;
+        break;
+      default: // completions and aborts follow from the network
+        break;
+      }
+    }
+    if (ended)
+      break;
+
+    auto max_wait = std::chrono::milliseconds(200);
+    if (next < events.size())
+      max_wait = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(at(events[next]) - clock::now()),
+                            std::chrono::milliseconds(0), max_wait);
+    driver.drive(max_wait);
+
+    int msgs_left = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi, &msgs_left))
+    {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      Transfer &t = TransferTable::of(msg->easy_handle);
+      stats.record_done(t, msg->data.result);
+      if (opts.body == BodyMode::crc32c)
+        stats.verify_body(t, msg->data.result);
+      stats.bytes.add(static_cast<uint64_t>(t.bytes));
+      live.erase(t.trace_id);
+      finish_easy(multi, pool, transfers, t);
+    }
+    if (next == events.size())
+      ended = true; // trace without an end record
+  }
+
+  while (!transfers.empty())
+    finish_easy(multi, pool, transfers, transfers[transfers.size() - 1]);
+}
+
+// --flow: the worker's transfers as coroutines (fetch_task.h) on its multi
+// handle. Each of per_multi tasks repeats one flow until the deadline, and
+// the random cancel destroys a whole task, in-flight fetches and all.
+constexpr size_t FLOW_FANOUT = 4;      // fetches per fan-out flow
+constexpr int FLOW_MAX_HOPS = 5;       // redirects a chain flow follows
+constexpr int FLOW_ATTEMPTS = 3;       // tries per retry flow
+constexpr auto FLOW_BACKOFF = std::chrono::milliseconds(50); // before the first retry, doubling
+
+struct FlowContext
+{
+  const Options &opts;
+  FetchScheduler &scheduler;
+  EasyPool &pool;
+  TransferTable &transfers;
+  BodyRing *ring;
+  const UrlCorpus &corpus;
+  Xoshiro256ss &rng;
+  Xoshiro256ss &url_rng;
+  InflightBudget &budget;
+  WorkerStats &stats;
+  uint16_t thread;
+  std::chrono::steady_clock::time_point deadline;
+  bool ending = false; // the run is over: what is still in flight is not a cancel
+
+  const char *next_url() { return corpus.pick(url_rng).url; }
+};
+
+struct FetchResult
+{
+  CURLcode result = CURLE_OK;
+  std::string location; // CURLINFO_REDIRECT_URL, empty if none
+};
+
+// One transfer; url must outlive it. Destroying the awaiting frame removes
+// the handle from the multi and counts the transfer as cancelled.
+static Task<FetchResult> fetch(FlowContext &ctx, const char *url)
+{
+  // Other workers free budget without telling this one, so poll for it
+  while (!ctx.budget.try_acquire())
+    co_await ctx.scheduler.sleep_for(std::chrono::milliseconds(5));
+  // Gives the handle and the budget back however the frame ends
+  struct Slot
+  {
+    FlowContext &ctx;
+    Transfer &t;
+    bool done = false;
+    ~Slot()
+    {
+      if (!done && !ctx.ending)
+      {
+        ctx.stats.cancelled.add();
+        ctx.stats.bytes.add(static_cast<uint64_t>(t.bytes));
+      }
+      CURL *easy = t.easy;
+      ctx.transfers.remove(t);
+      ctx.pool.release(easy);
+      ctx.budget.release();
+    }
+  };
+  Transfer &t = prepare_easy(ctx.pool, ctx.transfers, ctx.ring, url, ctx.opts.abort.plan(progress_rng()));
+  t.thread = ctx.thread;
+  Slot slot{ctx, t};
+
+  FetchResult r;
+  r.result = co_await ctx.scheduler.perform(t.easy);
+  slot.done = true;
+  ctx.stats.record_done(t, r.result);
+  if (ctx.opts.body == BodyMode::crc32c)
+    ctx.stats.verify_body(t, r.result);
+  ctx.stats.bytes.add(static_cast<uint64_t>(t.bytes));
+  char *location = nullptr;
+  if (r.result == CURLE_OK && curl_easy_getinfo(t.easy, CURLINFO_REDIRECT_URL, &location) == CURLE_OK && location)
+    r.location = location;
+  co_return r;
+}
+
+static Task<> flow_chain(FlowContext &ctx)
+{
+  std::string url = ctx.next_url();
+  for (int hop = 0; hop <= FLOW_MAX_HOPS; ++hop)
+  {
+    FetchResult r = co_await fetch(ctx, url.c_str());
+    if (r.location.empty() || hop == FLOW_MAX_HOPS)
+      break;
+    ctx.stats.flow_redirects.add();
+    url = std::move(r.location);
+  }
+}
+
+static Task<> flow_fanout(FlowContext &ctx)
+{
+  std::vector<Task<FetchResult>> parts;
+  for (size_t i = 0; i < FLOW_FANOUT; ++i)
+    parts.push_back(fetch(ctx, ctx.next_url()));
+  co_await when_all(std::move(parts));
+}
+
+static Task<> flow_retry(FlowContext &ctx)
+{
+  const char *url = ctx.next_url();
+  auto backoff = FLOW_BACKOFF;
+  for (int attempt = 1;; ++attempt)
+  {
+    FetchResult r = co_await fetch(ctx, url);
+    if (r.result == CURLE_OK || attempt == FLOW_ATTEMPTS || std::chrono::steady_clock::now() >= ctx.deadline)
+      break;
+    ctx.stats.flow_retries.add();
+    // Full jitter over [backoff / 2, backoff]
+    co_await ctx.scheduler.sleep_for(backoff / 2 + std::chrono::milliseconds(ctx.rng() % (backoff.count() / 2 + 1)));
+    backoff *= 2;
+  }
+}
+
+static Task<> flow_task(FlowContext &ctx)
+{
+  while (std::chrono::steady_clock::now() < ctx.deadline)
+  {
+    FlowKind kind = ctx.opts.flow;
+    if (kind == FlowKind::mix)
+      kind = static_cast<FlowKind>(static_cast<int>(FlowKind::single) + static_cast<int>(ctx.rng() % 4));
+    switch (kind)
+    {
+    case FlowKind::chain: co_await flow_chain(ctx); break;
+    case FlowKind::fanout: co_await flow_fanout(ctx); break;
+    case FlowKind::retry: co_await flow_retry(ctx); break;
+    default: co_await fetch(ctx, ctx.next_url()); break;
+    }
+    ctx.stats.flows.add();
+  }
+}
+
+template <typename Driver>
+static void run_flows(int id, const Options &opts, CURLM *multi, Driver &driver, EasyPool &pool,
+                      const UrlCorpus &corpus, std::chrono::seconds duration, size_t per_multi,
+                      InflightBudget &budget, WorkerStats &stats)
+{
+  std::unique_ptr<BodyRing> ring;
+  if (opts.body == BodyMode::ring)
+    ring = std::make_unique<BodyRing>(opts.body_ring_mb << 20);
+  TransferTable transfers;
+  Xoshiro256ss rng{stream_seed(opts, RngStream::control, static_cast<uint64_t>(id))};
+  std::uniform_int_distribution<int> pick10(0, 9);
+  Xoshiro256ss url_rng{stream_seed(opts, RngStream::urls, static_cast<uint64_t>(id))};
+  auto deadline = std::chrono::steady_clock::now() + duration;
+  FetchScheduler scheduler(multi); // destroyed first: its tasks hand handles back to transfers and pool
+  FlowContext ctx{opts, scheduler, pool,  transfers, ring.get(), corpus, rng, url_rng, budget,
+                  stats, static_cast<uint16_t>(id), deadline};
+
+  while (std::chrono::steady_clock::now() < deadline)
+  {
+    while (scheduler.tasks() < per_multi)
+      scheduler.spawn(flow_task(ctx));
+    driver.drive(scheduler.next_wakeup(std::chrono::milliseconds(200)));
+    scheduler.dispatch();
+
+    if (scheduler.tasks() > 0 && pick10(rng) == 0)
+    {
+      log("[cancel] thread ", id, " destroying a flow");
+      stats.flows_cancelled.add();
+      scheduler.cancel(rng() % scheduler.tasks());
+    }
+  }
+  ctx.ending = true;
+  scheduler.cancel_all();
+}
+
+static CURLM *make_multi(const Options &opts)
+{
+  CURLM *multi = curl_multi_init();
+  if (opts.multiplex())
+  {
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, opts.max_streams);
+  }
+  if (opts.max_host_connections > 0)
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, opts.max_host_connections);
+  return multi;
+}
+
+static void worker_thread(int id, const UrlCorpus &corpus, std::chrono::seconds duration,
+                          const Options &opts, CURLSH *share, size_t per_multi, double rate_share,
+                          InflightBudget &budget, std::span<const TraceRecord> replay, WorkerStats &stats)
+{
+  progress_rng() = Xoshiro256ss(stream_seed(opts, RngStream::progress, static_cast<uint64_t>(id)));
+  CURLM *multi = make_multi(opts);
+  EasyPool pool(opts, share);
+  auto run = [&](auto &driver) {
+    if (!opts.replay_file.empty())
+      replay_transfers(id, opts, multi, driver, pool, corpus, replay, stats);
+    else if (opts.flow != FlowKind::off)
+      run_flows(id, opts, multi, driver, pool, corpus, duration, per_multi, budget, stats);
+    else
+      run_transfers(id, opts, multi, driver, pool, corpus, duration, per_multi, rate_share, budget, stats);
+  };
+  if (opts.engine == Engine::socket)
+  {
+    SocketDriver driver(multi, &stats.gauges);
+    run(driver);
+  }
+  else
+  {
+    PollDriver driver(multi, &stats.gauges);
+    run(driver);
+  }
+  stats.pool = pool.stats();
+  curl_multi_cleanup(multi);
+  log("[thread] ", id, " finished");
+}
+
+// Handoff mode. A producer owns its jobs; one is in exactly one place at a
+// time: the producer's free list, an I/O thread's submission queue, a
+// Transfer, or the producer's completion queue.
+struct HandoffJob
+{
+  std::atomic<HandoffJob *> next{nullptr}; // MpscQueue link
+  const char *url = nullptr;
+  int producer = 0;
+  std::chrono::steady_clock::time_point submitted{}; // pushed by the producer
+  std::chrono::steady_clock::time_point posted{};    // pushed back by the I/O thread
+  bool cancelled = false; // removed or returned before CURLMSG_DONE
+};
+
+struct alignas(64) CompletionQueue
+{
+  MpscQueue<HandoffJob> jobs;
+  std::atomic<uint32_t> posts{0}; // bumped after every push, waited on by the producer
+};
+
+// One I/O thread's multi handle and inbox. The multi outlives both sides so
+// a producer's last curl_multi_wakeup never races curl_multi_cleanup.
+struct alignas(64) HandoffLoop
+{
+  CURLM *multi = nullptr;
+  MpscQueue<HandoffJob> submissions;
+  std::atomic<int> producers{0}; // still running; the loop exits at 0 after the deadline
+};
+
+// I/O side: turn submitted jobs into transfers on the loop's multi, and post
+// every job back to its producer once CURLMSG_DONE arrives or it is
+// cancelled. From the deadline on, in-flight and newly submitted jobs are
+// returned cancelled until every producer has stopped.
+static void handoff_io_thread(int id, const Options &opts, CURLSH *share, HandoffLoop &loop,
+                              std::span<CompletionQueue> completions, std::chrono::steady_clock::time_point deadline,
+                              WorkerStats &stats)
+{
+  using clock = std::chrono::steady_clock;
+  EasyPool pool(opts, share);
+  PollDriver driver(loop.multi, &stats.gauges); // curl_multi_poll, which curl_multi_wakeup interrupts
+  TransferTable transfers;
+  std::unique_ptr<BodyRing> ring;
+  if (opts.body == BodyMode::ring)
+    ring = std::make_unique<BodyRing>(opts.body_ring_mb << 20);
+  Xoshiro256ss rng{stream_seed(opts, RngStream::io, static_cast<uint64_t>(id))};
+  std::uniform_int_distribution<int> pick10(0, 9);
+  // Worker ids and I/O thread ids share the progress stream kind
+  progress_rng() = Xoshiro256ss(stream_seed(opts, RngStream::progress, uint64_t{1} << 31 | static_cast<uint64_t>(id)));
+
+  auto post = [&](HandoffJob &job, bool cancelled) {
+    job.cancelled = cancelled;
+    job.posted = clock::now();
+    CompletionQueue &cq = completions[job.producer];
+    cq.jobs.push(&job);
+    cq.posts.fetch_add(1, std::memory_order_release);
+    cq.posts.notify_one();
+  };
+  auto cancel = [&](Transfer &t) {
+    HandoffJob &job = *t.job;
+    stats.bytes.add(static_cast<uint64_t>(t.bytes));
+    finish_easy(loop.multi, pool, transfers, t);
+    post(job, true);
+  };
+
+  bool stopping = false;
+  for (;;)
+  {
+    while (HandoffJob *job = loop.submissions.pop())
+    {
+      if (stopping)
+      {
+        post(*job, true);
+        continue;
+      }
+      Transfer &t = add_easy(loop.multi, pool, transfers, ring.get(), job->url, opts.abort.plan(progress_rng()));
+      t.job = job;
+      stats.submit_us.record(micros(t.start - job->submitted));
+    }
+    // Producers only stop once all their jobs are back, so none is queued
+    if (stopping && loop.producers.load(std::memory_order_acquire) == 0)
+      break;
+
+    driver.drive();
+
+    int msgs_left = 0;
+    while (CURLMsg *msg = curl_multi_info_read(loop.multi, &msgs_left))
+    {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      Transfer &t = TransferTable::of(msg->easy_handle);
+      HandoffJob &job = *t.job;
+      CURLcode result = msg->data.result;
+      stats.record_done(t, result);
+      if (opts.body == BodyMode::crc32c)
+        stats.verify_body(t, result);
+      stats.bytes.add(static_cast<uint64_t>(t.bytes));
+      finish_easy(loop.multi, pool, transfers, t);
+      post(job, false);
+    }
+
+    if (!transfers.empty() && pick10(rng) == 0)
+    {
+      log("[cancel] io thread ", id, " removing handle");
+      stats.cancelled.add();
+      cancel(transfers[rng() % transfers.size()]);
+    }
+
+    if (!stopping && clock::now() >= deadline)
+    {
+      stopping = true;
+      while (!transfers.empty())
+        cancel(transfers[transfers.size() - 1]);
+    }
+  }
+  stats.pool = pool.stats();
+  log("[io] ", id, " finished");
+}
+
+// Producer side: keep depth jobs outstanding on one loop, waking it per
+// submission, and sleep on the completion queue in between.
+static void handoff_producer(int id, const Options &opts, const UrlCorpus &corpus, HandoffLoop &loop,
+                             CompletionQueue &cq, size_t depth, std::chrono::steady_clock::time_point deadline,
+                             InflightBudget &budget, WorkerStats &stats)
+{
+  using clock = std::chrono::steady_clock;
+  std::deque<HandoffJob> storage(depth);
+  std::vector<HandoffJob *> idle;
+  for (HandoffJob &job : storage)
+    idle.push_back(&job);
+  Xoshiro256ss url_rng{stream_seed(opts, RngStream::urls, static_cast<uint64_t>(id))};
+
+  size_t outstanding = 0;
+  for (;;)
+  {
+    bool open = clock::now() < deadline;
+    while (open && !idle.empty() && budget.try_acquire())
+    {
+      HandoffJob *job = idle.back();
+      idle.pop_back();
+      job->url = corpus.sample(url_rng);
+      job->producer = id;
+      job->submitted = clock::now();
+      loop.submissions.push(job);
+      curl_multi_wakeup(loop.multi);
+      stats.wakeups.add();
+      ++outstanding;
+    }
+    if (outstanding == 0)
+    {
+      if (!open)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1)); // budget exhausted elsewhere
+      continue;
+    }
+
+    // Read the post count first: a completion pushed after an empty pop
+    // bumps it, so the wait cannot miss it
+    uint32_t seen = cq.posts.load(std::memory_order_acquire);
+    HandoffJob *job = cq.jobs.pop();
+    if (!job)
+    {
+      cq.posts.wait(seen, std::memory_order_acquire);
+      continue;
+    }
+    for (; job; job = cq.jobs.pop())
+    {
+      // A cancelled job never completed, so it would skew the handoff costs
+      if (job->cancelled)
+      {
+        stats.handoff_cancelled.add();
+      }
+      else
+      {
+        auto now = clock::now();
+        stats.complete_us.record(micros(now - job->posted));
+        stats.round_trip_us.record(micros(now - job->submitted));
+      }
+      idle.push_back(job);
+      --outstanding;
+      budget.release();
+    }
+  }
+  loop.producers.fetch_sub(1, std::memory_order_release);
+  curl_multi_wakeup(loop.multi);
+  log("[producer] ", id, " finished");
+}
+
+// Built-in URL sets, tagged with the category --url-weights refers to.
+struct TaggedUrl
+{
+  const char *category;
+  const char *url;
+};
+
+// All URLs for stress testing organized by category
+static constexpr std::array<TaggedUrl, 68> all_test_urls = {{
+    // Small files (< 1MB)
+    {"small", "https://cdn.kernel.org/pub/linux/kernel/v6.x/sha256sums.asc"},
+    {"small", "https://raw.githubusercontent.com/curl/curl/master/README"},
+    {"small", "https://speed.hetzner.de/100KB.bin"},
+    {"small", "https://speed.hetzner.de/1MB.bin"},
+
+    // Medium files (1-10MB)
+    {"medium", "https://speed.hetzner.de/10MB.bin"},
+    {"medium", "https://www.learningcontainer.com/wp-content/uploads/2020/05/sample-5mb.pdf"},
+    {"medium", "https://proof.ovh.net/files/5Mb.dat"},
+
+    // Large files (> 10MB) - use with caution as they might slow down tests
+    {"large", "https://speed.hetzner.de/100MB.bin"},
+    {"large", "https://proof.ovh.net/files/100Mb.dat"},
+
+    // Specific file types
+    {"small", "https://www.w3.org/WAI/ER/tests/xhtml/testfiles/resources/pdf/dummy.pdf"},
+    {"medium", "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/04/file_example_MP4_480_1_5MG.mp4"},
+    {"small", "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/11/file_example_MP3_700KB.mp3"},
+    {"small", "https://file-examples.com/storage/fe2a41b7b56438da93df486/2017/10/file_example_PNG_500kB.png"},
+
+    // HTTPS with redirects
+    {"redirect", "https://bit.ly/3y0UWGJ"},
+    {"redirect", "https://httpbin.org/redirect/3"},
+
+    // Server with special behavior
+    {"slow", "https://httpbin.org/delay/2"},
+    {"error", "https://httpbin.org/status/429"},
+    {"error", "https://httpbin.org/status/500"},
+    {"error", "https://httpbin.org/status/404"},
+
+    // IPv6 enabled servers
+    {"ipv6", "https://ipv6.google.com/"},
+    {"ipv6", "https://ipv6.cloudflare-dns.com/"},
+
+    // Popular CDNs
+    {"small", "https://ajax.googleapis.com/ajax/libs/jquery/3.6.0/jquery.min.js"},
+    {"small", "https://cdnjs.cloudflare.com/ajax/libs/jquery/3.6.0/jquery.min.js"},
+    {"small", "https://cdn.jsdelivr.net/npm/bootstrap@5.1.3/dist/css/bootstrap.min.css"},
+    {"small", "https://unpkg.com/react@17/umd/react.production.min.js"},
+
+    // Cloud storage providers
+    {"medium", "https://storage.googleapis.com/pub-tools-public-publication-data/pdf/1e476f4d97eecc7f3673d74cbce0387a15a8ab53.pdf"},
+    {"medium", "https://download.microsoft.com/download/9/3/F/93FCF1E7-E6A4-478B-96E7-D4B285925B00/GUID-4.pdf"},
+    {"page", "https://aws.amazon.com/lambda/resources/"},
+    {"large", "https://dl.fbaipublications.com/fasttext/vectors-crawl/cc.en.300.bin.gz"},
+
+    // Government sites
+    {"page", "https://www.nasa.gov/wp-content/themes/nasa/assets/images/nasa-logo.svg"},
+    {"page", "https://www.whitehouse.gov/"},
+    {"page", "https://www.parliament.uk/"},
+    {"page", "https://europa.eu/european-union/index_en"},
+
+    // University sites
+    {"page", "https://www.ox.ac.uk/"},
+    {"page", "https://www.harvard.edu/"},
+    {"page", "https://www.stanford.edu/"},
+    {"page", "https://www.mit.edu/"},
+
+    // Different file types
+    {"small", "https://www.w3.org/TR/PNG/iso_8859-1.txt"},
+    {"small", "https://www.w3.org/People/mimasa/test/imgformat/img/w3c_home.jpg"},
+    {"small", "https://filesamples.com/samples/document/csv/sample1.csv"},
+    {"small", "https://filesamples.com/samples/code/json/sample1.json"},
+
+    // Redirects and special cases
+    {"page", "https://httpstat.us/200"},
+    {"redirect", "https://httpstat.us/301"},
+    {"error", "https://httpstat.us/400"},
+    {"error", "https://httpstat.us/503"},
+
+    // International domains
+    {"page", "https://www.bbc.co.uk/"},
+    {"page", "https://www.tagesschau.de/"},
+    {"page", "https://www.nhk.or.jp/"},
+    {"page", "https://www.rtve.es/"},
+
+    // Media streaming and large files
+    {"large", "https://commondatastorage.googleapis.com/gtv-videos-bucket/sample/BigBuckBunny.mp4"}, // Large file
+    {"large", "https://commondatastorage.googleapis.com/gtv-videos-bucket/sample/TearsOfSteel.mp4"}, // Large file
+
+    // API endpoints with different response types
+    {"api", "https://api.chucknorris.io/jokes/random"},
+    {"api", "https://cat-fact.herokuapp.com/facts/random"},
+    {"api", "https://api.publicapis.org/entries"},
+    {"api", "https://jsonplaceholder.typicode.com/posts"},
+
+    // Different network challenges
+    {"slow", "https://deelay.me/1000/https://example.com"}, // 1 second delay
+    {"slow", "https://deelay.me/3000/https://example.com"}, // 3 second delay
+
+    // Health check endpoints
+    {"api", "https://status.github.com/api/status.json"},
+    {"api", "https://www.githubstatus.com/"},
+    {"api", "https://status.cloud.google.com/"},
+    {"api", "https://status.aws.amazon.com/"},
+
+    // Additional variety for volume testing
+    {"large", "https://archive.org/download/BigBuckBunny_124/Content/big_buck_bunny_720p_surround.mp4"},
+    {"small", "https://cdn.shopify.com/s/files/1/0155/7645/products/cover_efa16558-4f83-4c39-941a-193fa9bc6854_large.jpg"},
+    {"medium", "https://soundhelix.com/examples/mp3/SoundHelix-Song-1.mp3"},
+    {"small", "https://fonts.googleapis.com/css?family=Roboto:300,400,500,700"},
+    {"large", "https://www.php.net/distributions/php-8.0.0.tar.gz"},
+    {"large", "https://www.python.org/ftp/python/3.9.7/Python-3.9.7.tar.xz"},
+    {"large", "https://nodejs.org/dist/v14.17.6/node-v14.17.6.tar.gz"}}};
+
+
+// Paths served by the local origin (origin_server.cpp), appended to each
+// --origin base URL. Query parameters shape the response.
+static constexpr std::array<TaggedUrl, 14> local_test_paths = {{
+    // Small and medium bodies
+    {"small", "/small?size=1024"},
+    {"small", "/small?size=16384"},
+    {"medium", "/medium?size=1048576"},
+    {"medium", "/medium?size=5242880"},
+
+    // Large bodies, also streamed chunked
+    {"large", "/large?size=33554432"},
+    {"large", "/large?size=33554432&chunked=1"},
+    {"large", "/chunked?size=262144&chunked=1"},
+
+    // Slow responses
+    {"slow", "/delay?size=1024&delay=100"},
+    {"slow", "/delay?size=1024&delay=1000"},
+
+    // Redirect chain
+    {"redirect", "/redirect?redirect=3&size=4096"},
+
+    // Error statuses
+    {"error", "/status?status=404&size=256"},
+    {"error", "/status?status=429&size=0"},
+    {"error", "/status?status=500&size=512"},
+    {"error", "/status?status=503&size=0&delay=50"}}};
+
+// Fill corpus from --url-file, or from the built-in set --urls selects.
+static bool build_corpus(const Options &opts, UrlCorpus &corpus, std::string &error)
+{
+  if (!opts.url_file.empty())
+  {
+    if (!corpus.load_file(opts.url_file, error))
+      return false;
+  }
+  else if (opts.url_set == UrlSet::internet)
+  {
+    for (const TaggedUrl &u : all_test_urls)
+      corpus.add(u.category, u.url);
+  }
+  else
+  {
+    for (const std::string &origin : opts.origins)
+      for (const TaggedUrl &u : local_test_paths)
+        corpus.add(u.category, corpus.owned(origin + u.url));
+  }
+  return corpus.finalize(opts.url_weights, error);
+}
+
+static bool parse_engine(Options &opts, std::string_view value)
+{
+  if (value == "poll")
+    opts.engine = Engine::poll;
+  else if (value == "socket")
+    opts.engine = Engine::socket;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_threads(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.threads) && opts.threads > 0;
+}
+
+static bool parse_per_multi(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.per_multi) && opts.per_multi > 0;
+}
+
+static bool parse_max_inflight(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.max_inflight);
+}
+
+static bool parse_switch(std::string_view value, bool &out)
+{
+  if (value == "on" || value == "1" || value == "true")
+    out = true;
+  else if (value == "off" || value == "0" || value == "false")
+    out = false;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_easy_pool(Options &opts, std::string_view value)
+{
+  return parse_switch(value, opts.easy_pool);
+}
+
+static bool parse_url_set(Options &opts, std::string_view value)
+{
+  if (value == "internet")
+    opts.url_set = UrlSet::internet;
+  else if (value == "local")
+    opts.url_set = UrlSet::local;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_origins(Options &opts, std::string_view value)
+{
+  opts.origins.clear();
+  while (!value.empty())
+  {
+    std::string_view origin = next_spec_token(value, ",");
+    while (origin.ends_with('/'))
+      origin.remove_suffix(1);
+    if (!origin.empty())
+      opts.origins.emplace_back(origin);
+  }
+  return !opts.origins.empty();
+}
+
+static bool parse_cainfo(Options &opts, std::string_view value)
+{
+  opts.cainfo = value;
+  return !opts.cainfo.empty();
+}
+
+static bool parse_body(Options &opts, std::string_view value)
+{
+  if (value == "discard")
+    opts.body = BodyMode::discard;
+  else if (value == "crc32c")
+    opts.body = BodyMode::crc32c;
+  else if (value == "ring")
+    opts.body = BodyMode::ring;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_body_ring_mb(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.body_ring_mb) && opts.body_ring_mb > 0;
+}
+
+static bool parse_share(Options &opts, std::string_view value)
+{
+  opts.share = 0;
+  if (value == "off")
+    return true;
+  if (value == "all")
+  {
+    opts.share = SHARE_DNS | SHARE_CONNECT | SHARE_SSL;
+    return true;
+  }
+  while (!value.empty())
+  {
+    std::string_view item = next_spec_token(value, ",");
+    if (item == "dns")
+      opts.share |= SHARE_DNS;
+    else if (item == "connect")
+      opts.share |= SHARE_CONNECT;
+    else if (item == "ssl")
+      opts.share |= SHARE_SSL;
+    else
+      return false;
+  }
+  return opts.share != 0;
+}
+
+static bool parse_share_lock(Options &opts, std::string_view value)
+{
+  if (value == "rwlock")
+    opts.share_lock = ShareLockKind::rwlock;
+  else if (value == "spin")
+    opts.share_lock = ShareLockKind::spin;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_load(Options &opts, std::string_view value)
+{
+  if (value == "closed")
+    opts.load = LoadMode::closed;
+  else if (value == "fixed")
+    opts.load = LoadMode::fixed;
+  else if (value == "poisson")
+    opts.load = LoadMode::poisson;
+  else if (value == "ramp")
+    opts.load = LoadMode::ramp;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_rate(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.rate) && opts.rate > 0;
+}
+
+static bool parse_rate_end(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.rate_end) && opts.rate_end >= 0;
+}
+
+static bool parse_http(Options &opts, std::string_view value)
+{
+  if (value == "default")
+    opts.http = HttpVersion::curl_default;
+  else if (value == "1.1")
+    opts.http = HttpVersion::v1_1;
+  else if (value == "2")
+    opts.http = HttpVersion::v2;
+  else if (value == "2-prior")
+    opts.http = HttpVersion::v2_prior;
+  else if (value == "3")
+    opts.http = HttpVersion::v3;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_max_host_connections(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.max_host_connections) && opts.max_host_connections >= 0;
+}
+
+static bool parse_max_streams(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.max_streams) && opts.max_streams > 0;
+}
+
+static bool parse_io_threads(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.io_threads) && opts.io_threads >= 0;
+}
+
+static bool parse_url_file(Options &opts, std::string_view value)
+{
+  opts.url_file = value;
+  return !value.empty();
+}
+
+static bool parse_url_weights(Options &opts, std::string_view value)
+{
+  opts.url_weights = value; // categories are checked once the corpus is loaded
+  return true;
+}
+
+static bool parse_seed(Options &opts, std::string_view value)
+{
+  uint64_t seed = 0;
+  if (!parse_spec_number(value, seed))
+    return false;
+  opts.seed = seed;
+  return true;
+}
+
+static bool parse_abort(Options &opts, std::string_view value)
+{
+  return opts.abort.parse(value);
+}
+
+static bool parse_retry(Options &opts, std::string_view value)
+{
+  return opts.retry.parse(value);
+}
+
+static bool parse_trace(Options &opts, std::string_view value)
+{
+  opts.trace_file = value;
+  return !value.empty();
+}
+
+static bool parse_replay(Options &opts, std::string_view value)
+{
+  opts.replay_file = value;
+  return !value.empty();
+}
+
+static bool parse_procs(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.procs) && opts.procs >= 0;
+}
+
+static bool parse_listen(Options &opts, std::string_view value)
+{
+  opts.listen = value;
+  return !value.empty();
+}
+
+static bool parse_expect_hosts(Options &opts, std::string_view value)
+{
+  return parse_spec_number(value, opts.expect_hosts) && opts.expect_hosts >= 0;
+}
+
+static bool parse_report_to(Options &opts, std::string_view value)
+{
+  opts.report_to = value;
+  return !value.empty();
+}
+
+static bool parse_pin(Options &opts, std::string_view value)
+{
+  if (value == "off")
+    opts.pin = PinMode::off;
+  else if (value == "cpu")
+    opts.pin = PinMode::cpu;
+  else if (value == "node")
+    opts.pin = PinMode::node;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_alloc(Options &opts, std::string_view value)
+{
+  if (value == "system")
+    opts.alloc = AllocMode::system;
+  else if (value == "pool")
+    opts.alloc = AllocMode::pool;
+  else if (value == "pool-debug")
+    opts.alloc = AllocMode::pool_debug;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_flow(Options &opts, std::string_view value)
+{
+  static constexpr std::pair<std::string_view, FlowKind> kinds[] = {
+      {"off", FlowKind::off},        {"single", FlowKind::single}, {"chain", FlowKind::chain},
+      {"fanout", FlowKind::fanout},  {"retry", FlowKind::retry},   {"mix", FlowKind::mix},
+  };
+  for (const auto &[name, kind] : kinds)
+    if (value == name)
+    {
+      opts.flow = kind;
+      return true;
+    }
+  return false;
+}
+
+static bool parse_quick_exit(Options &opts, std::string_view value)
+{
+  return parse_switch(value, opts.quick_exit);
+}
+
+static bool parse_teardown(Options &opts, std::string_view value)
+{
+  return opts.teardown.parse(value);
+}
+
+static bool parse_live(Options &opts, std::string_view value)
+{
+  opts.live = value == "off" ? std::string_view{} : value;
+  return !value.empty();
+}
+
+static bool parse_results(Options &opts, std::string_view value)
+{
+  opts.results_file = value;
+  return !value.empty();
+}
+
+static bool parse_duration(Options &opts, std::string_view value)
+{
+  long seconds = 0;
+  if (!parse_spec_number(value, seconds) || seconds <= 0)
+    return false;
+  opts.duration = std::chrono::seconds(seconds);
+  return true;
+}
+
+// [threads:|per-multi:]N,N,... ; the axis defaults to threads
+static bool parse_sweep(Options &opts, std::string_view value)
+{
+  opts.sweep_axis = SweepAxis::threads;
+  if (value.starts_with("threads:"))
+    value.remove_prefix(8);
+  else if (value.starts_with("per-multi:"))
+  {
+    opts.sweep_axis = SweepAxis::per_multi;
+    value.remove_prefix(10);
+  }
+
+  opts.sweep.clear();
+  while (!value.empty())
+  {
+    size_t level = 0;
+    if (!parse_spec_number(next_spec_token(value, ","), level) || level == 0 ||
+        level > static_cast<size_t>(std::numeric_limits<int>::max()))
+      return false;
+    opts.sweep.push_back(level);
+  }
+  return !opts.sweep.empty();
+}
+
+struct OptionSpec
+{
+  std::string_view flag; // --flag=value or --flag value
+  const char *env;       // environment fallback
+  const char *help;
+  bool (*apply)(Options &, std::string_view);
+};
+
+static constexpr OptionSpec OPTION_SPECS[] = {
+    {"--engine", "CRASHER_ENGINE", "poll|socket  event loop driving each multi handle (default poll)", parse_engine},
+    {"--threads", "CRASHER_THREADS", "N  worker threads, one CURLM each (default 16)", parse_threads},
+    {"--per-multi", "CRASHER_PER_MULTI", "N  in-flight transfers per multi handle (default 5)", parse_per_multi},
+    {"--max-inflight", "CRASHER_MAX_INFLIGHT", "N  process-wide in-flight budget, 0 = unlimited (default 0)",
+     parse_max_inflight},
+    {"--duration", "CRASHER_DURATION", "S  run length in seconds (default random 1-30 s per thread)", parse_duration},
+    {"--sweep", "CRASHER_SWEEP",
+     "[threads:|per-multi:]N,N,...  run once per concurrency level and report throughput", parse_sweep},
+    {"--easy-pool", "CRASHER_EASY_POOL",
+     "on|off  recycle easy handles with curl_easy_reset; off = init/cleanup per transfer (default on)",
+     parse_easy_pool},
+    {"--urls", "CRASHER_URLS", "internet|local  URL set: public internet or the local origin (default internet)",
+     parse_url_set},
+    {"--origin", "CRASHER_ORIGIN",
+     "URL[,URL...]  local origin base URLs (default http://127.0.0.1:8080,https://127.0.0.1:8443)", parse_origins},
+    {"--url-file", "CRASHER_URL_FILE",
+     "PATH  corpus file, one '[category] URL' per line; replaces the --urls set", parse_url_file},
+    {"--url-weights", "CRASHER_URL_WEIGHTS",
+     "CAT=W,...  category selection weights; unnamed categories get 0 (default: uniform over URLs)",
+     parse_url_weights},
+    {"--abort", "CRASHER_ABORT",
+     "SPEC  progress-callback aborts: off, or p=PCT,bytes=N[-M],ms=N[-M],phase=dns|connect|tls|body,dice=PCT "
+     "(default bytes=100K,dice=20)",
+     parse_abort},
+    {"--retry", "CRASHER_RETRY",
+     "SPEC  retry failed requests with backoff behind a per-host breaker: off, on, or attempts=N,base=MS,cap=MS,"
+     "on=CLASS+...,breaker=N,open=MS (default off)",
+     parse_retry},
+    {"--seed", "CRASHER_SEED",
+     "N  seed every random stream (URLs, cancels, aborts, run lengths, resolver faults) (default random)",
+     parse_seed},
+    {"--trace", "CRASHER_TRACE", "PATH  record adds, cancels, aborts, completions and resolver decisions",
+     parse_trace},
+    {"--replay", "CRASHER_REPLAY", "PATH  drive the run from a --trace recording instead of random choices",
+     parse_replay},
+    {"--cainfo", "CRASHER_CAINFO", "PATH  CA bundle, e.g. the origin's origin-cert.pem", parse_cainfo},
+    {"--body", "CRASHER_BODY",
+     "discard|crc32c|ring  body consumer; crc32c verifies X-Body-CRC32C from the origin (default discard)",
+     parse_body},
+    {"--body-ring-mb", "CRASHER_BODY_RING_MB", "N  per-worker mmap ring size for --body=ring (default 16)",
+     parse_body_ring_mb},
+    {"--share", "CRASHER_SHARE",
+     "off|all|dns,connect,ssl  one CURLSH across all workers for these caches; off = no DNS cache, no reuse "
+     "(default off)",
+     parse_share},
+    {"--share-lock", "CRASHER_SHARE_LOCK", "rwlock|spin  per-data-type lock behind the CURLSH (default rwlock)",
+     parse_share_lock},
+    {"--load", "CRASHER_LOAD",
+     "closed|fixed|poisson|ramp  closed = refill as transfers finish; others start transfers at --rate (default "
+     "closed)",
+     parse_load},
+    {"--rate", "CRASHER_RATE", "R  open-loop transfer starts per second, whole process", parse_rate},
+    {"--rate-end", "CRASHER_RATE_END", "R  --load=ramp: rate reached at the end of the run (default 0)",
+     parse_rate_end},
+    {"--http", "CRASHER_HTTP",
+     "default|1.1|2|2-prior|3  HTTP version; 2, 2-prior and 3 multiplex streams and allow reuse (default default)",
+     parse_http},
+    {"--max-host-connections", "CRASHER_MAX_HOST_CONNECTIONS",
+     "N  per-multi connection cap per host, 0 = unlimited (default 0)", parse_max_host_connections},
+    {"--max-streams", "CRASHER_MAX_STREAMS", "N  multiplexed streams per connection (default 100)",
+     parse_max_streams},
+    {"--io-threads", "CRASHER_IO_THREADS",
+     "N  handoff mode: --threads producers submit to N I/O threads owning the multis, 0 = off (default 0)",
+     parse_io_threads},
+    {"--procs", "CRASHER_PROCS",
+     "N  fork N worker processes pinned to CPU slices and aggregate their reports, 0 = in-process (default 0)",
+     parse_procs},
+    {"--listen", "CRASHER_LISTEN", "[HOST:]PORT  coordinator: accept reports from --report-to hosts",
+     parse_listen},
+    {"--expect-hosts", "CRASHER_EXPECT_HOSTS", "N  coordinator: wait for N --report-to hosts (default 0)",
+     parse_expect_hosts},
+    {"--report-to", "CRASHER_REPORT_TO",
+     "HOST:PORT  send this host's process reports to a --listen coordinator (numeric HOST)", parse_report_to},
+    {"--pin", "CRASHER_PIN",
+     "off|cpu|node  pin each worker (and its multi and resolver threads) to one CPU or one NUMA node (default off)",
+     parse_pin},
+    {"--alloc", "CRASHER_ALLOC",
+     "system|pool|pool-debug  libcurl allocator; pool-debug poisons and quarantines frees (default system)",
+     parse_alloc},
+    {"--flow", "CRASHER_FLOW",
+     "off|single|chain|fanout|retry|mix  run per-multi coroutine tasks per worker doing this flow (default off)",
+     parse_flow},
+    {"--quick-exit", "CRASHER_QUICK_EXIT",
+     "on|off  CURLOPT_QUICK_EXIT: abandon resolver threads at cleanup instead of joining them (default on)",
+     parse_quick_exit},
+    {"--teardown", "CRASHER_TEARDOWN",
+     "SPEC  time shutdowns instead of a stress run: on, or inflight=N,quick_exit=on|off|both,"
+     "cleanup=serial|parallel|both,trials=N,settle=MS",
+     parse_teardown},
+    {"--live", "CRASHER_LIVE",
+     "off|on|[HOST:]PORT|unix:PATH  print rates every second and serve them as Prometheus text (default off)",
+     parse_live},
+    {"--results", "CRASHER_RESULTS",
+     "PATH  write configuration, curl version and per-round results as JSON, or CSV for *.csv; see crasher_compare",
+     parse_results},
+};
+
+static void usage(const char *argv0)
+{
+  std::cerr << "usage: " << argv0 << " [options]\n";
+  for (const OptionSpec &spec : OPTION_SPECS)
+    std::cerr << "  " << spec.flag << "=" << spec.help << "  [" << spec.env << "]\n";
+}
+
+[[noreturn]] static void bad_option(const char *argv0, std::string_view what, std::string_view value)
+{
+  std::cerr << argv0 << ": invalid value '" << value << "' for " << what << "\n";
+  usage(argv0);
+  std::exit(2);
+}
+
+static Options parse_options(int argc, char **argv)
+{
+  Options opts;
+  for (const OptionSpec &spec : OPTION_SPECS)
+  {
+    const char *value = std::getenv(spec.env);
+    if (value && *value && !spec.apply(opts, value))
+      bad_option(argv[0], spec.env, value);
+  }
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage(argv[0]);
+      std::exit(0);
+    }
+
+    std::string_view name = arg.substr(0, arg.find('='));
+    const OptionSpec *spec = nullptr;
+    for (const OptionSpec &candidate : OPTION_SPECS)
+      if (candidate.flag == name)
+        spec = &candidate;
+    if (!spec)
+    {
+      usage(argv[0]);
+      std::exit(2);
+    }
+
+    std::string_view value;
+    if (name.size() < arg.size())
+      value = arg.substr(name.size() + 1);
+    else if (i + 1 < argc)
+      value = argv[++i];
+    if (!spec->apply(opts, value))
+      bad_option(argv[0], spec->flag, value);
+  }
+  if (opts.load != LoadMode::closed && opts.rate <= 0)
+  {
+    std::cerr << argv[0] << ": open-loop --load needs --rate\n";
+    std::exit(2);
+  }
+  if ((!opts.trace_file.empty() || !opts.replay_file.empty()) && (opts.io_threads > 0 || !opts.sweep.empty()))
+  {
+    std::cerr << argv[0] << ": --trace and --replay record a single round without --io-threads\n";
+    std::exit(2);
+  }
+  bool scale_out = opts.procs > 0 || !opts.listen.empty() || !opts.report_to.empty();
+  if (scale_out && (!opts.trace_file.empty() || !opts.replay_file.empty() || !opts.sweep.empty()))
+  {
+    std::cerr << argv[0] << ": --procs, --listen and --report-to run single rounds without --trace or --replay\n";
+    std::exit(2);
+  }
+  if (opts.listen.empty() != (opts.expect_hosts == 0))
+  {
+    std::cerr << argv[0] << ": --listen and --expect-hosts go together\n";
+    std::exit(2);
+  }
+  if (!opts.report_to.empty() && opts.procs == 0)
+    opts.procs = 1; // a remote host's report includes its crashes
+  if (!opts.trace_file.empty() && !opts.replay_file.empty())
+  {
+    std::cerr << argv[0] << ": --trace and --replay are exclusive\n";
+    std::exit(2);
+  }
+  if (opts.flow != FlowKind::off &&
+      (opts.io_threads > 0 || opts.load != LoadMode::closed || !opts.trace_file.empty() || !opts.replay_file.empty()))
+  {
+    std::cerr << argv[0] << ": --flow runs closed-loop workers without --io-threads, --trace or --replay\n";
+    std::exit(2);
+  }
+  if (opts.teardown.enabled() && (opts.procs > 0 || !opts.listen.empty() || !opts.report_to.empty() ||
+                                   !opts.sweep.empty() || opts.io_threads > 0 || !opts.trace_file.empty() ||
+                                   !opts.replay_file.empty()))
+  {
+    std::cerr << argv[0] << ": --teardown runs its own trials and cannot be combined with --procs, --listen, "
+              << "--report-to, --sweep, --io-threads, --trace or --replay\n";
+    std::exit(2);
+  }
+  if (!opts.live.empty() && (opts.procs > 0 || !opts.listen.empty() || opts.teardown.enabled()))
+  {
+    std::cerr << argv[0] << ": --live watches the workers of this process; it cannot be combined with --procs, "
+              << "--listen, --report-to or --teardown\n";
+    std::exit(2);
+  }
+  if (opts.retry.enabled() && (opts.io_threads > 0 || opts.flow != FlowKind::off || !opts.trace_file.empty() ||
+                                !opts.replay_file.empty()))
+  {
+    std::cerr << argv[0] << ": --retry cannot be combined with --io-threads, --flow, --trace or --replay\n";
+    std::exit(2);
+  }
+  if (opts.io_threads > 0 && (opts.engine != Engine::poll || opts.load != LoadMode::closed))
+  {
+    std::cerr << argv[0] << ": --io-threads needs --engine=poll and --load=closed\n";
+    std::exit(2);
+  }
+  const curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
+  if (opts.http == HttpVersion::v3 && !(curl_info->features & CURL_VERSION_HTTP3))
+  {
+    std::cerr << argv[0] << ": libcurl " << curl_info->version << " is built without HTTP/3\n";
+    std::exit(2);
+  }
+  if ((opts.http == HttpVersion::v2 || opts.http == HttpVersion::v2_prior) &&
+      !(curl_info->features & CURL_VERSION_HTTP2))
+  {
+    std::cerr << argv[0] << ": libcurl " << curl_info->version << " is built without HTTP/2\n";
+    std::exit(2);
+  }
+  return opts;
+}
+
+// Where one of a round's threads was pinned and how the scheduler treated it.
+struct ThreadPlacement
+{
+  std::string cpus; // affinity asked for
+  bool pinned = false;
+  int cpu = -1; // where it ended
+  int node = -1;
+  uint64_t migrations = 0;
+  uint64_t voluntary_switches = 0;
+  uint64_t involuntary_switches = 0;
+  uint64_t completed = 0;
+};
+
+// Threads that are neither main, a round's workers nor libcurl's resolver
+// threads: the log writers and the interposer's own, when they run
+static int helper_threads()
+{
+  int n = 0;
+#ifdef MYAPP_LOGGING_ENABLED
+  n += app_log().writer_running();
+#endif
+  using helpers_fn = int (*)();
+  static const auto fn = reinterpret_cast<helpers_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_helper_threads"));
+  return fn ? n + fn() : n;
+}
+
+// resolver_interpose's failed lookups so far by EAI code; all 0 if it is
+// not loaded.
+static std::array<uint64_t, RESOLVER_FAILURE_SLOTS> resolver_failures()
+{
+  using failures_fn = size_t (*)(uint64_t *, size_t);
+  static const auto fn = reinterpret_cast<failures_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_failures"));
+  std::array<uint64_t, RESOLVER_FAILURE_SLOTS> counts{};
+  if (fn)
+    fn(counts.data(), counts.size());
+  return counts;
+}
+
+static std::string resolver_failure_name(size_t index)
+{
+  using name_fn = const char *(*)(size_t);
+  static const auto fn = reinterpret_cast<name_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_failure_name"));
+  return fn ? fn(index) : "slot" + std::to_string(index);
+}
+
+// --live: once a second, sums the running round's counters and curl gauges,
+// prints the rates and refreshes the endpoint's Prometheus snapshot. All of
+// it is read from atomics the workers update anyway, so they never wait for
+// it. Each thread publishes its stats slot once built; a round detaches
+// before its slots go, and its totals carry over so counters only grow.
+class LiveMonitor
+{
+public:
+  using clock = std::chrono::steady_clock;
+  static constexpr auto INTERVAL = std::chrono::seconds(1);
+
+  // What a round exposes while it runs
+  struct Round
+  {
+    explicit Round(size_t slots) : stats(slots) {}
+    std::vector<std::atomic<const WorkerStats *>> stats; // null until its thread built it
+    int threads = 0;                                     // workers (handoff producers)
+    int io_threads = 0;                                  // handoff I/O threads
+  };
+
+  ~LiveMonitor() { stop(); }
+
+  // spec: "on" to print only, or an address for LiveEndpoint
+  bool open(std::string_view spec, std::string &error) { return spec == "on" || endpoint_.open(spec, error); }
+
+  void start() { thread_ = std::thread([this] { run(); }); }
+
+  void stop()
+  {
+    if (!thread_.joinable())
+      return;
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  void attach(Round &round)
+  {
+    std::lock_guard lock(mutex_);
+    round_ = &round;
+    ++rounds_;
+  }
+
+  void detach()
+  {
+    std::lock_guard lock(mutex_);
+    finished_ += sum(*round_);
+    round_ = nullptr;
+  }
+
+private:
+  struct Totals
+  {
+    uint64_t completed = 0, failed = 0, cancelled = 0, bytes = 0, resolved = 0, unresolved = 0, retries = 0;
+
+    Totals &operator+=(const Totals &o)
+    {
+      completed += o.completed;
+      failed += o.failed;
+      cancelled += o.cancelled;
+      bytes += o.bytes;
+      resolved += o.resolved;
+      unresolved += o.unresolved;
+      retries += o.retries;
+      return *this;
+    }
+  };
+
+  static Totals sum(const Round &round)
+  {
+    Totals t;
+    for (const auto &slot : round.stats)
+      if (const WorkerStats *s = slot.load(std::memory_order_acquire))
+      {
+        t.completed += s->completed.load();
+        t.failed += s->failed.load();
+        t.cancelled += s->cancelled.load();
+        t.bytes += s->bytes.load();
+        t.resolved += s->dns_us.count();
+        t.unresolved += s->results[CURLE_COULDNT_RESOLVE_HOST].load() + s->results[CURLE_COULDNT_RESOLVE_PROXY].load();
+        t.retries += s->retries.load();
+      }
+    return t;
+  }
+
+  void run()
+  {
+    const clock::time_point begin = clock::now();
+    clock::time_point last = begin;
+    Totals before;
+    std::string body;
+    for (clock::time_point next = begin + INTERVAL;; next += INTERVAL)
+    {
+      // Until the next sample: answer scrapes, or just wait, waking for stop()
+      for (std::unique_lock lock(mutex_); !stopping_ && clock::now() < next;)
+      {
+        if (!endpoint_.is_open())
+        {
+          wake_.wait_until(lock, next, [&] { return stopping_; });
+          continue;
+        }
+        lock.unlock();
+        endpoint_.serve_until(std::min(next, clock::now() + std::chrono::milliseconds(100)), body);
+        lock.lock();
+      }
+      std::unique_lock lock(mutex_);
+      if (stopping_)
+        return;
+      Totals now = finished_;
+      std::vector<std::pair<int, int>> gauges; // running, numfds per thread slot
+      int threads = 0;
+      if (round_)
+      {
+        now += sum(*round_);
+        threads = round_->threads + round_->io_threads;
+        for (const auto &slot : round_->stats)
+          if (const WorkerStats *s = slot.load(std::memory_order_acquire))
+            gauges.emplace_back(s->gauges.running.load(std::memory_order_relaxed),
+                                s->gauges.numfds.load(std::memory_order_relaxed));
+          else
+            gauges.emplace_back(0, 0);
+      }
+      const uint64_t round = rounds_;
+      lock.unlock();
+
+      // Whatever is not main, this thread, a helper, a worker or an I/O thread:
+      // libcurl's resolver threads
+      int resolver_threads = std::max(count_threads() - 2 - helper_threads() - threads, 0);
+      clock::time_point at = clock::now();
+      double seconds = std::chrono::duration<double>(at - last).count();
+      auto rate = [&](uint64_t a, uint64_t b) { return seconds > 0 ? (a - b) / seconds : 0.0; };
+      int running = 0, numfds = 0;
+      for (auto [r, n] : gauges)
+      {
+        running += r;
+        numfds += n;
+      }
+      double uptime = std::chrono::duration<double>(at - begin).count();
+      std::ostringstream line;
+      line << "[live] uptime_s=" << static_cast<uint64_t>(uptime) << " round=" << round
+           << " completed_per_s=" << rate(now.completed, before.completed)
+           << " failed_per_s=" << rate(now.failed, before.failed)
+           << " bytes_per_s=" << rate(now.bytes, before.bytes)
+           << " resolves_per_s=" << rate(now.resolved, before.resolved) << " running=" << running
+           << " numfds=" << numfds << " resolver_threads=" << resolver_threads << "\n";
+      std::cout << line.str() << std::flush;
+
+      MetricsText m;
+      m.family("crasher_uptime_seconds", "gauge", "Seconds since the live monitor started.");
+      m.sample("crasher_uptime_seconds", uptime);
+      m.family("crasher_round", "gauge", "Rounds started so far (sweep level).");
+      m.sample("crasher_round", static_cast<double>(round));
+      m.family("crasher_transfers_total", "counter", "Transfers by how they ended.");
+      // completed and failed are loaded apart, so failed may be ahead
+      uint64_t ok = now.completed >= now.failed ? now.completed - now.failed : 0;
+      m.sample("crasher_transfers_total", static_cast<double>(ok), "result=\"ok\"");
+      m.sample("crasher_transfers_total", static_cast<double>(now.failed), "result=\"failed\"");
+      m.sample("crasher_transfers_total", static_cast<double>(now.cancelled), "result=\"cancelled\"");
+      m.family("crasher_bytes_total", "counter", "Body bytes received.");
+      m.sample("crasher_bytes_total", static_cast<double>(now.bytes));
+      m.family("crasher_resolves_total", "counter", "Name resolutions as curl saw them.");
+      m.sample("crasher_resolves_total", static_cast<double>(now.resolved), "result=\"ok\"");
+      m.sample("crasher_resolves_total", static_cast<double>(now.unresolved), "result=\"failed\"");
+      m.family("crasher_retries_total", "counter", "Transfers started again by --retry.");
+      m.sample("crasher_retries_total", static_cast<double>(now.retries));
+      m.family("crasher_transfers_per_second", "gauge", "Completed transfers per second over the last interval.");
+      m.sample("crasher_transfers_per_second", rate(now.completed, before.completed));
+      m.family("crasher_bytes_per_second", "gauge", "Body bytes per second over the last interval.");
+      m.sample("crasher_bytes_per_second", rate(now.bytes, before.bytes));
+      m.family("crasher_multi_running", "gauge", "Running transfers curl last reported, per thread.");
+      for (size_t i = 0; i < gauges.size(); ++i)
+        m.sample("crasher_multi_running", gauges[i].first, "thread=\"" + std::to_string(i) + "\"");
+      m.family("crasher_poll_numfds", "gauge", "Descriptors with events in the last poll, per thread.");
+      for (size_t i = 0; i < gauges.size(); ++i)
+        m.sample("crasher_poll_numfds", gauges[i].second, "thread=\"" + std::to_string(i) + "\"");
+      m.family("crasher_resolver_threads", "gauge", "libcurl resolver threads: all but main, the monitor, log writers, workers and I/O threads.");
+      m.sample("crasher_resolver_threads", resolver_threads);
+      body = m.str();
+      before = now;
+      last = at;
+    }
+  }
+
+  LiveEndpoint endpoint_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  Round *round_ = nullptr;
+  uint64_t rounds_ = 0;
+  Totals finished_; // from detached rounds
+};
+
+static LiveMonitor *live_monitor = nullptr;
+
+struct RoundResult
+{
+  int threads = 0;    // producers in handoff mode
+  int io_threads = 0; // handoff mode
+  size_t per_multi = 0;
+  std::unique_ptr<WorkerStats> stats = std::make_unique<WorkerStats>();
+  std::chrono::duration<double> elapsed{};
+  std::vector<std::pair<const char *, ShareLocks::Stats>> share_locks; // per shared data type
+  std::vector<ThreadPlacement> placements; // --pin: one per worker, then one per I/O thread
+
+  double per_second(uint64_t n) const { return elapsed.count() > 0 ? n / elapsed.count() : 0.0; }
+};
+
+// One stress round: threads workers with per_multi transfers each.
+// replay holds each worker's recorded events when opts.replay_file is set.
+static RoundResult run_round(const Options &opts, const UrlCorpus &corpus, int num_threads, size_t per_multi,
+                             std::span<const std::vector<TraceRecord>> replay = {})
+{
+  Xoshiro256ss rng{stream_seed(opts, RngStream::round, 0)};
+  std::uniform_int_distribution<int> dice(1, 30);
+  InflightBudget budget(opts.max_inflight);
+  // Each thread builds its own stats, after pinning, so they live on its node
+  FirstTouchSlots<WorkerStats> stats(static_cast<size_t>(num_threads + opts.io_threads));
+  std::vector<ThreadPlacement> placements(stats.size());
+  const CpuTopology topology = CpuTopology::probe();
+
+  // One share object for the whole round; it outlives every easy handle
+  static constexpr std::pair<unsigned, curl_lock_data> SHARED_DATA[] = {
+      {SHARE_DNS, CURL_LOCK_DATA_DNS},
+      {SHARE_CONNECT, CURL_LOCK_DATA_CONNECT},
+      {SHARE_SSL, CURL_LOCK_DATA_SSL_SESSION},
+  };
+  CURLSH *share = nullptr;
+  std::unique_ptr<ShareLocks> locks;
+  if (opts.share)
+  {
+    share = curl_share_init();
+    locks = std::make_unique<ShareLocks>(opts.share_lock);
+    locks->install(share);
+    for (auto [bit, data] : SHARED_DATA)
+      if (opts.share & bit)
+        curl_share_setopt(share, CURLSHOPT_SHARE, data);
+  }
+
+  const CurlAllocator::Totals allocs_before = CurlAllocator::totals();
+  const auto failures_before = resolver_failures();
+  auto start = std::chrono::steady_clock::now();
+  if (event_trace)
+    event_trace->start(start);
+  std::vector<std::thread> threads;
+  LiveMonitor::Round live(stats.size());
+  live.threads = num_threads;
+  live.io_threads = opts.io_threads;
+  if (live_monitor)
+    live_monitor->attach(live);
+  // Thread slot runs fn(args..., its stats) where --pin puts it, counting
+  // how often the scheduler moved or switched it
+  auto spawn = [&](size_t slot, auto fn, auto... args) {
+    std::span<const int> cpus;
+    if (opts.pin == PinMode::cpu && !topology.cpus.empty())
+      cpus = std::span(topology.cpus).subspan(slot % topology.cpus.size(), 1);
+    else if (opts.pin == PinMode::node && !topology.nodes.empty())
+      cpus = topology.nodes[slot % topology.nodes.size()];
+    threads.emplace_back([&, slot, cpus, fn, args...] {
+      ThreadPlacement &where = placements[slot];
+      where.cpus = cpu_list(cpus);
+      where.pinned = !cpus.empty() && pin_current_thread(cpus);
+      WorkerStats &own = stats.emplace(slot);
+      live.stats[slot].store(&own, std::memory_order_release);
+      SchedCounters sched;
+      sched.start();
+      fn(args..., own);
+      SchedCounters::Sample taken = sched.stop();
+      own.migrations.add(taken.migrations);
+      own.voluntary_switches.add(taken.voluntary);
+      own.involuntary_switches.add(taken.involuntary);
+      where.cpu = current_cpu();
+      where.node = topology.node_of(where.cpu);
+      where.migrations = taken.migrations;
+      where.voluntary_switches = taken.voluntary;
+      where.involuntary_switches = taken.involuntary;
+      where.completed = own.completed.load();
+    });
+  };
+  std::vector<std::unique_ptr<HandoffLoop>> loops;
+  std::vector<CompletionQueue> completions(opts.io_threads > 0 ? num_threads : 0);
+  if (opts.io_threads > 0)
+  {
+    // Producers hand jobs to loop p % io_threads; one deadline for all
+    auto deadline = start + opts.duration.value_or(std::chrono::seconds(dice(rng)));
+    for (int i = 0; i < opts.io_threads; ++i)
+    {
+      loops.push_back(std::make_unique<HandoffLoop>());
+      loops.back()->multi = make_multi(opts);
+    }
+    for (int p = 0; p < num_threads; ++p)
+      loops[p % opts.io_threads]->producers.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < opts.io_threads; ++i)
+      spawn(static_cast<size_t>(num_threads + i), handoff_io_thread, i, std::cref(opts), share, std::ref(*loops[i]),
+            std::span<CompletionQueue>(completions), deadline);
+    for (int p = 0; p < num_threads; ++p)
+      spawn(static_cast<size_t>(p), handoff_producer, p, std::cref(opts), std::cref(corpus),
+            std::ref(*loops[p % opts.io_threads]), std::ref(completions[p]), per_multi, deadline, std::ref(budget));
+  }
+  else
+  {
+    for (int i = 0; i < num_threads; ++i)
+    {
+      auto duration = opts.duration.value_or(std::chrono::seconds(dice(rng)));
+      std::span<const TraceRecord> events;
+      if (static_cast<size_t>(i) < replay.size())
+        events = replay[i];
+      spawn(static_cast<size_t>(i), worker_thread, i, std::cref(corpus), duration, std::cref(opts), share, per_multi,
+            1.0 / num_threads, std::ref(budget), events);
+    }
+  }
+
+  for (auto &t : threads)
+    t.join();
+  if (live_monitor)
+    live_monitor->detach();
+  for (auto &loop : loops)
+    curl_multi_cleanup(loop->multi);
+
+  RoundResult result;
+  result.threads = num_threads;
+  result.io_threads = opts.io_threads;
+  result.per_multi = per_multi;
+  result.elapsed = std::chrono::steady_clock::now() - start;
+  for (size_t i = 0; i < stats.size(); ++i)
+    result.stats->merge(stats[i]);
+  const auto failures = resolver_failures();
+  for (size_t i = 0; i < failures.size(); ++i)
+    result.stats->resolver_failures[i].add(failures[i] - failures_before[i]);
+  if (opts.alloc != AllocMode::system)
+  {
+    const CurlAllocator::Totals allocs = CurlAllocator::totals();
+    result.stats->curl_allocs.add(allocs.allocs - allocs_before.allocs);
+    result.stats->curl_frees.add(allocs.frees - allocs_before.frees);
+    result.stats->curl_alloc_bytes.add(allocs.bytes - allocs_before.bytes);
+    result.stats->curl_large_allocs.add(allocs.large - allocs_before.large);
+    result.stats->curl_refills.add(allocs.refills - allocs_before.refills);
+    result.stats->curl_slab_bytes.add(allocs.slab_bytes);
+  }
+  if (opts.pin != PinMode::off)
+    result.placements = std::move(placements);
+  if (share)
+  {
+    static constexpr const char *NAMES[] = {"dns", "connect", "ssl_session"};
+    for (size_t i = 0; i < std::size(SHARED_DATA); ++i)
+      if (opts.share & SHARED_DATA[i].first)
+        result.share_locks.emplace_back(NAMES[i], locks->stats(SHARED_DATA[i].second));
+    // the share lock is also taken for curl's own bookkeeping
+    result.share_locks.emplace_back("share", locks->stats(CURL_LOCK_DATA_SHARE));
+    curl_share_cleanup(share);
+  }
+  return result;
+}
+
+static void print_histogram(std::ostream &out, std::string_view name, const LatencyHistogram &h)
+{
+  out << "[stats] " << name << " count=" << h.count() << " p50=" << h.percentile(0.50)
+      << " p99=" << h.percentile(0.99) << " p999=" << h.percentile(0.999) << " max=" << h.max() << "\n";
+}
+
+// resolver_interpose exports its telemetry when it is loaded into the
+// process (DYLD_INSERT_LIBRARIES / LD_PRELOAD); empty if it is not.
+static std::string resolver_report()
+{
+  using report_fn = size_t (*)(char *, size_t);
+  auto report = reinterpret_cast<report_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_report"));
+  if (!report)
+    return {};
+  std::string text(report(nullptr, 0), '\0');
+  report(text.data(), text.size() + 1);
+  return text;
+}
+
+// The interposer's hooks for reproducible runs, when it is loaded.
+static void resolver_seed(uint64_t seed)
+{
+  using seed_fn = void (*)(uint64_t);
+  if (auto fn = reinterpret_cast<seed_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_seed")))
+    fn(seed);
+}
+
+static void trace_resolve(void *ctx, const char *node, int error_index, int delay_ms)
+{
+  static_cast<TraceWriter *>(ctx)->record(TraceEvent::resolve, TRACE_NO_THREAD, fnv1a32(node ? node : ""),
+                                          static_cast<uint32_t>(std::max(delay_ms, 0)),
+                                          static_cast<uint8_t>(error_index + 1));
+}
+
+static void resolver_observe(TraceWriter *trace)
+{
+  using observe_fn = void (*)(void (*)(void *, const char *, int, int), void *);
+  if (auto fn = reinterpret_cast<observe_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_observe")))
+    fn(trace ? trace_resolve : nullptr, trace);
+}
+
+// Hand a trace's resolver decisions back to the interposer, in order.
+static void resolver_script(std::span<const TraceRecord> records)
+{
+  using script_fn = void (*)(const uint32_t *, const int *, const int *, size_t);
+  auto fn = reinterpret_cast<script_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_script"));
+  if (!fn)
+    return;
+  std::vector<uint32_t> hosts;
+  std::vector<int> errors, delays;
+  for (const TraceRecord &r : records)
+  {
+    if (r.event != TraceEvent::resolve)
+      continue;
+    hosts.push_back(r.transfer);
+    errors.push_back(static_cast<int>(r.code) - 1);
+    delays.push_back(static_cast<int>(r.arg));
+  }
+  if (!hosts.empty())
+    fn(hosts.data(), errors.data(), delays.data(), hosts.size());
+}
+
+static void print_report(std::ostream &out, const RoundResult &r)
+{
+  const WorkerStats &s = *r.stats;
+  out << "[stats] threads=" << r.threads << " per_multi=" << r.per_multi << " elapsed_s=" << r.elapsed.count()
+      << " completed=" << s.completed.load() << " failed=" << s.failed.load()
+      << " cancelled=" << s.cancelled.load() << " transfers_per_s=" << r.per_second(s.completed.load())
+      << " bytes_per_s=" << r.per_second(s.bytes.load()) << "\n";
+  print_histogram(out, "dns_us", s.dns_us);
+  print_histogram(out, "connect_us", s.connect_us);
+  print_histogram(out, "tls_us", s.tls_us);
+  print_histogram(out, "total_us", s.total_us);
+  if (s.scheduled.load())
+  {
+    out << "[stats] open_loop scheduled=" << s.scheduled.load() << " offered_per_s=" << r.per_second(s.scheduled.load())
+        << " unstarted=" << s.unstarted.load() << "\n";
+    print_histogram(out, "start_lag_us", s.start_lag_us);
+    print_histogram(out, "from_intended_us", s.from_intended_us);
+  }
+  if (uint64_t connections = s.new_connections.load())
+    out << "[stats] http h1=" << s.http_versions[0].load() << " h2=" << s.http_versions[1].load()
+        << " h3=" << s.http_versions[2].load() << " none=" << s.http_versions[3].load()
+        << " new_connections=" << connections
+        << " transfers_per_connection=" << static_cast<double>(s.completed.load()) / connections << "\n";
+  uint64_t aborted = 0;
+  for (const RelaxedCounter &c : s.aborts)
+    aborted += c.load();
+  if (aborted)
+  {
+    out << "[stats] aborts total=" << aborted;
+    for (size_t i = 1; i < s.aborts.size(); ++i)
+      out << " " << TRANSFER_PHASE_NAMES[i] << "=" << s.aborts[i].load();
+    out << "\n";
+  }
+  if (s.flows.load() || s.flows_cancelled.load())
+    out << "[stats] flows completed=" << s.flows.load() << " cancelled=" << s.flows_cancelled.load()
+        << " redirects=" << s.flow_redirects.load() << " retries=" << s.flow_retries.load() << "\n";
+  if (uint64_t requests = s.requests.load())
+  {
+    // amplification: transfers started per request the workload asked for
+    uint64_t attempts = requests + s.retries.load();
+    out << "[stats] retry requests=" << requests << " attempts=" << attempts
+        << " amplification=" << static_cast<double>(attempts) / requests << " recovered=" << s.retry_recovered.load()
+        << " exhausted=" << s.retry_exhausted.load() << " dropped=" << s.retry_dropped.load() << "\n";
+    out << "[stats] breaker trips=" << s.breaker_trips.load() << " probes=" << s.breaker_probes.load()
+        << " rejected=" << s.breaker_rejected.load() << "\n";
+    out << "[stats] failures";
+    for (size_t i = 1; i < FAILURE_CLASSES; ++i)
+      out << " " << FAILURE_CLASS_NAMES[i] << "=" << s.failure_classes[i].load();
+    out << "\n";
+    uint64_t resolved = s.dns_us.count();
+    uint64_t unresolved = s.results[CURLE_COULDNT_RESOLVE_HOST].load() + s.results[CURLE_COULDNT_RESOLVE_PROXY].load();
+    out << "[stats] resolve attempts=" << resolved + unresolved << " ok=" << resolved << " failed=" << unresolved
+        << " goodput_per_s=" << r.per_second(resolved) << "\n";
+    print_histogram(out, "request_us", s.request_us);
+  }
+  std::string eai;
+  for (size_t i = 0; i < s.resolver_failures.size(); ++i)
+    if (uint64_t n = s.resolver_failures[i].load())
+      eai += " " + resolver_failure_name(i) + "=" + std::to_string(n);
+  if (!eai.empty())
+    out << "[stats] resolver_failures" << eai << "\n";
+  if (s.replay_events.load() || s.replay_diverged.load())
+    out << "[stats] replay applied=" << s.replay_events.load() << " diverged=" << s.replay_diverged.load() << "\n";
+  if (r.io_threads > 0)
+  {
+    out << "[stats] handoff io_threads=" << r.io_threads << " producers=" << r.threads
+        << " wakeups=" << s.wakeups.load() << " cancelled=" << s.handoff_cancelled.load() << "\n";
+    print_histogram(out, "submit_us", s.submit_us);
+    print_histogram(out, "complete_us", s.complete_us);
+    print_histogram(out, "round_trip_us", s.round_trip_us);
+  }
+  for (size_t code = 0; code < s.results.size(); ++code)
+  {
+    if (uint64_t n = s.results[code].load())
+      out << "[stats] result " << code << " (" << curl_easy_strerror(static_cast<CURLcode>(code))
+          << ") count=" << n << "\n";
+  }
+  if (s.body_verified.load() || s.body_mismatched.load() || s.body_unverified.load())
+    out << "[stats] body verified=" << s.body_verified.load() << " mismatched=" << s.body_mismatched.load()
+        << " unverified=" << s.body_unverified.load() << "\n";
+  for (const auto &[name, lock] : r.share_locks)
+    out << "[stats] share_lock " << name << " acquisitions=" << lock.acquisitions << " contended="
+        << lock.contended << " wait_us=" << lock.wait.count() / 1000 << "\n";
+  if (uint64_t allocs = s.curl_allocs.load())
+  {
+    double transfers = static_cast<double>(std::max<uint64_t>(s.completed.load() + s.cancelled.load(), 1));
+    out << "[stats] curl_alloc allocs=" << allocs << " frees=" << s.curl_frees.load()
+        << " bytes=" << s.curl_alloc_bytes.load() << " large=" << s.curl_large_allocs.load()
+        << " refills=" << s.curl_refills.load() << " slab_bytes=" << s.curl_slab_bytes.load()
+        << " allocs_per_transfer=" << allocs / transfers
+        << " bytes_per_transfer=" << s.curl_alloc_bytes.load() / transfers << "\n";
+  }
+  out << "[stats] sched migrations=" << s.migrations.load() << " voluntary_cs=" << s.voluntary_switches.load()
+      << " involuntary_cs=" << s.involuntary_switches.load() << "\n";
+  for (size_t i = 0; i < r.placements.size(); ++i)
+  {
+    const ThreadPlacement &p = r.placements[i];
+    const char *role = i >= static_cast<size_t>(r.threads) ? "io" : r.io_threads > 0 ? "producer" : "worker";
+    out << "[worker] id=" << i << " role=" << role
+        << " cpus=" << p.cpus << (p.pinned || p.cpus == "any" ? "" : " (pin failed)") << " cpu=" << p.cpu
+        << " node=" << p.node << " migrations=" << p.migrations << " voluntary_cs=" << p.voluntary_switches
+        << " involuntary_cs=" << p.involuntary_switches << " completed=" << p.completed << "\n";
+  }
+  out << "[stats] easy_handles created=" << s.pool.created << " reused=" << s.pool.reused
+      << " setup_us=" << s.pool.setup.count() / 1000 << " teardown_us=" << s.pool.teardown.count() / 1000
+      << std::endl;
+}
+
+// --procs: one worker process of a scale-out run, as its coordinator sees it.
+// The child fills in its results; the coordinator adds how it ended.
+struct ProcReport
+{
+  std::string host;
+  uint64_t index = 0;
+  uint64_t pid = 0;
+  uint64_t seed = 0;         // the child's --seed: rerun it alone with this
+  std::string cpus;          // affinity list, e.g. "0-3"
+  bool has_result = false;   // the child sent its stats before it ended
+  int64_t exit_code = -1;    // exited with this status, -1 if killed
+  int64_t signal = 0;        // killed by this signal
+  bool core = false;         // ... and dumped core
+  RoundResult round;
+  std::string resolver; // its resolver_interpose report
+
+  bool crashed() const { return !has_result || exit_code != 0 || signal != 0; }
+
+  void encode(WireWriter &out) const
+  {
+    out.put(host);
+    for (uint64_t word : {index, pid, seed})
+      out.put(word);
+    out.put(cpus);
+    for (int64_t word : {int64_t{has_result}, exit_code, signal, int64_t{core}})
+      out.put(static_cast<uint64_t>(word));
+    out.put(static_cast<uint64_t>(round.threads));
+    out.put(static_cast<uint64_t>(round.io_threads));
+    out.put(round.per_multi);
+    out.put(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(round.elapsed).count()));
+    out.put(resolver);
+    round.stats->encode(out);
+  }
+
+  bool decode(const std::vector<uint64_t> &words)
+  {
+    WireReader in(words);
+    uint64_t flag = 0, code = 0, sig = 0, dumped = 0, threads = 0, io_threads = 0, elapsed_ns = 0;
+    bool ok = in.get(host) && in.get(index) && in.get(pid) && in.get(seed) && in.get(cpus) && in.get(flag) &&
+              in.get(code) && in.get(sig) && in.get(dumped) && in.get(threads) && in.get(io_threads) &&
+              in.get(round.per_multi) && in.get(elapsed_ns) && in.get(resolver) && round.stats->merge_encoded(in);
+    has_result = flag != 0;
+    exit_code = static_cast<int64_t>(code);
+    signal = static_cast<int64_t>(sig);
+    core = dumped != 0;
+    round.threads = static_cast<int>(threads);
+    round.io_threads = static_cast<int>(io_threads);
+    round.elapsed = std::chrono::nanoseconds(elapsed_ns);
+    return ok;
+  }
+};
+
+// What a forked child needs to report back; report_fd is -1 in every other
+// process.
+struct ProcRole
+{
+  int report_fd = -1;
+  ProcReport report;
+};
+
+static std::string host_name()
+{
+  char name[256] = {};
+  gethostname(name, sizeof(name) - 1);
+  return name;
+}
+
+// Where the kernel writes a core, for the crash line.
+static std::string core_pattern()
+{
+#ifdef __linux__
+  std::string pattern;
+  if (FILE *f = std::fopen("/proc/sys/kernel/core_pattern", "r"))
+  {
+    char line[256] = {};
+    if (std::fgets(line, sizeof(line), f))
+      pattern = line;
+    std::fclose(f);
+  }
+  while (!pattern.empty() && (pattern.back() == '\n' || pattern.back() == ' '))
+    pattern.pop_back();
+  return pattern;
+#else
+  return "/cores/core.%P";
+#endif
+}
+
+static void print_proc(std::ostream &out, const ProcReport &r)
+{
+  out << "[proc] host=" << r.host << " id=" << r.index << " pid=" << r.pid << " cpus=" << r.cpus
+      << " seed=" << r.seed;
+  if (r.has_result)
+    out << " completed=" << r.round.stats->completed.load() << " failed=" << r.round.stats->failed.load()
+        << " elapsed_s=" << r.round.elapsed.count()
+        << " transfers_per_s=" << r.round.per_second(r.round.stats->completed.load());
+  if (r.signal)
+    out << " crashed signal=" << r.signal << " (" << strsignal(static_cast<int>(r.signal)) << ")"
+        << " core=" << (r.core ? "dumped" : "none") << " core_pattern=" << core_pattern();
+  else if (r.exit_code != 0)
+    out << " failed exit=" << r.exit_code;
+  else if (!r.has_result)
+    out << " lost: exited without a report";
+  out << std::endl;
+}
+
+// --results: the run as results_file.h sections. The file is rewritten after
+// every round with run.status "running" and once more at the end, so a run
+// that crashes leaves a file saying so.
+static void describe_run(ResultsFile &file, const Options &opts, int argc, char **argv)
+{
+  ResultFields &run = file.section("run");
+  run.text("status", "running");
+  if (opts.seed)
+    run.count("seed", *opts.seed);
+  run.text("host", host_name());
+  run.count("started_unix", static_cast<uint64_t>(std::time(nullptr)));
+
+  ResultFields &config = file.section("config");
+  std::string command;
+  for (int i = 0; i < argc; ++i)
+    command += (i ? " " : "") + std::string(argv[i]);
+  config.text("command", command);
+  for (const OptionSpec &spec : OPTION_SPECS)
+    if (const char *value = std::getenv(spec.env); value && *value)
+      config.text(std::string("env.") + spec.env, value);
+  config.count("threads", static_cast<uint64_t>(opts.threads));
+  config.count("per_multi", opts.per_multi);
+  config.count("io_threads", static_cast<uint64_t>(opts.io_threads));
+  config.count("procs", static_cast<uint64_t>(opts.procs));
+  config.count("duration_s", opts.duration ? static_cast<uint64_t>(opts.duration->count()) : 0);
+  config.number("rate", opts.rate);
+
+  const curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  ResultFields &curl = file.section("curl");
+  curl.text("version", info->version);
+  curl.count("version_num", info->version_num);
+  curl.text("host", info->host);
+  curl.text("ssl", info->ssl_version ? info->ssl_version : "");
+  curl.text("libz", info->libz_version ? info->libz_version : "");
+  curl.count("asynchdns", (info->features & CURL_VERSION_ASYNCHDNS) != 0);
+  curl.count("http2", (info->features & CURL_VERSION_HTTP2) != 0);
+  curl.count("http3", (info->features & CURL_VERSION_HTTP3) != 0);
+}
+
+static void add_round(ResultFields &f, const RoundResult &r)
+{
+  const WorkerStats &s = *r.stats;
+  f.count("threads", static_cast<uint64_t>(r.threads));
+  f.count("per_multi", r.per_multi);
+  f.count("io_threads", static_cast<uint64_t>(r.io_threads));
+  f.number("elapsed_s", r.elapsed.count());
+  f.count("completed", s.completed.load());
+  f.count("failed", s.failed.load());
+  f.count("cancelled", s.cancelled.load());
+  f.count("bytes", s.bytes.load());
+  f.number("transfers_per_s", r.per_second(s.completed.load()));
+  f.number("bytes_per_s", r.per_second(s.bytes.load()));
+  auto histogram = [&](const char *name, const LatencyHistogram &h) {
+    std::string key = std::string("latency_us.") + name;
+    f.count(key + ".count", h.count());
+    f.count(key + ".p50", h.percentile(0.50));
+    f.count(key + ".p99", h.percentile(0.99));
+    f.count(key + ".p999", h.percentile(0.999));
+    f.count(key + ".max", h.max());
+  };
+  histogram("dns", s.dns_us);
+  histogram("connect", s.connect_us);
+  histogram("tls", s.tls_us);
+  histogram("total", s.total_us);
+  if (s.scheduled.load())
+  {
+    f.count("open_loop.scheduled", s.scheduled.load());
+    f.count("open_loop.unstarted", s.unstarted.load());
+    histogram("start_lag", s.start_lag_us);
+    histogram("from_intended", s.from_intended_us);
+  }
+  if (r.io_threads > 0)
+  {
+    f.count("handoff.wakeups", s.wakeups.load());
+    f.count("handoff.cancelled", s.handoff_cancelled.load());
+    histogram("submit", s.submit_us);
+    histogram("complete", s.complete_us);
+    histogram("round_trip", s.round_trip_us);
+  }
+  // As curl saw them; the interposer section has its own view
+  f.count("resolve.ok", s.dns_us.count());
+  f.count("resolve.failed",
+          s.results[CURLE_COULDNT_RESOLVE_HOST].load() + s.results[CURLE_COULDNT_RESOLVE_PROXY].load());
+  for (size_t i = 0; i < s.resolver_failures.size(); ++i)
+    if (uint64_t n = s.resolver_failures[i].load())
+      f.count("resolve.eai." + resolver_failure_name(i), n);
+  for (size_t code = 0; code < s.results.size(); ++code)
+    if (uint64_t n = s.results[code].load())
+      f.count("results." + std::to_string(code), n);
+  for (size_t i = 1; i < s.aborts.size(); ++i)
+    f.count(std::string("aborts.") + TRANSFER_PHASE_NAMES[i], s.aborts[i].load());
+  f.count("body.verified", s.body_verified.load());
+  f.count("body.mismatched", s.body_mismatched.load());
+  f.count("body.unverified", s.body_unverified.load());
+  f.count("http.h1", s.http_versions[0].load());
+  f.count("http.h2", s.http_versions[1].load());
+  f.count("http.h3", s.http_versions[2].load());
+  f.count("http.new_connections", s.new_connections.load());
+  f.count("sched.migrations", s.migrations.load());
+  f.count("sched.voluntary_cs", s.voluntary_switches.load());
+  f.count("sched.involuntary_cs", s.involuntary_switches.load());
+  if (s.curl_allocs.load())
+  {
+    f.count("curl_alloc.allocs", s.curl_allocs.load());
+    f.count("curl_alloc.bytes", s.curl_alloc_bytes.load());
+    f.count("curl_alloc.slab_bytes", s.curl_slab_bytes.load());
+  }
+  if (s.flows.load() || s.flows_cancelled.load())
+  {
+    f.count("flows.completed", s.flows.load());
+    f.count("flows.cancelled", s.flows_cancelled.load());
+    f.count("flows.redirects", s.flow_redirects.load());
+    f.count("flows.retries", s.flow_retries.load());
+  }
+  if (uint64_t requests = s.requests.load())
+  {
+    f.count("retry.requests", requests);
+    f.count("retry.attempts", requests + s.retries.load());
+    f.number("retry.amplification", static_cast<double>(requests + s.retries.load()) / requests);
+    f.count("retry.recovered", s.retry_recovered.load());
+    f.count("retry.exhausted", s.retry_exhausted.load());
+    f.count("retry.dropped", s.retry_dropped.load());
+    f.count("retry.breaker.trips", s.breaker_trips.load());
+    f.count("retry.breaker.probes", s.breaker_probes.load());
+    f.count("retry.breaker.rejected", s.breaker_rejected.load());
+    for (size_t i = 1; i < FAILURE_CLASSES; ++i)
+      f.count(std::string("retry.failures.") + FAILURE_CLASS_NAMES[i], s.failure_classes[i].load());
+    f.number("resolve.goodput_per_s", r.per_second(s.dns_us.count()));
+    histogram("request", s.request_us);
+  }
+  f.count("easy_handles.created", s.pool.created);
+  f.count("easy_handles.reused", s.pool.reused);
+}
+
+// Report lines "[tag] word... key=value ..." as "<prefix>tag.word....key"
+static void add_report_lines(ResultFields &f, const std::string &prefix, std::string_view text)
+{
+  while (!text.empty())
+  {
+    size_t eol = text.find('\n');
+    std::string_view line = text.substr(0, eol);
+    text = eol == std::string_view::npos ? std::string_view{} : text.substr(eol + 1);
+    size_t close = line.find(']');
+    if (!line.starts_with('[') || close == std::string_view::npos)
+      continue;
+    std::string name = prefix + std::string(line.substr(1, close - 1));
+    bool named = false; // bare words after the first key=value are commentary
+    for (line.remove_prefix(close + 1); !line.empty();)
+    {
+      size_t space = line.find(' ');
+      std::string_view word = line.substr(0, space);
+      line = space == std::string_view::npos ? std::string_view{} : line.substr(space + 1);
+      size_t eq = word.find('=');
+      if (word.empty() || (eq == std::string_view::npos && named))
+        continue;
+      if (eq == std::string_view::npos)
+      {
+        name += "." + std::string(word);
+        continue;
+      }
+      named = true;
+      std::string key = name + "." + std::string(word.substr(0, eq));
+      std::string_view value = word.substr(eq + 1);
+      uint64_t n = 0;
+      auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), n);
+      if (ec == std::errc{} && end == value.data() + value.size())
+        f.count(key, n);
+      else
+        f.text(key, value);
+    }
+  }
+}
+
+static void add_proc(ResultFields &f, const ProcReport &r)
+{
+  f.text("host", r.host);
+  f.count("id", r.index);
+  f.count("pid", r.pid);
+  f.count("seed", r.seed);
+  f.text("cpus", r.cpus);
+  f.text("status", r.signal ? "crashed" : r.exit_code != 0 ? "failed" : r.has_result ? "ok" : "lost");
+  f.count("signal", static_cast<uint64_t>(r.signal));
+  f.count("core", r.core);
+  if (r.has_result)
+  {
+    f.count("completed", r.round.stats->completed.load());
+    f.count("failed", r.round.stats->failed.load());
+    f.number("elapsed_s", r.round.elapsed.count());
+    f.number("transfers_per_s", r.round.per_second(r.round.stats->completed.load()));
+  }
+  add_report_lines(f, "interposer.", r.resolver);
+}
+
+static bool write_results(const Options &opts, ResultsFile &file, std::string_view status, const char *argv0)
+{
+  if (opts.results_file.empty())
+    return true;
+  file.section("run").text("status", status);
+  std::string error;
+  if (file.write(opts.results_file, error))
+    return true;
+  std::cerr << argv0 << ": " << error << "\n";
+  return false;
+}
+
+// Runs the coordinator of a --procs / --listen run and returns its exit
+// status. In each forked child it instead returns nullopt, with opts turned
+// into that child's share of the run and role set for reporting back.
+static std::optional<int> run_procs(Options &opts, int argc, char **argv, ProcRole &role)
+{
+  const char *argv0 = argv[0];
+  if (!opts.seed)
+    opts.seed = random_seed();
+  std::cout << "[seed] " << *opts.seed << std::endl; // flushed: the children inherit the buffer
+  ResultsFile results;
+  describe_run(results, opts, argc, argv);
+  if (!write_results(opts, results, "running", argv0))
+    return 2;
+  std::string error;
+  int listen_fd = opts.listen.empty() ? -1 : wire_socket(opts.listen, true, error);
+  int upstream = opts.report_to.empty() ? -1 : wire_socket(opts.report_to, false, error);
+  if ((!opts.listen.empty() && listen_fd < 0) || (!opts.report_to.empty() && upstream < 0))
+  {
+    std::cerr << argv0 << ": " << error << "\n";
+    return 2;
+  }
+
+  struct Child
+  {
+    pid_t pid = -1;
+    int fd = -1;
+    WireStream stream;
+    bool reaped = false;
+    ProcReport report;
+  };
+  const std::string host = host_name();
+  const std::vector<int> cpus = CpuTopology::probe().cpus; // node by node: slices stay on one node
+  std::vector<Child> children(static_cast<size_t>(opts.procs));
+  for (size_t i = 0; i < children.size(); ++i)
+  {
+    // Even contiguous slices of the allowed CPUs, one CPU each past that
+    std::span<const int> slice;
+    size_t n = cpus.size(), k = children.size();
+    if (n >= k)
+      slice = std::span(cpus).subspan(i * n / k, (i + 1) * n / k - i * n / k);
+    else if (n > 0)
+      slice = std::span(cpus).subspan(i % n, 1);
+    Child &c = children[i];
+    c.report.host = host;
+    c.report.index = i;
+    c.report.seed = stream_seed(opts, RngStream::proc, i);
+    c.report.cpus = cpu_list(slice);
+    int pair[2];
+    if (cloexec_socketpair(AF_UNIX, SOCK_STREAM, pair) != 0)
+    {
+      std::cerr << argv0 << ": socketpair: " << std::strerror(errno) << "\n";
+      return 2;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(pair[0]);
+      for (size_t j = 0; j < i; ++j)
+        close(children[j].fd);
+      if (listen_fd >= 0)
+        close(listen_fd);
+      if (upstream >= 0)
+        close(upstream);
+      if (!pin_current_thread(slice))
+        std::cerr << argv0 << ": proc " << i << ": cannot pin to cpus " << c.report.cpus << "\n";
+      // Let a crash leave a core as far as the hard limit allows
+      rlimit core{};
+      if (getrlimit(RLIMIT_CORE, &core) == 0)
+      {
+        core.rlim_cur = core.rlim_max;
+        setrlimit(RLIMIT_CORE, &core);
+      }
+      // Reports go to the coordinator; stderr stays for crash output
+      if (int null = open("/dev/null", O_WRONLY); null >= 0)
+      {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+      }
+      opts.seed = c.report.seed;
+      opts.results_file.clear(); // the coordinator writes it
+      opts.rate /= static_cast<double>(children.size()); // --rate is for the whole host
+      opts.rate_end /= static_cast<double>(children.size());
+      role.report_fd = pair[1];
+      role.report = std::move(c.report);
+      role.report.pid = static_cast<uint64_t>(getpid());
+      return std::nullopt;
+    }
+    close(pair[1]);
+    if (pid < 0)
+    {
+      std::cerr << argv0 << ": fork: " << std::strerror(errno) << "\n";
+      close(pair[0]);
+      children.resize(i);
+      break;
+    }
+    c.pid = pid;
+    c.fd = pair[0];
+    c.report.pid = static_cast<uint64_t>(pid);
+  }
+
+  // Every finished process, local or remote, in the order they ended
+  std::vector<ProcReport> reports;
+  auto deliver = [&](ProcReport &&r) {
+    print_proc(std::cout, r);
+    if (upstream >= 0)
+    {
+      WireWriter out;
+      r.encode(out);
+      out.send(upstream, WireKind::proc);
+    }
+    reports.push_back(std::move(r));
+  };
+
+  struct Remote
+  {
+    int fd;
+    WireStream stream;
+  };
+  std::vector<Remote> remotes;
+  int hosts_done = 0, hosts_lost = 0;
+  size_t live = children.size();
+  std::vector<uint64_t> words;
+  while (live > 0 || hosts_done < opts.expect_hosts)
+  {
+    std::vector<pollfd> fds;
+    for (const Child &c : children)
+      if (c.fd >= 0)
+        fds.push_back({c.fd, POLLIN, 0});
+    for (const Remote &r : remotes)
+      fds.push_back({r.fd, POLLIN, 0});
+    if (listen_fd >= 0)
+      fds.push_back({listen_fd, POLLIN, 0});
+    // Short timeout: a child can die before its socket shows it
+    poll(fds.data(), fds.size(), 200);
+
+    auto readable = [&](int fd) {
+      for (const pollfd &p : fds)
+        if (p.fd == fd)
+          return (p.revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+      return false;
+    };
+    WireKind kind;
+    for (Child &c : children)
+    {
+      if (c.fd < 0 || !readable(c.fd))
+        continue;
+      bool open = c.stream.fill(c.fd);
+      while (c.stream.next(kind, words))
+      {
+        ProcReport sent;
+        if (kind == WireKind::proc && sent.decode(words))
+        {
+          c.report.has_result = true;
+          c.report.round = std::move(sent.round);
+          c.report.resolver = std::move(sent.resolver);
+        }
+      }
+      if (!open || c.stream.broken())
+      {
+        close(c.fd);
+        c.fd = -1;
+      }
+    }
+    for (auto r = remotes.begin(); r != remotes.end();)
+    {
+      bool open = !readable(r->fd) || r->stream.fill(r->fd);
+      bool ended = false;
+      while (!ended && r->stream.next(kind, words))
+      {
+        ProcReport sent;
+        if (kind == WireKind::end)
+          ended = true;
+        else if (kind == WireKind::proc && sent.decode(words))
+          deliver(std::move(sent));
+      }
+      if (open && !ended && !r->stream.broken())
+      {
+        ++r;
+        continue;
+      }
+      if (!ended)
+      {
+        ++hosts_lost;
+        std::cout << "[proc] remote report connection lost" << std::endl;
+      }
+      ++hosts_done;
+      close(r->fd);
+      r = remotes.erase(r);
+    }
+    if (listen_fd >= 0 && readable(listen_fd))
+      if (int fd = cloexec_accept(listen_fd); fd >= 0)
+        remotes.push_back({fd, {}});
+
+    for (Child &c : children)
+    {
+      int status = 0;
+      if (!c.reaped && waitpid(c.pid, &status, WNOHANG) == c.pid)
+      {
+        c.reaped = true;
+        c.report.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        c.report.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+        c.report.core = WIFSIGNALED(status) && WCOREDUMP(status);
+      }
+      if (c.reaped && c.fd < 0 && c.pid >= 0)
+      {
+        deliver(std::move(c.report));
+        c.pid = -1;
+        --live;
+      }
+    }
+  }
+  if (listen_fd >= 0)
+    close(listen_fd);
+  if (upstream >= 0)
+  {
+    WireWriter{}.send(upstream, WireKind::end);
+    close(upstream);
+  }
+
+  // The processes ran side by side: throughput over the longest of them
+  RoundResult total;
+  size_t crashed = 0, reported = 0;
+  for (const ProcReport &r : reports)
+  {
+    crashed += r.crashed();
+    if (!r.has_result)
+      continue;
+    ++reported;
+    total.threads += r.round.threads;
+    total.io_threads += r.round.io_threads;
+    total.per_multi = r.round.per_multi;
+    total.elapsed = std::max(total.elapsed, r.round.elapsed);
+    total.stats->merge(*r.round.stats);
+  }
+  std::cout << "[procs] processes=" << reports.size() << " reported=" << reported << " crashed=" << crashed
+            << " hosts=" << hosts_done - hosts_lost << " lost_hosts=" << hosts_lost << "\n";
+  if (reported)
+    print_report(std::cout, total);
+  for (const ProcReport &r : reports)
+  {
+    std::string_view text = r.resolver;
+    while (!text.empty())
+    {
+      size_t eol = text.find('\n');
+      std::cout << "[proc " << r.host << "/" << r.index << "] " << text.substr(0, eol) << "\n";
+      text = eol == std::string_view::npos ? std::string_view{} : text.substr(eol + 1);
+    }
+  }
+  std::cout.flush();
+  if (reported)
+    add_round(results.append("rounds"), total);
+  for (const ProcReport &r : reports)
+    add_proc(results.append("procs"), r);
+  ResultFields &run = results.section("run");
+  run.count("processes", reports.size());
+  run.count("crashed", crashed);
+  run.count("lost_hosts", static_cast<uint64_t>(hosts_lost));
+  if (!write_results(opts, results, crashed || hosts_lost ? "crashed" : "ok", argv0))
+    return 1;
+  return crashed || hosts_lost ? 1 : 0;
+}
+
+// A child's results, sent once before it exits.
+static void report_to_coordinator(ProcRole &role, RoundResult &&round)
+{
+  role.report.has_result = true;
+  role.report.exit_code = 0;
+  role.report.round = std::move(round);
+  role.report.resolver = resolver_report();
+  WireWriter out;
+  role.report.encode(out);
+  out.send(role.report_fd, WireKind::proc);
+  close(role.report_fd);
+  role.report_fd = -1;
+}
+
+// --teardown, in a trial's child: fill every worker's multi, keep it full
+// for the settle time, then shut down the way the stress run does and time
+// each step. Completed transfers are replaced while settling, so teardown
+// meets the full count in flight.
+static TeardownSample teardown_trial(const Options &opts, const UrlCorpus &corpus, TeardownCleanup cleanup)
+{
+  using clock = std::chrono::steady_clock;
+  CurlAllocator::init(opts.alloc, CURL_GLOBAL_DEFAULT);
+  struct Worker
+  {
+    CURLM *multi = nullptr;
+    std::unique_ptr<EasyPool> pool;
+    std::unique_ptr<BodyRing> ring;
+    TransferTable transfers;
+    uint32_t resolving = 0;
+    clock::time_point removed{}, cleaned{};
+  };
+  const auto threads = static_cast<size_t>(opts.threads);
+  const size_t inflight = opts.teardown.inflight();
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (size_t i = 0; i < threads; ++i)
+    workers.push_back(std::make_unique<Worker>());
+
+  // Every handle removed and cleaned up, then the multi
+  auto remove_all = [](Worker &w) {
+    while (!w.transfers.empty())
+      finish_easy(w.multi, *w.pool, w.transfers, w.transfers[w.transfers.size() - 1]);
+    w.pool.reset();
+    w.removed = clock::now();
+  };
+  auto cleanup_multi = [](Worker &w) {
+    curl_multi_cleanup(w.multi);
+    w.cleaned = clock::now();
+  };
+
+  std::latch ready(static_cast<std::ptrdiff_t>(threads));
+  std::atomic<bool> go{false};
+  std::vector<std::thread> running;
+  for (size_t i = 0; i < threads; ++i)
+    running.emplace_back([&, i] {
+      Worker &w = *workers[i];
+      size_t count = inflight / threads + (i < inflight % threads);
+      w.multi = make_multi(opts);
+      w.pool = std::make_unique<EasyPool>(opts, nullptr);
+      if (opts.body == BodyMode::ring)
+        w.ring = std::make_unique<BodyRing>(opts.body_ring_mb << 20);
+      Xoshiro256ss url_rng{stream_seed(opts, RngStream::urls, i)};
+      PollDriver driver(w.multi);
+      for (auto until = clock::now() + opts.teardown.settle();;)
+      {
+        while (w.transfers.size() < count)
+          add_easy(w.multi, *w.pool, w.transfers, w.ring.get(), corpus.pick(url_rng).url);
+        // The last refill is driven too: a handle never performed has no
+        // name lookup time yet without having started its resolve
+        bool last = clock::now() >= until;
+        driver.drive(last ? std::chrono::milliseconds(0) : std::chrono::milliseconds(10));
+        if (last)
+          break;
+        int msgs_left = 0;
+        while (CURLMsg *msg = curl_multi_info_read(w.multi, &msgs_left))
+          if (msg->msg == CURLMSG_DONE)
+            finish_easy(w.multi, *w.pool, w.transfers, TransferTable::of(msg->easy_handle));
+      }
+      for (size_t j = 0; j < w.transfers.size(); ++j)
+      {
+        curl_off_t namelookup = 0;
+        curl_easy_getinfo(w.transfers[j].easy, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+        w.resolving += namelookup == 0;
+      }
+      ready.count_down();
+      go.wait(false);
+      if (cleanup == TeardownCleanup::parallel)
+      {
+        remove_all(w);
+        cleanup_multi(w);
+      }
+    });
+  ready.wait();
+
+  TeardownSample sample;
+  for (const auto &w : workers)
+  {
+    sample.handles += static_cast<uint32_t>(w->transfers.size());
+    sample.resolving += w->resolving;
+  }
+  int busy = count_threads();
+  sample.threads_busy = busy < 0 ? -1 : busy - 1 - helper_threads() - static_cast<int>(threads);
+  const clock::time_point start = clock::now();
+  sample.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+  if (cleanup == TeardownCleanup::serial)
+  {
+    for (const auto &w : workers)
+      remove_all(*w);
+    for (const auto &w : workers)
+      cleanup_multi(*w);
+  }
+  go.store(true);
+  go.notify_all();
+  for (std::thread &t : running)
+    t.join();
+  auto since = [&](clock::time_point t) { return static_cast<uint64_t>(micros(t - start)); };
+  sample.joined_us = since(clock::now());
+  for (const auto &w : workers)
+  {
+    sample.removed_us = std::max(sample.removed_us, since(w->removed));
+    sample.multi_us = std::max(sample.multi_us, since(w->cleaned));
+  }
+  curl_global_cleanup();
+  sample.global_us = since(clock::now());
+  int left = count_threads();
+  sample.threads_left = left < 0 ? -1 : left - 1 - helper_threads();
+  return sample;
+}
+
+// Runs the --teardown benchmark and returns the exit status: 0, or 1 if a
+// trial crashed or did not report. Each trial is a forked child, started
+// before libcurl or any thread exists here, so every shutdown begins from a
+// fresh curl_global_init and abandoned resolver threads die with their trial.
+static int run_teardown(const Options &opts, int argc, char **argv)
+{
+  using clock = std::chrono::steady_clock;
+  const char *argv0 = argv[0];
+  UrlCorpus corpus;
+  std::string error;
+  if (!build_corpus(opts, corpus, error))
+  {
+    std::cerr << argv0 << ": " << error << "\n";
+    return 2;
+  }
+  const TeardownPlan &plan = opts.teardown;
+  std::cout << "[teardown] inflight=" << plan.inflight() << " threads=" << opts.threads
+            << " settle_ms=" << plan.settle().count() << " trials=" << plan.trials() << std::endl;
+  ResultsFile results;
+  describe_run(results, opts, argc, argv);
+  if (!write_results(opts, results, "running", argv0))
+    return 2;
+
+  int failures = 0;
+  for (TeardownPlan::Variant v : plan.variants())
+  {
+    const char *quick = v.quick_exit ? "on" : "off";
+    const char *cleanup = TEARDOWN_CLEANUP_NAMES[static_cast<size_t>(v.cleanup)];
+    std::vector<uint64_t> exits;
+    int threads_left = 0, crashed = 0;
+    for (uint32_t trial = 0; trial < plan.trials(); ++trial)
+    {
+      int pair[2];
+      if (cloexec_socketpair(AF_UNIX, SOCK_STREAM, pair) != 0)
+      {
+        std::cerr << argv0 << ": socketpair: " << std::strerror(errno) << "\n";
+        return 2;
+      }
+      std::cout.flush(); // the child inherits the buffer
+      pid_t pid = fork();
+      if (pid == 0)
+      {
+        close(pair[0]);
+        Options trial_opts = opts;
+        trial_opts.quick_exit = v.quick_exit;
+        TeardownSample sample = teardown_trial(trial_opts, corpus, v.cleanup);
+        bool sent = write(pair[1], &sample, sizeof(sample)) == static_cast<ssize_t>(sizeof(sample));
+        std::exit(sent ? 0 : 1); // static destructors and atexit handlers run, as in a real exit
+      }
+      close(pair[1]);
+      if (pid < 0)
+      {
+        std::cerr << argv0 << ": fork: " << std::strerror(errno) << "\n";
+        close(pair[0]);
+        return 2;
+      }
+      TeardownSample sample;
+      size_t got = 0;
+      for (ssize_t n; got < sizeof(sample) &&
+                      (n = read(pair[0], reinterpret_cast<char *>(&sample) + got, sizeof(sample) - got)) != 0;)
+        if (n > 0)
+          got += static_cast<size_t>(n);
+        else if (errno != EINTR)
+          break;
+      close(pair[0]);
+      int status = 0;
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      {
+      }
+      const bool reported = got == sizeof(sample);
+      const bool ok = reported && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      uint64_t exit_us = 0; // the shared steady clock, from the child's start of teardown
+      if (reported)
+        exit_us = static_cast<uint64_t>(
+            micros(clock::now().time_since_epoch() - std::chrono::nanoseconds(sample.start_ns)));
+
+      ResultFields &f = results.append("teardown");
+      f.text("quick_exit", quick);
+      f.text("cleanup", cleanup);
+      f.count("trial", trial);
+      f.text("status", ok ? "ok" : WIFSIGNALED(status) ? "crashed" : "failed");
+      f.count("signal", WIFSIGNALED(status) ? static_cast<uint64_t>(WTERMSIG(status)) : 0);
+      std::cout << "[teardown] quick_exit=" << quick << " cleanup=" << cleanup << " trial=" << trial;
+      if (reported)
+      {
+        exits.push_back(exit_us);
+        threads_left = std::max(threads_left, sample.threads_left);
+        std::cout << " handles=" << sample.handles << " resolving=" << sample.resolving
+                  << " resolver_threads=" << sample.threads_busy << " removed_ms=" << sample.removed_us / 1000.0
+                  << " multi_cleanup_ms=" << sample.multi_us / 1000.0 << " joined_ms=" << sample.joined_us / 1000.0
+                  << " global_cleanup_ms=" << sample.global_us / 1000.0 << " exit_ms=" << exit_us / 1000.0
+                  << " threads_left=" << sample.threads_left;
+        f.count("handles", sample.handles);
+        f.count("resolving", sample.resolving);
+        f.number("resolver_threads", sample.threads_busy);
+        f.count("removed_us", sample.removed_us);
+        f.count("multi_cleanup_us", sample.multi_us);
+        f.count("joined_us", sample.joined_us);
+        f.count("global_cleanup_us", sample.global_us);
+        f.count("exit_us", exit_us);
+        f.number("threads_left", sample.threads_left);
+      }
+      if (ok)
+        std::cout << " status=ok\n";
+      else if (WIFSIGNALED(status))
+        std::cout << " status=crashed signal=" << WTERMSIG(status) << " (" << strsignal(WTERMSIG(status)) << ")\n";
+      else
+        std::cout << " status=failed exit=" << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << "\n";
+      crashed += !ok;
+    }
+    std::sort(exits.begin(), exits.end());
+    std::cout << "[teardown] summary quick_exit=" << quick << " cleanup=" << cleanup << " trials=" << plan.trials()
+              << " failed=" << crashed;
+    if (!exits.empty())
+      std::cout << " exit_ms_p50=" << exits[exits.size() / 2] / 1000.0 << " exit_ms_max=" << exits.back() / 1000.0
+                << " threads_left_max=" << threads_left;
+    std::cout << "\n";
+    failures += crashed;
+  }
+  bool saved = write_results(opts, results, failures ? "crashed" : "ok", argv0);
+  return failures || !saved ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  Options opts = parse_options(argc, argv);
+  if (opts.teardown.enabled())
+    return run_teardown(opts, argc, argv);
+  // Fork before libcurl or any thread exists: each child inits its own
+  ProcRole role;
+  if (opts.procs > 0 || !opts.listen.empty())
+    if (std::optional<int> status = run_procs(opts, argc, argv, role))
+      return *status;
+  CurlAllocator::init(opts.alloc, CURL_GLOBAL_DEFAULT);
+
+  std::vector<std::vector<TraceRecord>> replay;
+  uint64_t replay_corpus_size = 0;
+  if (!opts.replay_file.empty())
+  {
+    TraceHeader header;
+    std::vector<TraceRecord> records;
+    std::string error;
+    if (!load_trace(opts.replay_file, header, records, error))
+    {
+      std::cerr << argv[0] << ": " << error << "\n";
+      return 2;
+    }
+    // The recording's thread count, so every thread has its events; its seed unless --seed is given
+    opts.threads = static_cast<int>(header.threads);
+    if (!opts.seed)
+      opts.seed = header.seed;
+    replay.resize(header.threads);
+    for (const TraceRecord &r : records)
+      if (r.thread < replay.size())
+        replay[r.thread].push_back(r);
+    resolver_script(records);
+    replay_corpus_size = header.corpus_size;
+  }
+
+  UrlCorpus corpus;
+  std::string corpus_error;
+  if (!build_corpus(opts, corpus, corpus_error))
+  {
+    std::cerr << argv[0] << ": " << corpus_error << "\n";
+    return 2;
+  }
+  // Logging URL count for verification
+  log("Using ", corpus.size(), " URLs for stress testing");
+  std::cout << "[corpus] urls=" << corpus.size();
+  for (const UrlCorpus::Category &c : corpus.categories())
+    std::cout << " " << c.name << "=" << c.urls.size() << "/w" << c.weight;
+  std::cout << "\n";
+
+  if (!opts.replay_file.empty() && replay_corpus_size != corpus.size())
+  {
+    std::cerr << argv[0] << ": " << opts.replay_file << " was recorded with " << replay_corpus_size
+              << " URLs, this corpus has " << corpus.size() << "\n";
+    return 2;
+  }
+  // A trace is only replayable under a known seed, so draw one if needed
+  if (!opts.trace_file.empty() && !opts.seed)
+    opts.seed = random_seed();
+  if (opts.seed)
+  {
+    std::cout << "[seed] " << *opts.seed << "\n";
+    resolver_seed(stream_seed(opts, RngStream::resolver, 0));
+  }
+  std::unique_ptr<TraceWriter> trace;
+  if (!opts.trace_file.empty())
+  {
+    if (corpus.categories().size() > TRACE_MAX_CATEGORIES)
+    {
+      std::cerr << argv[0] << ": --trace records at most " << TRACE_MAX_CATEGORIES
+                << " URL categories, this corpus has " << corpus.categories().size() << "\n";
+      return 2;
+    }
+    TraceHeader header;
+    header.threads = static_cast<uint32_t>(opts.threads);
+    header.seed = *opts.seed;
+    header.corpus_size = corpus.size();
+    std::string error;
+    trace = TraceWriter::create(opts.trace_file, header, error);
+    if (!trace)
+    {
+      std::cerr << argv[0] << ": " << error << "\n";
+      return 2;
+    }
+    event_trace = trace.get();
+    resolver_observe(trace.get());
+  }
+  ResultsFile results;
+  describe_run(results, opts, argc, argv);
+  if (!write_results(opts, results, "running", argv[0]))
+    return 2;
+  std::unique_ptr<LiveMonitor> live;
+  if (!opts.live.empty())
+  {
+    live = std::make_unique<LiveMonitor>();
+    std::string error;
+    if (!live->open(opts.live, error))
+    {
+      std::cerr << argv[0] << ": --live: " << error << "\n";
+      return 2;
+    }
+    live->start();
+    live_monitor = live.get();
+  }
+
+  if (opts.sweep.empty())
+  {
+    // The open-loop schedule (and a ramp's slope) needs a common run length
+    Options round_opts = opts;
+    if (opts.load != LoadMode::closed && !round_opts.duration)
+      round_opts.duration = std::chrono::seconds(10);
+    RoundResult r = run_round(round_opts, corpus, opts.threads, opts.per_multi, replay);
+    print_report(std::cout, r);
+    add_round(results.append("rounds"), r);
+    if (role.report_fd >= 0)
+      report_to_coordinator(role, std::move(r));
+  }
+  else
+  {
+    // Sweep rounds need a common run length to compare throughput
+    Options round_opts = opts;
+    if (!round_opts.duration)
+      round_opts.duration = std::chrono::seconds(10);
+    for (size_t level : opts.sweep)
+    {
+      int num_threads = opts.sweep_axis == SweepAxis::threads ? static_cast<int>(level) : opts.threads;
+      size_t per_multi = opts.sweep_axis == SweepAxis::per_multi ? level : opts.per_multi;
+      RoundResult r = run_round(round_opts, corpus, num_threads, per_multi);
+      std::cout << "[sweep] threads=" << num_threads << " per_multi=" << per_multi
+                << " completed=" << r.stats->completed.load() << " elapsed_s=" << r.elapsed.count()
+                << " transfers_per_s=" << r.per_second(r.stats->completed.load())
+                << " handle_setup_us=" << r.stats->pool.setup.count() / 1000
+                << " handle_teardown_us=" << r.stats->pool.teardown.count() / 1000 << "\n";
+      print_report(std::cout, r);
+      add_round(results.append("rounds"), r);
+      write_results(opts, results, "running", argv[0]);
+    }
+  }
+
+  if (trace)
+  {
+    resolver_observe(nullptr);
+    event_trace = nullptr;
+    trace->close();
+    std::cout << "[trace] " << opts.trace_file << " records=" << trace->records() << "\n";
+  }
+  if (live)
+  {
+    live_monitor = nullptr;
+    live->stop();
+  }
+  std::string resolver = resolver_report();
+  std::cout << resolver;
+  add_report_lines(results.section("interposer"), "", resolver);
+  bool saved = write_results(opts, results, "ok", argv[0]);
   curl_global_cleanup();
   log("Finished stress run.");
-  return 0;
+  return saved ? 0 : 1;
 }
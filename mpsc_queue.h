@@ -0,0 +1,65 @@
+// mpsc_queue.h - intrusive multi-producer single-consumer queue (Vyukov).
+// push() is one atomic exchange and never blocks, fails or allocates: nodes
+// carry their own link. pop() belongs to a single consumer thread. A push
+// that has swapped the head but not yet linked its node makes pop() report
+// empty for that instant, so producers signal the consumer after pushing
+// (curl_multi_wakeup, an atomic notify) rather than before.
+
+#pragma once
+
+#include <atomic>
+
+// Node needs a default constructor (for the stub) and a member
+// std::atomic<Node *> next that the queue owns while the node is queued.
+template <typename Node>
+class MpscQueue
+{
+public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  void push(Node *node)
+  {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Oldest node, or nullptr when empty (or a push is half-way through).
+  Node *pop()
+  {
+    Node *tail = tail_;
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_)
+    {
+      if (!next)
+        return nullptr;
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire))
+      return nullptr;
+    // tail is the last node: requeue the stub behind it so it can be handed out
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+private:
+  alignas(64) std::atomic<Node *> head_; // producers
+  alignas(64) Node *tail_;               // consumer
+  Node stub_;
+};
@@ -0,0 +1,1081 @@
+// origin_server.cpp - loopback HTTP/HTTPS origin for deterministic stress runs.
+//
+// Every path is accepted; the response is shaped by query parameters so
+// any mix can be composed from one URL:
+//   size=N       body length in bytes (default 1024)
+//   status=CODE  response status (default 200)
+//   delay=MS     wait before responding, without blocking the event loop
+//   chunked=1    send the body with Transfer-Encoding: chunked
+//   redirect=K   302 to the same URL with redirect=K-1, until K reaches 0
+// e.g. https://127.0.0.1:8443/blob?size=1048576&delay=50&chunked=1
+//
+// Each thread runs its own epoll/kqueue loop over the shared listen sockets.
+// Bodies are generated on the fly from a fixed pattern, so multi-GB
+// responses cost no memory. Every response advertises the CRC32C of its
+// body in X-Body-CRC32C (hex) so clients can verify what they received.
+// TLS (OpenSSL) uses a self-signed certificate
+// generated at start-up and written to --cert-out for curl's CAINFO.
+// With nghttp2, HTTP/2 is offered through ALPN on the TLS port and accepted
+// with prior knowledge (h2c) on the plain port; streams on one connection
+// are delayed and answered independently. chunked=1 drops content-length.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifdef ORIGIN_WITH_TLS
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+#ifdef ORIGIN_WITH_NGHTTP2
+#include <nghttp2/nghttp2.h>
+#endif
+
+#include "crc32c.h"
+#include "event_poller.h"
+
+namespace
+{
+
+constexpr size_t PATTERN_BYTES = 64 * 1024;
+constexpr size_t CHUNK_BYTES = 16 * 1024;
+constexpr size_t READ_LIMIT = 16 * 1024; // max request head size
+constexpr std::string_view H2_PREFACE_LINE = "PRI * HTTP/2.0\r\n";
+
+// Body byte at offset i is PATTERN[i % PATTERN_BYTES].
+const std::array<char, PATTERN_BYTES> &pattern()
+{
+  static const std::array<char, PATTERN_BYTES> bytes = [] {
+    std::array<char, PATTERN_BYTES> p{};
+    uint32_t x = 2463534242u;
+    for (char &c : p)
+    {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      c = static_cast<char>(x & 0xff);
+    }
+    return p;
+  }();
+  return bytes;
+}
+
+std::string_view reason_phrase(int status)
+{
+  switch (status)
+  {
+  case 200: return "OK";
+  case 204: return "No Content";
+  case 301: return "Moved Permanently";
+  case 302: return "Found";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 429: return "Too Many Requests";
+  case 500: return "Internal Server Error";
+  case 502: return "Bad Gateway";
+  case 503: return "Service Unavailable";
+  default: return "Status";
+  }
+}
+
+struct Request
+{
+  std::string_view path;  // without query
+  std::string_view query; // without '?'
+  bool keep_alive = true;
+};
+
+struct ResponseSpec
+{
+  uint64_t size = 1024;
+  int status = 200;
+  uint64_t delay_ms = 0;
+  bool chunked = false;
+  unsigned redirect = 0;
+};
+
+template <typename T>
+void parse_param(std::string_view value, T &out)
+{
+  T parsed{};
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+  if (ec == std::errc{})
+    out = parsed;
+}
+
+ResponseSpec parse_spec(std::string_view query)
+{
+  ResponseSpec spec;
+  while (!query.empty())
+  {
+    size_t amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+    size_t eq = pair.find('=');
+    if (eq == std::string_view::npos)
+      continue;
+    std::string_view key = pair.substr(0, eq), value = pair.substr(eq + 1);
+    if (key == "size")
+      parse_param(value, spec.size);
+    else if (key == "status")
+      parse_param(value, spec.status);
+    else if (key == "delay")
+      parse_param(value, spec.delay_ms);
+    else if (key == "chunked")
+      spec.chunked = value == "1";
+    else if (key == "redirect")
+      parse_param(value, spec.redirect);
+  }
+  return spec;
+}
+
+// Same query with redirect=K replaced by redirect=K-1.
+std::string next_redirect(const Request &req, unsigned remaining)
+{
+  std::string location(req.path);
+  location += '?';
+  std::string_view query = req.query;
+  bool first = true;
+  while (!query.empty())
+  {
+    size_t amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+    if (!first)
+      location += '&';
+    first = false;
+    if (pair.starts_with("redirect="))
+      location += "redirect=" + std::to_string(remaining - 1);
+    else
+      location += pair;
+  }
+  return location;
+}
+
+bool iequals(std::string_view a, std::string_view b)
+{
+  auto lower = [](char c) { return std::tolower(static_cast<unsigned char>(c)); };
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [&](char x, char y) { return lower(x) == lower(y); });
+}
+
+// Parse the request head; returns false on malformed input.
+bool parse_request(std::string_view head, Request &req)
+{
+  size_t eol = head.find("\r\n");
+  std::string_view line = head.substr(0, eol);
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.rfind(' ');
+  if (sp1 == std::string_view::npos || sp2 <= sp1)
+    return false;
+  std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  std::string_view version = line.substr(sp2 + 1);
+  size_t q = target.find('?');
+  req.path = target.substr(0, q);
+  req.query = q == std::string_view::npos ? std::string_view{} : target.substr(q + 1);
+  req.keep_alive = version == "HTTP/1.1";
+
+  std::string_view rest = eol == std::string_view::npos ? std::string_view{} : head.substr(eol + 2);
+  while (!rest.empty())
+  {
+    eol = rest.find("\r\n");
+    std::string_view header = rest.substr(0, eol);
+    rest = eol == std::string_view::npos ? std::string_view{} : rest.substr(eol + 2);
+    size_t colon = header.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+    std::string_view name = header.substr(0, colon);
+    std::string_view value = header.substr(colon + 1);
+    while (!value.empty() && value.front() == ' ')
+      value.remove_prefix(1);
+    if (iequals(name, "Connection"))
+      req.keep_alive = iequals(value, "keep-alive") || (req.keep_alive && !iequals(value, "close"));
+  }
+  return true;
+}
+
+#ifdef ORIGIN_WITH_TLS
+#ifdef ORIGIN_WITH_NGHTTP2
+// Prefer h2, fall back to http/1.1; clients without ALPN get http/1.1.
+int select_alpn(SSL *, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen,
+                void *)
+{
+  static const unsigned char protos[] = "\x02h2\x08http/1.1";
+  if (SSL_select_next_proto(const_cast<unsigned char **>(out), outlen, protos, sizeof(protos) - 1, in, inlen) !=
+      OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_NOACK;
+  return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
+// Self-signed P-256 certificate valid for localhost, 127.0.0.1 and ::1.
+SSL_CTX *make_tls_context(const std::string &cert_out, [[maybe_unused]] bool h2)
+{
+  EVP_PKEY *pkey = nullptr;
+  EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  if (!pctx || EVP_PKEY_keygen_init(pctx) <= 0 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(pctx, &pkey) <= 0)
+  {
+    EVP_PKEY_CTX_free(pctx);
+    return nullptr;
+  }
+  EVP_PKEY_CTX_free(pctx);
+
+  X509 *cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), static_cast<long>(std::time(nullptr)));
+  X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 30L * 24 * 3600);
+  X509_set_pubkey(cert, pkey);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+
+  X509V3_CTX v3;
+  X509V3_set_ctx_nodb(&v3);
+  X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+  for (auto [nid, value] : {std::pair{NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1,IP:::1"},
+                            std::pair{NID_basic_constraints, "critical,CA:TRUE"}})
+  {
+    if (X509_EXTENSION *ext = X509V3_EXT_conf_nid(nullptr, &v3, nid, value))
+    {
+      X509_add_ext(cert, ext, -1);
+      X509_EXTENSION_free(ext);
+    }
+  }
+  X509_sign(cert, pkey, EVP_sha256());
+
+  if (FILE *f = std::fopen(cert_out.c_str(), "w"))
+  {
+    PEM_write_X509(f, cert);
+    std::fclose(f);
+  }
+  else
+  {
+    std::cerr << "origin: cannot write certificate to " << cert_out << "\n";
+  }
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  SSL_CTX_use_certificate(ctx, cert);
+  SSL_CTX_use_PrivateKey(ctx, pkey);
+#ifdef ORIGIN_WITH_NGHTTP2
+  if (h2)
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, nullptr);
+#endif
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+  return ctx;
+}
+#else
+using SSL_CTX = void;
+#endif
+
+#ifdef ORIGIN_WITH_NGHTTP2
+class OriginWorker;
+
+// One HTTP/2 request; the body is produced straight from the pattern.
+struct H2Stream
+{
+  std::string path; // :path, query included
+  ResponseSpec spec;
+  std::string location;
+  uint64_t body_left = 0;
+  uint64_t body_offset = 0;
+};
+#endif
+
+struct Connection
+{
+  enum class State
+  {
+    handshake,
+    reading,
+    delaying,
+    writing,
+    h2, // nghttp2 owns framing from here on
+  };
+
+  int fd = -1;
+  uint64_t generation = 0; // guards stale timers after fd reuse
+  State state = State::reading;
+#ifdef ORIGIN_WITH_TLS
+  SSL *ssl = nullptr;
+#endif
+  unsigned want = EventPoller::READABLE; // what the last blocked call waits for
+  std::string in;
+  std::string out;
+  size_t out_off = 0;
+  uint64_t body_left = 0;
+  uint64_t body_offset = 0;
+  bool chunked = false;
+  bool keep_alive = true;
+  std::string pending_head; // response head held back during a delay
+#ifdef ORIGIN_WITH_NGHTTP2
+  OriginWorker *owner = nullptr;
+  nghttp2_session *h2 = nullptr;
+  std::unordered_map<int32_t, H2Stream> streams; // references stay valid across inserts
+#endif
+};
+
+class OriginWorker
+{
+public:
+  OriginWorker(std::vector<std::pair<int, bool>> listeners, SSL_CTX *tls, unsigned h2_streams)
+      : listeners_(std::move(listeners)), tls_(tls), h2_streams_(h2_streams)
+  {
+    for (auto [fd, is_tls] : listeners_)
+      poller_.set(fd, EventPoller::READABLE);
+  }
+
+  void run()
+  {
+    std::array<EventPoller::Event, 256> events;
+    for (;;)
+    {
+      int n = poller_.wait(events, next_timeout_ms());
+      for (int i = 0; i < n; ++i)
+        on_event(events[i].fd);
+      fire_timers();
+    }
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+  struct Timer
+  {
+    Clock::time_point at;
+    int fd;
+    uint64_t generation;
+    int32_t stream = 0; // HTTP/2 stream to answer, 0 for HTTP/1.1
+    bool operator>(const Timer &o) const { return at > o.at; }
+  };
+
+  void on_event(int fd)
+  {
+    for (auto [lfd, is_tls] : listeners_)
+    {
+      if (lfd == fd)
+        return accept_all(lfd, is_tls);
+    }
+    if (static_cast<size_t>(fd) < conns_.size() && conns_[fd])
+      advance(*conns_[fd]);
+  }
+
+  void accept_all(int lfd, [[maybe_unused]] bool is_tls)
+  {
+    for (;;)
+    {
+      int fd = accept(lfd, nullptr, nullptr);
+      if (fd < 0)
+        return; // EAGAIN, or another worker won the race
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (static_cast<size_t>(fd) >= conns_.size())
+        conns_.resize(static_cast<size_t>(fd) + 1);
+      auto conn = std::make_unique<Connection>();
+      conn->fd = fd;
+      conn->generation = ++generation_;
+#ifdef ORIGIN_WITH_TLS
+      if (is_tls && tls_)
+      {
+        conn->ssl = SSL_new(static_cast<SSL_CTX *>(tls_));
+        SSL_set_fd(conn->ssl, fd);
+        SSL_set_accept_state(conn->ssl);
+        conn->state = Connection::State::handshake;
+      }
+#endif
+      conns_[fd] = std::move(conn);
+      advance(*conns_[fd]);
+    }
+  }
+
+  void close_conn(Connection &c)
+  {
+    int fd = c.fd;
+    poller_.remove(fd);
+#ifdef ORIGIN_WITH_NGHTTP2
+    if (c.h2)
+      nghttp2_session_del(c.h2);
+#endif
+#ifdef ORIGIN_WITH_TLS
+    if (c.ssl)
+    {
+      SSL_shutdown(c.ssl);
+      SSL_free(c.ssl);
+    }
+#endif
+    close(fd);
+    conns_[fd].reset();
+  }
+
+  // >0 bytes, 0 peer closed/error, -1 would block (c.want updated)
+  ssize_t io_read(Connection &c, char *buf, size_t len)
+  {
+#ifdef ORIGIN_WITH_TLS
+    if (c.ssl)
+    {
+      int n = SSL_read(c.ssl, buf, static_cast<int>(len));
+      return n > 0 ? n : tls_blocked(c, n);
+    }
+#endif
+    ssize_t n = recv(c.fd, buf, len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+      c.want = EventPoller::READABLE;
+      return -1;
+    }
+    return n < 0 ? 0 : n;
+  }
+
+  ssize_t io_write(Connection &c, const char *buf, size_t len)
+  {
+#ifdef ORIGIN_WITH_TLS
+    if (c.ssl)
+    {
+      int n = SSL_write(c.ssl, buf, static_cast<int>(len));
+      return n > 0 ? n : tls_blocked(c, n);
+    }
+#endif
+#ifdef MSG_NOSIGNAL
+    ssize_t n = send(c.fd, buf, len, MSG_NOSIGNAL);
+#else
+    ssize_t n = send(c.fd, buf, len, 0);
+#endif
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+      c.want = EventPoller::WRITABLE;
+      return -1;
+    }
+    return n < 0 ? 0 : n;
+  }
+
+#ifdef ORIGIN_WITH_TLS
+  ssize_t tls_blocked(Connection &c, int ret)
+  {
+    switch (SSL_get_error(c.ssl, ret))
+    {
+    case SSL_ERROR_WANT_READ:
+      c.want = EventPoller::READABLE;
+      return -1;
+    case SSL_ERROR_WANT_WRITE:
+      c.want = EventPoller::WRITABLE;
+      return -1;
+    default:
+      ERR_clear_error();
+      return 0;
+    }
+  }
+#endif
+
+  // Run the connection's state machine until it would block.
+  void advance(Connection &c)
+  {
+    for (;;)
+    {
+      switch (c.state)
+      {
+      case Connection::State::handshake:
+      {
+#ifdef ORIGIN_WITH_TLS
+        int r = SSL_do_handshake(c.ssl);
+        if (r == 1)
+        {
+          c.state = Connection::State::reading;
+#ifdef ORIGIN_WITH_NGHTTP2
+          const unsigned char *proto = nullptr;
+          unsigned int proto_len = 0;
+          SSL_get0_alpn_selected(c.ssl, &proto, &proto_len);
+          if (std::string_view(reinterpret_cast<const char *>(proto), proto_len) == "h2" && !start_h2(c))
+            return close_conn(c);
+#endif
+          continue;
+        }
+        if (tls_blocked(c, r) < 0)
+          return wait_for(c, c.want);
+#endif
+        return close_conn(c);
+      }
+
+      case Connection::State::reading:
+      {
+        size_t end = c.in.find("\r\n\r\n");
+        if (end == std::string::npos)
+        {
+          if (c.in.size() > READ_LIMIT)
+            return close_conn(c);
+          char buf[4096];
+          ssize_t n = io_read(c, buf, sizeof(buf));
+          if (n < 0)
+            return wait_for(c, c.want);
+          if (n == 0)
+            return close_conn(c);
+          c.in.append(buf, static_cast<size_t>(n));
+          continue;
+        }
+#ifdef ORIGIN_WITH_NGHTTP2
+        if (h2_streams_ > 0 && c.in.starts_with(H2_PREFACE_LINE))
+        {
+          if (!start_h2(c))
+            return close_conn(c);
+          continue;
+        }
+#endif
+        if (!start_response(c, end + 4))
+          return close_conn(c);
+        if (c.state == Connection::State::delaying)
+          return wait_for(c, 0);
+        continue;
+      }
+
+      case Connection::State::delaying:
+        // Woken by fire_timers(); with no interest set only an error or hangup
+        // gets here, and left registered it would wake every wait.
+        return close_conn(c);
+
+      case Connection::State::writing:
+      {
+        if (c.out_off == c.out.size())
+        {
+          if (!refill(c))
+          {
+            if (!c.keep_alive)
+              return close_conn(c);
+            c.state = Connection::State::reading;
+            continue;
+          }
+        }
+        ssize_t n = io_write(c, c.out.data() + c.out_off, c.out.size() - c.out_off);
+        if (n < 0)
+          return wait_for(c, c.want);
+        if (n == 0)
+          return close_conn(c);
+        c.out_off += static_cast<size_t>(n);
+        continue;
+      }
+
+      case Connection::State::h2:
+#ifdef ORIGIN_WITH_NGHTTP2
+        return advance_h2(c);
+#else
+        return close_conn(c);
+#endif
+      }
+    }
+  }
+
+  void wait_for(Connection &c, unsigned interest) { poller_.set(c.fd, interest); }
+
+  // Consume one request head from c.in and queue the response head.
+  bool start_response(Connection &c, size_t head_len)
+  {
+    Request req;
+    std::string head = c.in.substr(0, head_len);
+    c.in.erase(0, head_len);
+    if (!parse_request(head, req))
+      return false;
+
+    ResponseSpec spec = parse_spec(req.query);
+    std::string location;
+    if (spec.redirect > 0)
+    {
+      location = next_redirect(req, spec.redirect);
+      spec.status = 302;
+      spec.size = 0;
+    }
+
+    std::string out = "HTTP/1.1 " + std::to_string(spec.status) + " ";
+    out += reason_phrase(spec.status);
+    out += "\r\nServer: crasher-origin\r\nContent-Type: application/octet-stream\r\n";
+    if (!location.empty())
+      out += "Location: " + location + "\r\n";
+    char crc_hex[9];
+    std::snprintf(crc_hex, sizeof(crc_hex), "%08x", body_crc(spec.size));
+    out += "X-Body-CRC32C: ";
+    out += crc_hex;
+    out += "\r\n";
+    if (spec.chunked)
+      out += "Transfer-Encoding: chunked\r\n";
+    else
+      out += "Content-Length: " + std::to_string(spec.size) + "\r\n";
+    out += c.keep_alive && req.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    c.keep_alive = c.keep_alive && req.keep_alive;
+    c.chunked = spec.chunked;
+    c.body_left = spec.size;
+    c.body_offset = 0;
+    c.out.clear();
+    c.out_off = 0;
+
+    if (spec.delay_ms > 0)
+    {
+      c.pending_head = std::move(out);
+      c.state = Connection::State::delaying;
+      timers_.push(Timer{Clock::now() + std::chrono::milliseconds(spec.delay_ms), c.fd, c.generation});
+      return true;
+    }
+    c.out = std::move(out);
+    c.state = Connection::State::writing;
+    return true;
+  }
+
+  // Produce the next piece of body (and chunk framing) into c.out. Returns
+  // false once the response is complete.
+  bool refill(Connection &c)
+  {
+    c.out.clear();
+    c.out_off = 0;
+    if (c.body_left == 0)
+    {
+      if (c.chunked)
+      {
+        c.chunked = false; // terminator sent once
+        c.out = "0\r\n\r\n";
+        return true;
+      }
+      return false;
+    }
+
+    const auto &bytes = pattern();
+    size_t piece = static_cast<size_t>(std::min<uint64_t>(c.body_left, CHUNK_BYTES));
+    if (c.chunked)
+    {
+      char size_hex[20];
+      auto [end, ec] = std::to_chars(size_hex, size_hex + sizeof(size_hex), piece, 16);
+      c.out.append(size_hex, end);
+      c.out += "\r\n";
+    }
+    size_t at = static_cast<size_t>(c.body_offset % PATTERN_BYTES);
+    while (piece > 0)
+    {
+      size_t n = std::min(piece, PATTERN_BYTES - at);
+      c.out.append(bytes.data() + at, n);
+      c.body_offset += n;
+      c.body_left -= n;
+      piece -= n;
+      at = 0;
+    }
+    if (c.chunked)
+      c.out += "\r\n";
+    return true;
+  }
+
+  // CRC32C of the first size bytes of the repeating pattern: the CRC of
+  // one whole pattern, combined with itself by doubling for each
+  // repetition, then the CRC of the partial tail appended.
+  static uint32_t body_crc(uint64_t size)
+  {
+    const auto &bytes = pattern();
+    static const uint32_t block = crc32c_final(crc32c_update(crc32c_init(), bytes.data(), PATTERN_BYTES));
+    uint32_t crc = 0; // CRC32C of no bytes
+    uint32_t run = block;
+    uint64_t run_bytes = PATTERN_BYTES;
+    for (uint64_t reps = size / PATTERN_BYTES; reps != 0; reps >>= 1)
+    {
+      if (reps & 1)
+        crc = crc32c_combine(crc, run, run_bytes);
+      if (reps > 1)
+      {
+        run = crc32c_combine(run, run, run_bytes);
+        run_bytes *= 2;
+      }
+    }
+    size_t tail = static_cast<size_t>(size % PATTERN_BYTES);
+    return crc32c_combine(crc, crc32c_final(crc32c_update(crc32c_init(), bytes.data(), tail)), tail);
+  }
+
+  int next_timeout_ms() const
+  {
+    if (timers_.empty())
+      return -1;
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.top().at - Clock::now()).count();
+    return wait < 0 ? 0 : static_cast<int>(wait);
+  }
+
+  void fire_timers()
+  {
+    auto now = Clock::now();
+    while (!timers_.empty() && timers_.top().at <= now)
+    {
+      Timer t = timers_.top();
+      timers_.pop();
+      if (static_cast<size_t>(t.fd) >= conns_.size() || !conns_[t.fd] || conns_[t.fd]->generation != t.generation)
+        continue;
+      Connection &c = *conns_[t.fd];
+#ifdef ORIGIN_WITH_NGHTTP2
+      if (t.stream != 0)
+      {
+        if (auto it = c.streams.find(t.stream); it != c.streams.end())
+          h2_respond(c, t.stream, it->second);
+        advance(c);
+        continue;
+      }
+#endif
+      c.out = std::move(c.pending_head);
+      c.state = Connection::State::writing;
+      advance(c);
+    }
+  }
+
+#ifdef ORIGIN_WITH_NGHTTP2
+  // Hand c over to an nghttp2 server session. Whatever is buffered in c.in
+  // (the h2c preface, or nothing after ALPN) is fed to it first.
+  bool start_h2(Connection &c)
+  {
+    nghttp2_session_callbacks *cbs = nullptr;
+    if (nghttp2_session_callbacks_new(&cbs) != 0)
+      return false;
+    nghttp2_session_callbacks_set_on_begin_headers_callback(cbs, h2_on_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(cbs, h2_on_header);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(cbs, h2_on_frame_recv);
+    nghttp2_session_callbacks_set_on_stream_close_callback(cbs, h2_on_stream_close);
+    int rv = nghttp2_session_server_new(&c.h2, cbs, &c);
+    nghttp2_session_callbacks_del(cbs);
+    if (rv != 0)
+      return false;
+    nghttp2_settings_entry settings[] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, h2_streams_}};
+    nghttp2_submit_settings(c.h2, NGHTTP2_FLAG_NONE, settings, std::size(settings));
+    c.owner = this;
+    c.state = Connection::State::h2;
+    return true;
+  }
+
+  // Alternate between flushing nghttp2's output and feeding it input until
+  // the socket would block. Output is drained first so a slow reader pushes
+  // back on the whole connection, as with HTTP/1.1.
+  void advance_h2(Connection &c)
+  {
+    if (!c.in.empty())
+    {
+      ssize_t used = nghttp2_session_mem_recv(c.h2, reinterpret_cast<const uint8_t *>(c.in.data()), c.in.size());
+      c.in.clear();
+      if (used < 0)
+        return close_conn(c);
+    }
+    for (;;)
+    {
+      if (c.out_off == c.out.size())
+      {
+        c.out.clear();
+        c.out_off = 0;
+        while (c.out.size() < PATTERN_BYTES)
+        {
+          const uint8_t *data = nullptr;
+          ssize_t n = nghttp2_session_mem_send(c.h2, &data);
+          if (n < 0)
+            return close_conn(c);
+          if (n == 0)
+            break;
+          c.out.append(reinterpret_cast<const char *>(data), static_cast<size_t>(n));
+        }
+      }
+      if (c.out_off < c.out.size())
+      {
+        ssize_t n = io_write(c, c.out.data() + c.out_off, c.out.size() - c.out_off);
+        if (n < 0)
+          return wait_for(c, c.want);
+        if (n == 0)
+          return close_conn(c);
+        c.out_off += static_cast<size_t>(n);
+        continue;
+      }
+      if (!nghttp2_session_want_read(c.h2) && !nghttp2_session_want_write(c.h2))
+        return close_conn(c);
+      char buf[16384];
+      ssize_t n = io_read(c, buf, sizeof(buf));
+      if (n < 0)
+        return wait_for(c, c.want);
+      if (n == 0 || nghttp2_session_mem_recv(c.h2, reinterpret_cast<const uint8_t *>(buf), static_cast<size_t>(n)) < 0)
+        return close_conn(c);
+    }
+  }
+
+  // Shape the response exactly as for HTTP/1.1, then answer now or after
+  // the requested delay.
+  void h2_request(Connection &c, int32_t id, H2Stream &s)
+  {
+    Request req;
+    std::string_view target = s.path;
+    size_t q = target.find('?');
+    req.path = target.substr(0, q);
+    req.query = q == std::string_view::npos ? std::string_view{} : target.substr(q + 1);
+    s.spec = parse_spec(req.query);
+    if (s.spec.redirect > 0)
+    {
+      s.location = next_redirect(req, s.spec.redirect);
+      s.spec.status = 302;
+      s.spec.size = 0;
+    }
+    s.body_left = s.spec.size;
+    if (s.spec.delay_ms > 0)
+    {
+      timers_.push(Timer{Clock::now() + std::chrono::milliseconds(s.spec.delay_ms), c.fd, c.generation, id});
+      return;
+    }
+    h2_respond(c, id, s);
+  }
+
+  void h2_respond(Connection &c, int32_t id, H2Stream &s)
+  {
+    auto nv = [](std::string_view name, std::string_view value) {
+      return nghttp2_nv{reinterpret_cast<uint8_t *>(const_cast<char *>(name.data())),
+                        reinterpret_cast<uint8_t *>(const_cast<char *>(value.data())), name.size(), value.size(),
+                        NGHTTP2_NV_FLAG_NONE};
+    };
+    std::string status = std::to_string(s.spec.status);
+    std::string length = std::to_string(s.spec.size);
+    char crc_hex[9];
+    std::snprintf(crc_hex, sizeof(crc_hex), "%08x", body_crc(s.spec.size));
+    std::vector<nghttp2_nv> headers = {nv(":status", status), nv("server", "crasher-origin"),
+                                       nv("content-type", "application/octet-stream"), nv("x-body-crc32c", crc_hex)};
+    if (!s.spec.chunked)
+      headers.push_back(nv("content-length", length));
+    if (!s.location.empty())
+      headers.push_back(nv("location", s.location));
+    nghttp2_data_provider body{};
+    body.read_callback = h2_read_body;
+    // Header values are copied by nghttp2; a failure here resets the stream.
+    if (nghttp2_submit_response(c.h2, id, headers.data(), headers.size(), s.spec.size > 0 ? &body : nullptr) != 0)
+      nghttp2_submit_rst_stream(c.h2, NGHTTP2_FLAG_NONE, id, NGHTTP2_INTERNAL_ERROR);
+  }
+
+  static Connection &h2_conn(void *user_data) { return *static_cast<Connection *>(user_data); }
+
+  static int h2_on_begin_headers(nghttp2_session *, const nghttp2_frame *frame, void *user_data)
+  {
+    if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+      h2_conn(user_data).streams.try_emplace(frame->hd.stream_id);
+    return 0;
+  }
+
+  static int h2_on_header(nghttp2_session *, const nghttp2_frame *frame, const uint8_t *name, size_t namelen,
+                          const uint8_t *value, size_t valuelen, uint8_t, void *user_data)
+  {
+    auto &streams = h2_conn(user_data).streams;
+    auto it = streams.find(frame->hd.stream_id);
+    if (it != streams.end() && std::string_view(reinterpret_cast<const char *>(name), namelen) == ":path")
+      it->second.path.assign(reinterpret_cast<const char *>(value), valuelen);
+    return 0;
+  }
+
+  // A request is complete once its END_STREAM arrives (request bodies are
+  // accepted and ignored).
+  static int h2_on_frame_recv(nghttp2_session *, const nghttp2_frame *frame, void *user_data)
+  {
+    if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+        !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM))
+      return 0;
+    Connection &c = h2_conn(user_data);
+    if (auto it = c.streams.find(frame->hd.stream_id); it != c.streams.end())
+      c.owner->h2_request(c, frame->hd.stream_id, it->second);
+    return 0;
+  }
+
+  // Also covers client cancellation (RST_STREAM); a pending delay timer
+  // then finds no stream and does nothing.
+  static int h2_on_stream_close(nghttp2_session *, int32_t stream_id, uint32_t, void *user_data)
+  {
+    h2_conn(user_data).streams.erase(stream_id);
+    return 0;
+  }
+
+  static ssize_t h2_read_body(nghttp2_session *, int32_t stream_id, uint8_t *buf, size_t length, uint32_t *data_flags,
+                              nghttp2_data_source *, void *user_data)
+  {
+    auto &streams = h2_conn(user_data).streams;
+    auto it = streams.find(stream_id);
+    if (it == streams.end())
+      return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    H2Stream &s = it->second;
+    const auto &bytes = pattern();
+    size_t total = static_cast<size_t>(std::min<uint64_t>(length, s.body_left));
+    for (size_t done = 0; done < total;)
+    {
+      size_t at = static_cast<size_t>(s.body_offset % PATTERN_BYTES);
+      size_t n = std::min(total - done, PATTERN_BYTES - at);
+      std::memcpy(buf + done, bytes.data() + at, n);
+      done += n;
+      s.body_offset += n;
+    }
+    s.body_left -= total;
+    if (s.body_left == 0)
+      *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    return static_cast<ssize_t>(total);
+  }
+#endif
+
+  EventPoller poller_;
+  std::vector<std::pair<int, bool>> listeners_;
+  SSL_CTX *tls_;
+  unsigned h2_streams_; // SETTINGS_MAX_CONCURRENT_STREAMS, 0 = no HTTP/2
+  std::vector<std::unique_ptr<Connection>> conns_; // indexed by fd
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  uint64_t generation_ = 0;
+};
+
+int listen_on(const std::string &bind, int port)
+{
+  sockaddr_storage addr{};
+  socklen_t len = 0;
+  int family = bind.find(':') != std::string::npos ? AF_INET6 : AF_INET;
+  if (family == AF_INET6)
+  {
+    auto *a6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    a6->sin6_family = AF_INET6;
+    a6->sin6_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET6, bind.c_str(), &a6->sin6_addr) != 1)
+      return -1;
+    len = sizeof(*a6);
+  }
+  else
+  {
+    auto *a4 = reinterpret_cast<sockaddr_in *>(&addr);
+    a4->sin_family = AF_INET;
+    a4->sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, bind.c_str(), &a4->sin_addr) != 1)
+      return -1;
+    len = sizeof(*a4);
+  }
+
+  int fd = socket(family, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), len) != 0 || listen(fd, 4096) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+struct OriginOptions
+{
+  std::string bind = "127.0.0.1";
+  int http_port = 8080;
+  int https_port = 8443; // 0 disables
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string cert_out = "origin-cert.pem";
+  unsigned h2_streams = 1000; // 0 disables HTTP/2
+};
+
+[[noreturn]] void usage(const char *argv0, int status)
+{
+  std::cerr << "usage: " << argv0
+            << " [--bind=ADDR] [--http-port=N] [--https-port=N|0] [--threads=N] [--cert-out=PATH]"
+               " [--h2-streams=N|0]\n";
+  std::exit(status);
+}
+
+OriginOptions parse_origin_options(int argc, char **argv)
+{
+  OriginOptions opts;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string_view name = arg.substr(0, eq);
+    std::string_view value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
+    if (name == "--help" || name == "-h")
+      usage(argv[0], 0);
+    else if (name == "--bind")
+      opts.bind = value;
+    else if (name == "--http-port")
+      parse_param(value, opts.http_port);
+    else if (name == "--https-port")
+      parse_param(value, opts.https_port);
+    else if (name == "--threads")
+      parse_param(value, opts.threads);
+    else if (name == "--cert-out")
+      opts.cert_out = value;
+    else if (name == "--h2-streams")
+      parse_param(value, opts.h2_streams);
+    else
+      usage(argv[0], 2);
+  }
+  opts.threads = std::max(1u, opts.threads);
+  return opts;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const OriginOptions opts = parse_origin_options(argc, argv);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::pair<int, bool>> listeners;
+  if (opts.http_port > 0)
+  {
+    int fd = listen_on(opts.bind, opts.http_port);
+    if (fd < 0)
+    {
+      std::cerr << "origin: cannot listen on " << opts.bind << ":" << opts.http_port << "\n";
+      return 1;
+    }
+    listeners.emplace_back(fd, false);
+    std::cout << "origin: http://" << opts.bind << ":" << opts.http_port << "/" << std::endl;
+  }
+
+  SSL_CTX *tls = nullptr;
+  if (opts.https_port > 0)
+  {
+#ifdef ORIGIN_WITH_TLS
+    tls = make_tls_context(opts.cert_out, opts.h2_streams > 0);
+    int fd = tls ? listen_on(opts.bind, opts.https_port) : -1;
+    if (fd < 0)
+    {
+      std::cerr << "origin: cannot serve TLS on " << opts.bind << ":" << opts.https_port << "\n";
+      return 1;
+    }
+    listeners.emplace_back(fd, true);
+    std::cout << "origin: https://" << opts.bind << ":" << opts.https_port << "/ (CA: " << opts.cert_out << ")"
+              << std::endl;
+#else
+    std::cerr << "origin: built without OpenSSL, HTTPS disabled\n";
+#endif
+  }
+
+  if (listeners.empty())
+    usage(argv[0], 2);
+#ifdef ORIGIN_WITH_NGHTTP2
+  if (opts.h2_streams > 0)
+    std::cout << "origin: HTTP/2 enabled (ALPN h2, h2c prior knowledge), " << opts.h2_streams
+              << " concurrent streams per connection" << std::endl;
+#endif
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < opts.threads; ++i)
+    threads.emplace_back([&listeners, tls, &opts] { OriginWorker(listeners, tls, opts.h2_streams).run(); });
+  for (auto &t : threads)
+    t.join();
+  return 0;
+}
@@ -0,0 +1,78 @@
+// prng.h - seeding and generators for reproducible runs, shared by crasher
+// and resolver_interpose. derive_seed() splits one run seed into
+// independent per-thread streams (splitmix64); Xoshiro256ss (xoshiro256**)
+// is the fast per-thread generator and works with <random> distributions.
+// fnv1a32 names a host the same way on both sides of the interposer.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string_view>
+
+inline uint64_t splitmix64(uint64_t &state)
+{
+  uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Seed of stream number stream under one run seed.
+inline uint64_t derive_seed(uint64_t seed, uint64_t stream)
+{
+  uint64_t state = seed ^ splitmix64(stream);
+  return splitmix64(state);
+}
+
+// A seed for runs that did not ask for one.
+inline uint64_t random_seed()
+{
+  std::random_device rd;
+  return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+}
+
+class Xoshiro256ss
+{
+public:
+  using result_type = uint64_t;
+
+  explicit Xoshiro256ss(uint64_t seed)
+  {
+    for (uint64_t &word : s_)
+      word = splitmix64(seed); // never all zero
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  result_type operator()()
+  {
+    const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+private:
+  static constexpr uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t s_[4];
+};
+
+constexpr uint32_t fnv1a32(std::string_view text)
+{
+  uint32_t h = 2166136261u;
+  for (char c : text)
+  {
+    h ^= static_cast<unsigned char>(c);
+    h *= 16777619u;
+  }
+  return h;
+}
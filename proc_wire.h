@@ -0,0 +1,201 @@
+// proc_wire.h - messages between crasher processes. --procs children report
+// to their coordinator over a socketpair; whole hosts report to a remote
+// coordinator over TCP (--report-to, --listen). A message is a 16-byte header
+// plus a payload of 64-bit words in host byte order, so both ends must run
+// the same build of crasher.
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "socket_util.h"
+
+enum class WireKind : uint32_t
+{
+  proc = 1, // one process' results and how it ended
+  end,      // a remote host has no more to send
+};
+
+struct WireHeader
+{
+  char magic[4] = {'C', 'R', 'P', 'W'};
+  uint32_t version = 1;
+  WireKind kind = WireKind::proc;
+  uint32_t words = 0;
+};
+static_assert(sizeof(WireHeader) == 16);
+
+// Largest payload a reader accepts, far above any real report (32 MiB)
+inline constexpr uint32_t WIRE_MAX_WORDS = uint32_t{1} << 22;
+
+class WireWriter
+{
+public:
+  void put(uint64_t word) { words_.push_back(word); }
+
+  // Length, then the bytes packed into words.
+  void put(std::string_view text)
+  {
+    put(static_cast<uint64_t>(text.size()));
+    size_t first = words_.size();
+    words_.resize(first + (text.size() + 7) / 8);
+    if (!text.empty())
+      std::memcpy(&words_[first], text.data(), text.size());
+  }
+
+  std::vector<uint64_t> &words() { return words_; }
+
+  // Blocks until the whole message is written; false if the peer is gone.
+  bool send(int fd, WireKind kind) const
+  {
+    WireHeader header;
+    header.kind = kind;
+    header.words = static_cast<uint32_t>(words_.size());
+    return send_all(fd, &header, sizeof(header)) &&
+           send_all(fd, words_.data(), words_.size() * sizeof(uint64_t));
+  }
+
+private:
+  static bool send_all(int fd, const void *data, size_t n)
+  {
+    auto *p = static_cast<const char *>(data);
+    while (n > 0)
+    {
+      ssize_t sent = ::send(fd, p, n, SEND_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+        continue;
+      if (sent <= 0)
+        return false;
+      p += sent;
+      n -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  std::vector<uint64_t> words_;
+};
+
+class WireReader
+{
+public:
+  explicit WireReader(const std::vector<uint64_t> &words) : words_(words) {}
+
+  bool get(uint64_t &word)
+  {
+    if (next_ >= words_.size())
+      return false;
+    word = words_[next_++];
+    return true;
+  }
+
+  bool get(std::string &text)
+  {
+    uint64_t length = 0;
+    if (!get(length) || length > (words_.size() - next_) * 8)
+      return false;
+    text.assign(reinterpret_cast<const char *>(words_.data() + next_), length);
+    next_ += (length + 7) / 8;
+    return true;
+  }
+
+private:
+  const std::vector<uint64_t> &words_;
+  size_t next_ = 0;
+};
+
+// Reassembles messages from one connection as its bytes arrive.
+class WireStream
+{
+public:
+  // Reads what fd has; false on EOF or error (messages already read stay).
+  bool fill(int fd)
+  {
+    char chunk[64 * 1024];
+    ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR)
+      return true;
+    if (n <= 0)
+      return false;
+    buffer_.append(chunk, static_cast<size_t>(n));
+    return true;
+  }
+
+  // The next complete message; false if none yet. A malformed or oversized
+  // header sets broken() and stops the stream.
+  bool next(WireKind &kind, std::vector<uint64_t> &words)
+  {
+    if (broken_ || buffer_.size() - offset_ < sizeof(WireHeader))
+      return false;
+    WireHeader header;
+    std::memcpy(&header, buffer_.data() + offset_, sizeof(header));
+    const WireHeader expected;
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+        header.words > WIRE_MAX_WORDS)
+    {
+      broken_ = true;
+      return false;
+    }
+    size_t bytes = sizeof(header) + size_t{header.words} * sizeof(uint64_t);
+    if (buffer_.size() - offset_ < bytes)
+      return false;
+    kind = header.kind;
+    words.resize(header.words);
+    std::memcpy(words.data(), buffer_.data() + offset_ + sizeof(header), words.size() * sizeof(uint64_t));
+    offset_ += bytes;
+    if (offset_ == buffer_.size())
+    {
+      buffer_.clear();
+      offset_ = 0;
+    }
+    return true;
+  }
+
+  bool broken() const { return broken_; }
+
+private:
+  std::string buffer_;
+  size_t offset_ = 0;
+  bool broken_ = false;
+};
+
+// "HOST:PORT", "[V6]:PORT" or ":PORT"/"PORT" (any address, listen only), with
+// a numeric HOST. Returns a connected or listening TCP socket, or -1 with
+// error set.
+inline int wire_socket(std::string_view spec, bool listen, std::string &error)
+{
+  sockaddr_storage address{};
+  socklen_t length = 0;
+  if (!parse_numeric_address(spec, address, length, error))
+    return -1;
+  if (size_t colon = spec.rfind(':'); !listen && (colon == std::string_view::npos || colon == 0))
+  {
+    error = std::string(spec) + ": needs a host to connect to";
+    return -1;
+  }
+  int fd = cloexec_socket(address.ss_family, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    error = std::string(spec) + ": " + std::strerror(errno);
+    return -1;
+  }
+  int one = 1;
+  if (listen)
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  const auto *sa = reinterpret_cast<const sockaddr *>(&address);
+  bool ok = listen ? bind(fd, sa, length) == 0 && ::listen(fd, 64) == 0 : connect(fd, sa, length) == 0;
+  if (!ok)
+  {
+    error = std::string(spec) + ": " + std::strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
@@ -0,0 +1,199 @@
+// resolver_interpose.h - glue between the fault-injection cores
+// (hook_getaddrinfo.cpp, socket_faults.cpp) and the platform backend that
+// installs them:
+// interpose_fishhook.cpp rebinds Mach-O symbol pointers on macOS,
+// interpose_elf.cpp exports the libc symbols for LD_PRELOAD on Linux.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <netdb.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "async_log.h"
+
+using getaddrinfo_fn = int (*)(const char *, const char *, const struct addrinfo *, struct addrinfo **);
+using freeaddrinfo_fn = void (*)(struct addrinfo *);
+
+using socket_fn = int (*)(int, int, int);
+using connect_fn = int (*)(int, const struct sockaddr *, socklen_t);
+using recv_fn = ssize_t (*)(int, void *, size_t, int);
+using read_fn = ssize_t (*)(int, void *, size_t);
+using send_fn = ssize_t (*)(int, const void *, size_t, int);
+using write_fn = ssize_t (*)(int, const void *, size_t);
+using close_fn = int (*)(int);
+
+// The real libc entry points, filled in by the backend before the hooks can
+// be reached.
+extern getaddrinfo_fn real_gai;
+extern freeaddrinfo_fn real_freeaddrinfo;
+extern socket_fn real_socket;
+extern connect_fn real_connect;
+extern recv_fn real_recv;
+extern read_fn real_read;
+extern send_fn real_send;
+extern write_fn real_write;
+extern close_fn real_close;
+
+// What the core decided to do with one lookup.
+struct FaultDecision
+{
+  int error;       // non-zero: fail with this EAI_* code without resolving
+  int error_index; // its position in the core's ERROR_CODES, or -1
+  int delay_ms;    // otherwise sleep this long before resolving
+};
+
+// The core's ERROR_CODES table, for reports. error_code_index returns -1 for
+// codes that are not in it.
+inline constexpr size_t MAX_ERROR_CODES = 16;
+size_t error_code_count();
+const char *error_code_name(size_t index);
+int error_code_index(int code);
+
+// Draw the next decision from the configured fault profile.
+FaultDecision decide_fault(const char *node);
+
+// Next value of the calling thread's fault generator (seeded like the
+// resolver's decisions, see resolver_interpose_seed).
+uint64_t fault_random();
+
+// Serve a lookup through the fault profile and the real resolver.
+int hook_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
+void hook_freeaddrinfo(struct addrinfo *ai);
+
+// Synthetic resolver (synthetic_resolver.cpp), configured from
+// RESOLVER_INTERPOSE_SYNTHETIC in the constructor. When enabled it answers
+// in place of real_gai; synthetic_freeaddrinfo returns false for chains it
+// did not allocate.
+void synthetic_configure();
+bool synthetic_enabled();
+int synthetic_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                          struct addrinfo **res);
+bool synthetic_freeaddrinfo(struct addrinfo *ai);
+
+// Socket faults (socket_faults.cpp), configured from
+// RESOLVER_INTERPOSE_SOCKET in the constructor. The hooks pass straight
+// through unless it is set, and then only touch TCP sockets made by
+// hook_socket.
+enum class SocketOp : uint8_t
+{
+  connect,
+  recv, // recv and read
+  send, // send and write
+  close,
+};
+
+enum class SocketOutcome : uint8_t
+{
+  pass,
+  delay,
+  eagain,
+  short_io,
+  reset,
+};
+
+inline constexpr size_t SOCKET_OPS = 4;
+inline constexpr size_t SOCKET_OUTCOMES = 5;
+const char *socket_op_name(size_t op);
+const char *socket_outcome_name(size_t outcome);
+
+void socket_faults_configure();
+int hook_socket(int domain, int type, int protocol);
+int hook_connect(int fd, const struct sockaddr *addr, socklen_t length);
+ssize_t hook_recv(int fd, void *buf, size_t length, int flags);
+ssize_t hook_read(int fd, void *buf, size_t length);
+ssize_t hook_send(int fd, const void *buf, size_t length, int flags);
+ssize_t hook_write(int fd, const void *buf, size_t length);
+int hook_close(int fd);
+
+// Telemetry (resolver_telemetry.cpp). telemetry_fault is called for every
+// fault decision, telemetry_resolve for every lookup that reached the real
+// or synthetic resolver. RESOLVER_INTERPOSE_STATS_SHM=/name additionally
+// republishes the report into a POSIX shared-memory segment.
+void telemetry_configure();
+void telemetry_fault(const char *node, const FaultDecision &fault);
+void telemetry_resolve(const char *node, uint64_t resolve_us, int result);
+// telemetry_socket counts one socket fault decision, telemetry_shaping one
+// token-bucket wait.
+void telemetry_socket(SocketOp op, SocketOutcome outcome, uint64_t delay_us);
+void telemetry_shaping(uint64_t wait_us);
+
+// Exported for the host program (crasher looks it up with dlsym): writes the
+// merged report, NUL-terminated, into buf and returns its full length like
+// snprintf.
+extern "C" size_t resolver_interpose_report(char *buf, size_t capacity);
+
+// Exported for per-round reports: failed lookups so far by EAI code,
+// injected or returned by the resolver. counts[i] is the code named
+// resolver_interpose_failure_name(i), the last slot ("other") the codes
+// outside ERROR_CODES. Fills up to capacity slots and returns how many
+// there are.
+extern "C" size_t resolver_interpose_failures(uint64_t *counts, size_t capacity);
+extern "C" const char *resolver_interpose_failure_name(size_t index);
+
+// Exported for reproducible runs (crasher --seed, --trace and --replay).
+// resolver_interpose_seed reseeds every thread's fault generator from one
+// seed, as RESOLVER_INTERPOSE_SEED does at load time. The observer sees
+// every decision (error_index -1 for none). A script queues decisions per
+// host, keyed by fnv1a32(node) from prng.h, and hands them out in order
+// before the profile is consulted again.
+using resolver_observer_fn = void (*)(void *ctx, const char *node, int error_index, int delay_ms);
+extern "C" void resolver_interpose_seed(uint64_t seed);
+extern "C" void resolver_interpose_observe(resolver_observer_fn fn, void *ctx);
+extern "C" void resolver_interpose_script(const uint32_t *host_hash, const int *error_index, const int *delay_ms,
+                                          size_t count);
+
+// Exported so the host program can keep its own TCP sockets (coordinator
+// links, the --live endpoint) out of socket fault injection.
+extern "C" void resolver_interpose_untrack(int fd);
+
+// Exported so the host program can tell the library's own threads (the shm
+// dumper, the log writer) from resolver threads when it counts them.
+extern "C" int resolver_interpose_helper_threads();
+
+// Split an environment spec into "key=value" entries, separated by commas,
+// semicolons or whitespace, with '#' starting a comment, and hand each to
+// apply(entry, key, value). An entry without '=' has an empty value.
+template <typename Apply>
+void for_each_spec_entry(std::string_view spec, Apply &&apply)
+{
+  while (!spec.empty())
+  {
+    size_t end = spec.find_first_of(",; \t\r\n#");
+    std::string_view entry = spec.substr(0, end);
+    if (end != std::string_view::npos && spec[end] == '#')
+      end = spec.find('\n', end);
+    spec = end == std::string_view::npos ? std::string_view{} : spec.substr(end + 1);
+    if (entry.empty())
+      continue;
+    size_t eq = entry.find('=');
+    apply(entry, entry.substr(0, eq), eq == std::string_view::npos ? std::string_view{} : entry.substr(eq + 1));
+  }
+}
+
+// Implemented by the backend; called once from the core's constructor after
+// the configuration has been read.
+void install_hooks();
+
+#ifdef MYAPP_LOGGING_ENABLED
+// Asynchronous logging for interposer (outputs to stderr). Never destroyed:
+// resolver threads may still log while the library's statics are torn down.
+inline AsyncLog &interposer_log()
+{
+  static AsyncLog *log = new AsyncLog(STDERR_FILENO);
+  return *log;
+}
+
+template <typename... Args>
+void log_interposer(Args &&...args)
+{
+  interposer_log().write(args...);
+}
+#else  // MYAPP_LOGGING_ENABLED
+// Empty inline function when logging is disabled
+template <typename... Args>
+inline void log_interposer(Args &&...) {}
+#endif // MYAPP_LOGGING_ENABLED
@@ -0,0 +1,457 @@
+// resolver_telemetry.cpp - per-thread resolver counters for resolver_interpose.
+// Every thread that enters the hooks owns one Block (counters, histograms and
+// a small per-host table) and writes it with relaxed single-writer atomics;
+// blocks of exited threads are reused by new ones, so curl's short-lived
+// resolver threads do not grow the list. Readers merge all blocks on demand:
+// resolver_interpose_report() for the caller, and optionally a background
+// thread that republishes the report into a shared-memory segment.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "prng.h"
+#include "resolver_interpose.h"
+
+namespace
+{
+
+constexpr size_t HOST_SLOTS = 64;     // per block, open addressing
+constexpr size_t HOST_NAME_BYTES = 64; // longer names are truncated
+constexpr size_t REPORT_HOSTS = 32;   // busiest hosts listed in the report
+constexpr size_t SHM_BYTES = 256 * 1024;
+
+struct HostStats
+{
+  std::atomic<uint32_t> hash{0}; // 0 = free; published after name
+  char name[HOST_NAME_BYTES];
+  RelaxedCounter calls;
+  RelaxedCounter injected_fail;
+  RelaxedCounter delayed;
+  RelaxedCounter delay_ms_sum;
+  RelaxedCounter resolved;
+  RelaxedCounter resolve_fail;
+  RelaxedCounter resolve_us_sum;
+  RelaxedCounter resolve_us_max;
+};
+
+struct Block
+{
+  std::atomic<bool> owned{true};
+  Block *next = nullptr;
+
+  RelaxedCounter calls;
+  RelaxedCounter delayed;
+  RelaxedCounter fast;
+  RelaxedCounter injected[MAX_ERROR_CODES];
+  RelaxedCounter resolve_ok;
+  RelaxedCounter resolve_err[MAX_ERROR_CODES + 1]; // last slot: codes not in ERROR_CODES
+  LatencyHistogram delay_us;
+  LatencyHistogram resolve_us;
+  RelaxedCounter other_hosts; // calls for hosts that found the table full
+  HostStats hosts[HOST_SLOTS];
+  RelaxedCounter socket_calls[SOCKET_OPS][SOCKET_OUTCOMES];
+  RelaxedCounter socket_delay_us;
+  RelaxedCounter shaping_waits;
+  RelaxedCounter shaping_wait_us;
+};
+
+std::atomic<Block *> blocks{nullptr};
+
+Block *claim_block()
+{
+  for (Block *b = blocks.load(std::memory_order_acquire); b; b = b->next)
+  {
+    bool expected = false;
+    if (b->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+      return b;
+  }
+  Block *b = new Block;
+  b->next = blocks.load(std::memory_order_relaxed);
+  while (!blocks.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed))
+  {
+  }
+  return b;
+}
+
+struct BlockOwner
+{
+  Block *block = nullptr;
+  ~BlockOwner()
+  {
+    if (block)
+      block->owned.store(false, std::memory_order_release);
+  }
+};
+
+Block &local_block()
+{
+  static thread_local BlockOwner owner;
+  if (!owner.block)
+    owner.block = claim_block();
+  return *owner.block;
+}
+
+// Never 0, which marks a free slot
+uint32_t host_hash(std::string_view host)
+{
+  uint32_t h = fnv1a32(host);
+  return h ? h : 1;
+}
+
+std::string_view host_key(const char *node)
+{
+  std::string_view host = node ? node : "(null)";
+  return host.substr(0, HOST_NAME_BYTES - 1);
+}
+
+// Find or insert host in the owning thread's table; null when full.
+HostStats *host_slot(Block &b, const char *node)
+{
+  std::string_view host = host_key(node);
+  uint32_t h = host_hash(host);
+  for (size_t probe = 0; probe < HOST_SLOTS; ++probe)
+  {
+    HostStats &s = b.hosts[(h + probe) % HOST_SLOTS];
+    uint32_t current = s.hash.load(std::memory_order_relaxed);
+    if (current == 0)
+    {
+      std::memcpy(s.name, host.data(), host.size());
+      s.name[host.size()] = '\0';
+      s.hash.store(h, std::memory_order_release);
+      return &s;
+    }
+    if (current == h && host == s.name)
+      return &s;
+  }
+  b.other_hosts.add();
+  return nullptr;
+}
+
+void max_into(RelaxedCounter &c, uint64_t value)
+{
+  uint64_t current = c.load();
+  if (value > current)
+    c.add(value - current);
+}
+
+// ---- report ----
+struct HostTotals
+{
+  std::string name;
+  uint64_t calls = 0, injected_fail = 0, delayed = 0, delay_ms_sum = 0;
+  uint64_t resolved = 0, resolve_fail = 0, resolve_us_sum = 0, resolve_us_max = 0;
+};
+
+void appendf(std::string &out, const char *fmt, auto... args)
+{
+  char line[512];
+  int n = std::snprintf(line, sizeof(line), fmt, args...);
+  if (n > 0)
+    out.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+}
+
+void append_histogram(std::string &out, const char *name, const LatencyHistogram &h)
+{
+  appendf(out, "[resolver] %s count=%llu p50=%llu p99=%llu p999=%llu max=%llu\n", name,
+          static_cast<unsigned long long>(h.count()), static_cast<unsigned long long>(h.percentile(0.50)),
+          static_cast<unsigned long long>(h.percentile(0.99)), static_cast<unsigned long long>(h.percentile(0.999)),
+          static_cast<unsigned long long>(h.max()));
+}
+
+std::string build_report()
+{
+  uint64_t calls = 0, delayed = 0, fast = 0, other_hosts = 0, resolve_ok = 0;
+  uint64_t injected[MAX_ERROR_CODES] = {}, resolve_err[MAX_ERROR_CODES + 1] = {};
+  size_t threads = 0, live = 0;
+  // the histograms are too large for the stack of a resolver thread
+  auto delay_us = std::make_unique<LatencyHistogram>();
+  auto resolve_us = std::make_unique<LatencyHistogram>();
+  std::vector<HostTotals> hosts;
+  uint64_t socket_calls[SOCKET_OPS][SOCKET_OUTCOMES] = {};
+  uint64_t socket_delay_us = 0, shaping_waits = 0, shaping_wait_us = 0;
+
+  for (Block *b = blocks.load(std::memory_order_acquire); b; b = b->next)
+  {
+    for (size_t op = 0; op < SOCKET_OPS; ++op)
+      for (size_t o = 0; o < SOCKET_OUTCOMES; ++o)
+        socket_calls[op][o] += b->socket_calls[op][o].load();
+    socket_delay_us += b->socket_delay_us.load();
+    shaping_waits += b->shaping_waits.load();
+    shaping_wait_us += b->shaping_wait_us.load();
+    ++threads;
+    live += b->owned.load(std::memory_order_relaxed);
+    calls += b->calls.load();
+    delayed += b->delayed.load();
+    fast += b->fast.load();
+    other_hosts += b->other_hosts.load();
+    resolve_ok += b->resolve_ok.load();
+    for (size_t i = 0; i < MAX_ERROR_CODES; ++i)
+      injected[i] += b->injected[i].load();
+    for (size_t i = 0; i <= MAX_ERROR_CODES; ++i)
+      resolve_err[i] += b->resolve_err[i].load();
+    delay_us->merge(b->delay_us);
+    resolve_us->merge(b->resolve_us);
+
+    for (const HostStats &s : b->hosts)
+    {
+      if (s.hash.load(std::memory_order_acquire) == 0)
+        continue;
+      auto it = std::find_if(hosts.begin(), hosts.end(), [&](const HostTotals &t) { return t.name == s.name; });
+      if (it == hosts.end())
+        it = hosts.insert(hosts.end(), HostTotals{.name = s.name});
+      it->calls += s.calls.load();
+      it->injected_fail += s.injected_fail.load();
+      it->delayed += s.delayed.load();
+      it->delay_ms_sum += s.delay_ms_sum.load();
+      it->resolved += s.resolved.load();
+      it->resolve_fail += s.resolve_fail.load();
+      it->resolve_us_sum += s.resolve_us_sum.load();
+      it->resolve_us_max = std::max(it->resolve_us_max, s.resolve_us_max.load());
+    }
+  }
+
+  uint64_t failed = 0;
+  for (uint64_t n : injected)
+    failed += n;
+
+  using ull = unsigned long long;
+  std::string out;
+  appendf(out, "[resolver] calls=%llu injected_fail=%llu delayed=%llu fast=%llu thread_blocks=%zu live=%zu\n",
+          ull(calls), ull(failed), ull(delayed), ull(fast), threads, live);
+  append_histogram(out, "injected_delay_us", *delay_us);
+  append_histogram(out, "resolve_us", *resolve_us);
+  for (size_t i = 0; i < error_code_count() && i < MAX_ERROR_CODES; ++i)
+    if (injected[i])
+      appendf(out, "[resolver] injected %s count=%llu\n", error_code_name(i), ull(injected[i]));
+  appendf(out, "[resolver] resolved ok count=%llu\n", ull(resolve_ok));
+  for (size_t i = 0; i <= MAX_ERROR_CODES; ++i)
+    if (resolve_err[i])
+      appendf(out, "[resolver] resolved %s count=%llu\n", i < error_code_count() ? error_code_name(i) : "other",
+              ull(resolve_err[i]));
+
+  std::sort(hosts.begin(), hosts.end(), [](const HostTotals &a, const HostTotals &b) { return a.calls > b.calls; });
+  for (size_t i = 0; i < hosts.size() && i < REPORT_HOSTS; ++i)
+  {
+    const HostTotals &h = hosts[i];
+    appendf(out,
+            "[resolver] host %s calls=%llu injected_fail=%llu delayed=%llu avg_delay_ms=%llu resolved=%llu "
+            "resolve_fail=%llu avg_resolve_us=%llu max_resolve_us=%llu\n",
+            h.name.c_str(), ull(h.calls), ull(h.injected_fail), ull(h.delayed),
+            ull(h.delayed ? h.delay_ms_sum / h.delayed : 0), ull(h.resolved), ull(h.resolve_fail),
+            ull(h.resolved ? h.resolve_us_sum / h.resolved : 0), ull(h.resolve_us_max));
+  }
+  if (hosts.size() > REPORT_HOSTS || other_hosts)
+    appendf(out, "[resolver] hosts listed=%zu of %zu untracked_calls=%llu\n", std::min(hosts.size(), REPORT_HOSTS),
+            hosts.size(), ull(other_hosts));
+
+  for (size_t op = 0; op < SOCKET_OPS; ++op)
+  {
+    uint64_t total = 0;
+    for (uint64_t n : socket_calls[op])
+      total += n;
+    if (!total)
+      continue;
+    appendf(out, "[socket] %s calls=%llu", socket_op_name(op), ull(total));
+    for (size_t o = 0; o < SOCKET_OUTCOMES; ++o)
+      appendf(out, " %s=%llu", socket_outcome_name(o), ull(socket_calls[op][o]));
+    appendf(out, "\n");
+  }
+  if (socket_delay_us || shaping_waits)
+    appendf(out, "[socket] injected_delay_ms=%llu shaping_waits=%llu shaping_wait_ms=%llu\n",
+            ull(socket_delay_us / 1000), ull(shaping_waits), ull(shaping_wait_us / 1000));
+  return out;
+}
+
+// ---- shared-memory dump ----
+// Layout: ShmHeader, then length bytes of report text. seq is odd while the
+// text is being rewritten; readers retry until they see the same even value
+// before and after copying.
+struct ShmHeader
+{
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> length;
+};
+
+void shm_dump_loop(ShmHeader *header, char *text, size_t capacity, std::chrono::milliseconds interval)
+{
+  for (;;)
+  {
+    std::string report = build_report();
+    size_t n = std::min(report.size(), capacity);
+    uint64_t seq = header->seq.load(std::memory_order_relaxed);
+    header->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(text, report.data(), n);
+    header->length.store(n, std::memory_order_relaxed);
+    header->seq.store(seq + 2, std::memory_order_release);
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+std::atomic<pid_t> shm_dump_pid{0}; // a forked child has no dumper thread
+
+void start_shm_dump(const char *name, std::chrono::milliseconds interval)
+{
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, SHM_BYTES) != 0)
+  {
+    log_interposer("[telemetry] cannot create shm segment ", name);
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  void *mem = mmap(nullptr, SHM_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+  {
+    log_interposer("[telemetry] cannot map shm segment ", name);
+    return;
+  }
+  auto *header = new (mem) ShmHeader{};
+  char *text = static_cast<char *>(mem) + sizeof(ShmHeader);
+  std::thread(shm_dump_loop, header, text, SHM_BYTES - sizeof(ShmHeader), interval).detach();
+  shm_dump_pid.store(getpid(), std::memory_order_release);
+  log_interposer("[telemetry] dumping to shm ", name, " every ", interval.count(), " ms");
+}
+
+} // namespace
+
+void telemetry_fault(const char *node, const FaultDecision &fault)
+{
+  Block &b = local_block();
+  HostStats *host = host_slot(b, node);
+  b.calls.add();
+  if (host)
+    host->calls.add();
+  if (fault.error != 0)
+  {
+    if (fault.error_index >= 0 && static_cast<size_t>(fault.error_index) < MAX_ERROR_CODES)
+      b.injected[fault.error_index].add();
+    if (host)
+      host->injected_fail.add();
+  }
+  else if (fault.delay_ms > 0)
+  {
+    b.delayed.add();
+    b.delay_us.record(static_cast<uint64_t>(fault.delay_ms) * 1000);
+    if (host)
+    {
+      host->delayed.add();
+      host->delay_ms_sum.add(static_cast<uint64_t>(fault.delay_ms));
+    }
+  }
+  else
+  {
+    b.fast.add();
+  }
+}
+
+void telemetry_resolve(const char *node, uint64_t resolve_us, int result)
+{
+  Block &b = local_block();
+  HostStats *host = host_slot(b, node);
+  b.resolve_us.record(resolve_us);
+  if (result == 0)
+  {
+    b.resolve_ok.add();
+  }
+  else
+  {
+    int index = error_code_index(result);
+    b.resolve_err[index >= 0 && static_cast<size_t>(index) < MAX_ERROR_CODES ? index : MAX_ERROR_CODES].add();
+  }
+  if (host)
+  {
+    host->resolved.add();
+    if (result != 0)
+      host->resolve_fail.add();
+    host->resolve_us_sum.add(resolve_us);
+    max_into(host->resolve_us_max, resolve_us);
+  }
+}
+
+void telemetry_socket(SocketOp op, SocketOutcome outcome, uint64_t delay_us)
+{
+  Block &b = local_block();
+  b.socket_calls[static_cast<size_t>(op)][static_cast<size_t>(outcome)].add();
+  if (delay_us)
+    b.socket_delay_us.add(delay_us);
+}
+
+void telemetry_shaping(uint64_t wait_us)
+{
+  Block &b = local_block();
+  b.shaping_waits.add();
+  b.shaping_wait_us.add(wait_us);
+}
+
+void telemetry_configure()
+{
+  const char *pattern = std::getenv("RESOLVER_INTERPOSE_STATS_SHM");
+  if (!pattern || !*pattern)
+    return;
+  // LD_PRELOAD also reaches child processes (and wrappers like timeout);
+  // "%p" in the name expands to the pid so they do not share a segment.
+  std::string name(pattern);
+  if (size_t at = name.find("%p"); at != std::string::npos)
+    name.replace(at, 2, std::to_string(getpid()));
+  long ms = 1000;
+  if (const char *interval = std::getenv("RESOLVER_INTERPOSE_STATS_INTERVAL_MS"); interval && *interval)
+    ms = std::max(10L, std::strtol(interval, nullptr, 10));
+  start_shm_dump(name.c_str(), std::chrono::milliseconds(ms));
+}
+
+extern "C" size_t resolver_interpose_report(char *buf, size_t capacity)
+{
+  std::string report = build_report();
+  if (buf && capacity > 0)
+  {
+    size_t n = std::min(report.size(), capacity - 1);
+    std::memcpy(buf, report.data(), n);
+    buf[n] = '\0';
+  }
+  return report.size();
+}
+
+extern "C" size_t resolver_interpose_failures(uint64_t *counts, size_t capacity)
+{
+  size_t slots = error_code_count() + 1;
+  for (size_t i = 0; i < std::min(slots, capacity); ++i)
+    counts[i] = 0;
+  for (Block *b = blocks.load(std::memory_order_acquire); b; b = b->next)
+  {
+    for (size_t i = 0; i + 1 < slots && i < capacity; ++i)
+      counts[i] += b->injected[i].load() + b->resolve_err[i].load();
+    if (slots <= capacity)
+      counts[slots - 1] += b->resolve_err[MAX_ERROR_CODES].load();
+  }
+  return slots;
+}
+
+extern "C" const char *resolver_interpose_failure_name(size_t index)
+{
+  return index < error_code_count() ? error_code_name(index) : "other";
+}
+
+extern "C" int resolver_interpose_helper_threads()
+{
+  int n = shm_dump_pid.load(std::memory_order_acquire) == getpid();
+#ifdef MYAPP_LOGGING_ENABLED
+  n += interposer_log().writer_running();
+#endif
+  return n;
+}
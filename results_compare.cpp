@@ -0,0 +1,208 @@
+// results_compare.cpp - regression gate over two crasher --results files.
+//
+//   crasher_compare BASE NEW [--max-throughput-drop=PCT] [--max-p99-rise=PCT] [--min-count=N]
+//
+// Rounds are matched by position. NEW fails when it did not finish
+// (run.status other than "ok": still "running" after a crash, or a --procs
+// run with crashed processes), when a round's transfers_per_s fell by more
+// than PCT (default 5), when a latency p99 rose by more than PCT (default
+// 10; any rise from 0 counts), or when a body failed its checksum. A p99 is
+// only compared when both runs have at least N samples of it (default 100).
+// Either file may be JSON or CSV. Exit status: 0 pass, 1 regression, 2 usage
+// or unreadable file.
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "results_file.h"
+
+namespace
+{
+
+using Flat = std::map<std::string, std::string>;
+
+struct CompareOptions
+{
+  std::string base, next;
+  double max_throughput_drop = 5; // percent
+  double max_p99_rise = 10;       // percent
+  double min_count = 100;
+};
+
+[[noreturn]] void usage(const char *argv0, int status)
+{
+  (status ? std::cerr : std::cout)
+      << "usage: " << argv0 << " BASE NEW [options]\n"
+      << "  --max-throughput-drop=PCT  fail if a round's transfers_per_s falls more (default 5)\n"
+      << "  --max-p99-rise=PCT         fail if a latency p99 rises more (default 10)\n"
+      << "  --min-count=N              compare a p99 only with N samples in both runs (default 100)\n";
+  std::exit(status);
+}
+
+bool parse_double(std::string_view text, double &out)
+{
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+  return ec == std::errc{} && end == text.data() + text.size() && out >= 0;
+}
+
+CompareOptions parse_compare_options(int argc, char **argv)
+{
+  CompareOptions opts;
+  std::vector<std::string_view> files;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string_view name = arg.substr(0, eq);
+    std::string_view value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
+    bool ok = true;
+    if (name == "--help" || name == "-h")
+      usage(argv[0], 0);
+    else if (name == "--max-throughput-drop")
+      ok = parse_double(value, opts.max_throughput_drop);
+    else if (name == "--max-p99-rise")
+      ok = parse_double(value, opts.max_p99_rise);
+    else if (name == "--min-count")
+      ok = parse_double(value, opts.min_count);
+    else if (arg.starts_with("--"))
+      ok = false;
+    else
+      files.push_back(arg);
+    if (!ok)
+      usage(argv[0], 2);
+  }
+  if (files.size() != 2)
+    usage(argv[0], 2);
+  opts.base = files[0];
+  opts.next = files[1];
+  return opts;
+}
+
+// Missing or non-numeric values read as nullopt
+std::optional<double> number(const Flat &f, const std::string &key)
+{
+  auto it = f.find(key);
+  double value = 0;
+  if (it == f.end() || !parse_double(it->second, value))
+    return std::nullopt;
+  return value;
+}
+
+std::string value_of(const Flat &f, const std::string &key)
+{
+  auto it = f.find(key);
+  return it == f.end() ? "-" : it->second;
+}
+
+class Gate
+{
+public:
+  // One compared metric; limit is the allowed change in percent, signed in
+  // the bad direction (negative for throughput)
+  void check(const std::string &name, double base, double next, double limit)
+  {
+    // From a zero base any rise is unbounded, so a p99 that leaves 0 fails
+    double change = base > 0 ? (next - base) / base * 100 : next > 0 ? HUGE_VAL : 0;
+    bool bad = limit < 0 ? change < limit : change > limit;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-44s %14.1f %14.1f %+8.1f%% %+6.1f%%  %s\n", name.c_str(), base, next, change,
+                  limit, bad ? "REGRESSION" : "ok");
+    std::cout << line;
+    failures_ += bad;
+  }
+
+  void fail(const std::string &what)
+  {
+    std::cout << "[compare] " << what << "\n";
+    ++failures_;
+  }
+
+  int failures() const { return failures_; }
+
+private:
+  int failures_ = 0;
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const CompareOptions opts = parse_compare_options(argc, argv);
+  Flat base, next;
+  std::string error;
+  if (!ResultsReader::load(opts.base, base, error) || !ResultsReader::load(opts.next, next, error))
+  {
+    std::cerr << argv[0] << ": " << error << "\n";
+    return 2;
+  }
+
+  for (const char *key : {"curl.version", "run.seed", "config.command"})
+    if (value_of(base, key) != value_of(next, key))
+      std::cout << "[compare] " << key << ": " << value_of(base, key) << " -> " << value_of(next, key) << "\n";
+  for (const auto &[key, value] : next)
+    if (key.starts_with("config.env.") && value_of(base, key) != value)
+      std::cout << "[compare] " << key << ": " << value_of(base, key) << " -> " << value << "\n";
+
+  Gate gate;
+  if (value_of(base, "run.status") != "ok")
+    std::cout << "[compare] base run.status=" << value_of(base, "run.status") << "\n";
+  if (value_of(next, "run.status") != "ok")
+    gate.fail("new run.status=" + value_of(next, "run.status") + ": the run did not finish cleanly");
+  if (number(next, "run.crashed").value_or(0) > 0)
+    gate.fail("new run.crashed=" + value_of(next, "run.crashed"));
+
+  char header[128];
+  std::snprintf(header, sizeof(header), "%-44s %14s %14s %9s %7s\n", "metric", "base", "new", "change", "limit");
+  std::cout << header;
+  size_t rounds = 0;
+  for (;; ++rounds)
+  {
+    std::string round = "rounds." + std::to_string(rounds) + ".";
+    std::optional<double> base_tps = number(base, round + "transfers_per_s");
+    std::optional<double> next_tps = number(next, round + "transfers_per_s");
+    if (!base_tps || !next_tps)
+      break;
+    auto level = [&](const Flat &f) {
+      return value_of(f, round + "threads") + "/" + value_of(f, round + "per_multi");
+    };
+    if (level(base) != level(next))
+      std::cout << "[compare] " << round << "threads/per_multi differ: " << level(base) << " -> " << level(next) << "\n";
+    gate.check(round + "transfers_per_s", *base_tps, *next_tps, -opts.max_throughput_drop);
+    std::string latency = round + "latency_us.";
+    for (auto it = base.lower_bound(latency); it != base.end() && it->first.starts_with(latency); ++it)
+    {
+      if (!it->first.ends_with(".p99"))
+        continue;
+      std::string count = it->first.substr(0, it->first.size() - 3) + "count";
+      if (number(base, count).value_or(0) < opts.min_count || number(next, count).value_or(0) < opts.min_count)
+        continue;
+      if (std::optional<double> b = number(base, it->first), n = number(next, it->first); b && n)
+        gate.check(it->first, *b, *n, opts.max_p99_rise);
+    }
+    if (number(next, round + "body.mismatched").value_or(0) > 0)
+      gate.fail(round + "body.mismatched=" + value_of(next, round + "body.mismatched"));
+  }
+  // The interposer's own resolve timing, when both runs had it loaded
+  const std::string resolve = "interposer.resolver.resolve_us.";
+  if (number(base, resolve + "count").value_or(0) >= opts.min_count &&
+      number(next, resolve + "count").value_or(0) >= opts.min_count)
+    gate.check(resolve + "p99", number(base, resolve + "p99").value_or(0), number(next, resolve + "p99").value_or(0),
+               opts.max_p99_rise);
+
+  if (rounds == 0)
+    gate.fail("no rounds to compare");
+  else if (number(base, "rounds." + std::to_string(rounds) + ".transfers_per_s") ||
+           number(next, "rounds." + std::to_string(rounds) + ".transfers_per_s"))
+    std::cout << "[compare] round counts differ, compared the first " << rounds << "\n";
+  std::cout << "[compare] " << (gate.failures() ? "FAIL" : "PASS") << " rounds=" << rounds
+            << " regressions=" << gate.failures() << "\n";
+  return gate.failures() ? 1 : 0;
+}
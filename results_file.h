@@ -0,0 +1,414 @@
+// results_file.h - crasher's machine-readable results (--results) and the
+// reader crasher_compare uses. A results document is a list of sections,
+// each either one object or an array of objects, and every object is a flat
+// list of dotted keys ("latency_us.total.p99") with a number or a string.
+// Written as JSON, or as CSV (one row per "rounds" entry, the object
+// sections repeated as prefixed columns, other arrays left out) when the
+// path ends in .csv. Either form reads back as one flat map:
+// "run.status", "rounds.0.transfers_per_s", ...
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ResultFields
+{
+  struct Field
+  {
+    std::string key;
+    std::string value;
+    bool quoted; // a string, not a number
+  };
+  std::vector<Field> fields;
+
+  // Setting a key again replaces its value
+  void text(std::string key, std::string_view value) { put(std::move(key), std::string(value), true); }
+
+  void count(std::string key, uint64_t value) { put(std::move(key), std::to_string(value), false); }
+
+  void number(std::string key, double value)
+  {
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    put(std::move(key), ec == std::errc{} ? std::string(buffer, end) : "0", false);
+  }
+
+private:
+  void put(std::string key, std::string value, bool quoted)
+  {
+    for (Field &f : fields)
+      if (f.key == key)
+      {
+        f.value = std::move(value);
+        f.quoted = quoted;
+        return;
+      }
+    fields.push_back({std::move(key), std::move(value), quoted});
+  }
+};
+
+class ResultsFile
+{
+public:
+  static constexpr const char *FORMAT = "crasher-results";
+  static constexpr int VERSION = 1;
+
+  // The object section name, created on first use
+  ResultFields &section(std::string_view name)
+  {
+    for (Section &s : sections_)
+      if (s.name == name && !s.list)
+        return s.items.front();
+    return sections_.emplace_back(Section{std::string(name), false, {ResultFields{}}}).items.front();
+  }
+
+  // A new object at the end of array section name
+  ResultFields &append(std::string_view name)
+  {
+    for (Section &s : sections_)
+      if (s.name == name && s.list)
+        return s.items.emplace_back();
+    return sections_.emplace_back(Section{std::string(name), true, {ResultFields{}}}).items.front();
+  }
+
+  // Through a temporary and rename(), so a crash mid-write keeps the old file.
+  bool write(const std::string &path, std::string &error) const
+  {
+    std::string text = path.ends_with(".csv") ? csv() : json();
+    std::string temp = path + ".tmp";
+    FILE *f = std::fopen(temp.c_str(), "w");
+    bool ok = f && std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (f)
+      ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+      error = path + ": " + std::strerror(errno);
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+private:
+  struct Section
+  {
+    std::string name;
+    bool list;
+    std::vector<ResultFields> items;
+  };
+
+  static void quote(std::string &out, std::string_view text)
+  {
+    out += '"';
+    for (char c : text)
+    {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out += escape;
+        continue;
+      }
+      out += c;
+    }
+    out += '"';
+  }
+
+  static void object(std::string &out, const ResultFields &fields, const char *indent)
+  {
+    out += "{";
+    for (size_t i = 0; i < fields.fields.size(); ++i)
+    {
+      const ResultFields::Field &f = fields.fields[i];
+      out += i ? ",\n" : "\n";
+      out += indent;
+      quote(out, f.key);
+      out += ": ";
+      if (f.quoted)
+        quote(out, f.value);
+      else
+        out += f.value;
+    }
+    out += "\n";
+    out += std::string_view(indent).substr(2);
+    out += "}";
+  }
+
+  std::string json() const
+  {
+    std::string out = "{\n  \"format\": \"" + std::string(FORMAT) + "\",\n  \"version\": " + std::to_string(VERSION);
+    for (const Section &s : sections_)
+    {
+      out += ",\n  ";
+      quote(out, s.name);
+      out += ": ";
+      if (!s.list)
+      {
+        object(out, s.items.front(), "    ");
+        continue;
+      }
+      out += "[";
+      for (size_t i = 0; i < s.items.size(); ++i)
+      {
+        out += i ? ", " : "";
+        object(out, s.items[i], "      ");
+      }
+      out += "]";
+    }
+    return out + "\n}\n";
+  }
+
+  static void cell(std::string &out, std::string_view text)
+  {
+    if (text.find_first_of(",\"\n") == std::string_view::npos)
+    {
+      out += text;
+      return;
+    }
+    out += '"';
+    for (char c : text)
+      out += c == '"' ? std::string("\"\"") : std::string(1, c);
+    out += '"';
+  }
+
+  std::string csv() const
+  {
+    std::vector<std::pair<std::string, const ResultFields::Field *>> fixed; // object sections
+    const Section *rounds = nullptr;
+    for (const Section &s : sections_)
+      if (!s.list)
+        for (const ResultFields::Field &f : s.items.front().fields)
+          fixed.emplace_back(s.name + "." + f.key, &f);
+      else if (s.name == "rounds")
+        rounds = &s;
+    std::vector<std::string> columns; // round keys in first-seen order
+    if (rounds)
+      for (const ResultFields &r : rounds->items)
+        for (const ResultFields::Field &f : r.fields)
+          if (std::find(columns.begin(), columns.end(), f.key) == columns.end())
+            columns.push_back(f.key);
+
+    std::string out;
+    for (const auto &[name, field] : fixed)
+      cell(out += out.empty() ? "" : ",", name);
+    for (const std::string &c : columns)
+      cell(out += out.empty() ? "" : ",", "round." + c);
+    out += "\n";
+    size_t rows = rounds ? rounds->items.size() : 1;
+    for (size_t row = 0; row < rows; ++row)
+    {
+      bool first = true;
+      for (const auto &[name, field] : fixed)
+      {
+        cell(out += first ? "" : ",", field->value);
+        first = false;
+      }
+      for (const std::string &c : columns)
+      {
+        std::string_view value;
+        for (const ResultFields::Field &f : rounds->items[row].fields)
+          if (f.key == c)
+            value = f.value;
+        cell(out += first ? "" : ",", value);
+        first = false;
+      }
+      out += "\n";
+    }
+    return out;
+  }
+
+  std::vector<Section> sections_;
+};
+
+// Flattens a results file into "section.key" / "list.N.key" entries.
+class ResultsReader
+{
+public:
+  static bool load(const std::string &path, std::map<std::string, std::string> &out, std::string &error)
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+      error = path + ": " + std::strerror(errno);
+      return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    size_t start = text.find_first_not_of(" \t\r\n");
+    bool ok = start != std::string::npos && text[start] == '{' ? ResultsReader(text).json(out)
+                                                               : ResultsReader(text).csv(out);
+    if (!ok)
+      error = path + ": not a crasher results file";
+    return ok;
+  }
+
+private:
+  explicit ResultsReader(std::string_view text) : text_(text) {}
+
+  bool json(std::map<std::string, std::string> &out)
+  {
+    if (!value("", out))
+      return false;
+    skip_space();
+    return pos_ == text_.size() && out["format"] == ResultsFile::FORMAT;
+  }
+
+  void skip_space()
+  {
+    while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_])))
+      ++pos_;
+  }
+
+  bool eat(char c)
+  {
+    skip_space();
+    if (pos_ < text_.size() && text_[pos_] == c)
+    {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool string(std::string &s)
+  {
+    if (!eat('"'))
+      return false;
+    for (; pos_ < text_.size(); ++pos_)
+    {
+      char c = text_[pos_];
+      if (c == '"')
+      {
+        ++pos_;
+        return true;
+      }
+      if (c == '\\' && ++pos_ < text_.size())
+      {
+        c = text_[pos_];
+        if (c == 'u')
+        {
+          unsigned code = 0;
+          std::from_chars(text_.data() + pos_ + 1, text_.data() + std::min(pos_ + 5, text_.size()), code, 16);
+          c = code < 0x80 ? static_cast<char>(code) : '?';
+          pos_ += 4;
+        }
+        else if (c == 'n')
+          c = '\n';
+        else if (c == 't')
+          c = '\t';
+      }
+      s += c;
+    }
+    return false;
+  }
+
+  bool value(const std::string &key, std::map<std::string, std::string> &out)
+  {
+    skip_space();
+    std::string prefix = key.empty() ? "" : key + ".";
+    if (eat('{'))
+    {
+      if (eat('}'))
+        return true;
+      do
+      {
+        std::string name;
+        if (!string(name) || !eat(':') || !value(prefix + name, out))
+          return false;
+      } while (eat(','));
+      return eat('}');
+    }
+    if (eat('['))
+    {
+      if (eat(']'))
+        return true;
+      size_t index = 0;
+      do
+      {
+        if (!value(prefix + std::to_string(index++), out))
+          return false;
+      } while (eat(','));
+      return eat(']');
+    }
+    if (pos_ < text_.size() && text_[pos_] == '"')
+    {
+      std::string s;
+      if (!string(s))
+        return false;
+      out[key] = s;
+      return true;
+    }
+    size_t end = text_.find_first_of(",}] \t\r\n", pos_);
+    if (end == pos_ || end == std::string_view::npos)
+      return false;
+    out[key] = std::string(text_.substr(pos_, end - pos_)); // number, true, false, null
+    pos_ = end;
+    return true;
+  }
+
+  // One row's cells; quotes as written by ResultsFile::cell
+  static std::vector<std::string> cells(std::string_view line)
+  {
+    std::vector<std::string> row(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+      char c = line[i];
+      if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+        row.back() += line[++i];
+      else if (c == '"')
+        quoted = !quoted;
+      else if (c == ',' && !quoted)
+        row.emplace_back();
+      else if (c != '\r')
+        row.back() += c;
+    }
+    return row;
+  }
+
+  bool csv(std::map<std::string, std::string> &out)
+  {
+    std::vector<std::string> header;
+    size_t row = 0;
+    while (pos_ < text_.size())
+    {
+      size_t eol = text_.find('\n', pos_);
+      std::string_view line = text_.substr(pos_, eol == std::string_view::npos ? std::string_view::npos : eol - pos_);
+      pos_ = eol == std::string_view::npos ? text_.size() : eol + 1;
+      if (line.empty())
+        continue;
+      std::vector<std::string> values = cells(line);
+      if (header.empty())
+      {
+        header = std::move(values);
+        continue;
+      }
+      for (size_t i = 0; i < header.size() && i < values.size(); ++i)
+        if (header[i].starts_with("round."))
+          out["rounds." + std::to_string(row) + header[i].substr(5)] = values[i];
+        else
+          out[header[i]] = values[i];
+      ++row;
+    }
+    out["format"] = ResultsFile::FORMAT;
+    return !header.empty() && out.count("run.status");
+  }
+
+  std::string_view text_;
+  size_t pos_ = 0;
+};
@@ -0,0 +1,340 @@
+// retry_policy.h - how crasher's workers retry failed transfers (--retry)
+// and the per-host circuit breaker in front of them. A RetryPolicy is
+// parsed once; each worker keeps its own RetryQueue of pending retries and
+// its own CircuitBreaker, so nothing here is shared between threads.
+//
+// Spec: "off", "on", or comma-separated key=value entries, all optional:
+//   attempts=N     tries per request, the first included (default 4)
+//   base=MS        backoff ceiling before the first retry, doubling per retry (default 100)
+//   cap=MS         largest backoff ceiling (default 5000)
+//   on=CLASS+...   failure classes to retry: resolve, connect, timeout, tls, other
+//                  (default resolve+connect+timeout)
+//   breaker=N      consecutive host failures that open its breaker, 0 = none (default 5)
+//   open=MS        how long an open breaker rejects the host before one probe (default 2000)
+// Backoff is "full jitter": uniform in [0, min(cap, base * 2^(retry - 1))].
+// A host failure is a resolve, connect, timeout or TLS failure; a transfer
+// that finishes any other way closes its host's breaker again.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <curl/curl.h>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "spec_parser.h"
+
+enum class FailureClass : uint8_t
+{
+  none, // CURLE_OK
+  resolve,
+  connect, // refused, reset, nothing received, broken stream
+  timeout,
+  tls,
+  aborted, // our own progress-callback abort: never retried
+  other,
+};
+
+inline constexpr const char *FAILURE_CLASS_NAMES[] = {"none",    "resolve", "connect", "timeout",
+                                                      "tls",     "aborted", "other"};
+inline constexpr size_t FAILURE_CLASSES = sizeof(FAILURE_CLASS_NAMES) / sizeof(FAILURE_CLASS_NAMES[0]);
+
+inline FailureClass classify_failure(CURLcode code)
+{
+  switch (code)
+  {
+  case CURLE_OK: return FailureClass::none;
+  case CURLE_COULDNT_RESOLVE_HOST:
+  case CURLE_COULDNT_RESOLVE_PROXY: return FailureClass::resolve;
+  case CURLE_COULDNT_CONNECT:
+  case CURLE_SEND_ERROR:
+  case CURLE_RECV_ERROR:
+  case CURLE_GOT_NOTHING:
+  case CURLE_PARTIAL_FILE:
+  case CURLE_HTTP2:
+  case CURLE_HTTP2_STREAM:
+  case CURLE_HTTP3: return FailureClass::connect;
+  case CURLE_OPERATION_TIMEDOUT: return FailureClass::timeout;
+  case CURLE_SSL_CONNECT_ERROR:
+  case CURLE_PEER_FAILED_VERIFICATION:
+  case CURLE_SSL_CERTPROBLEM:
+  case CURLE_SSL_CIPHER:
+  case CURLE_SSL_CACERT_BADFILE: return FailureClass::tls;
+  case CURLE_ABORTED_BY_CALLBACK: return FailureClass::aborted;
+  default: return FailureClass::other;
+  }
+}
+
+inline bool host_failure(FailureClass c)
+{
+  return c == FailureClass::resolve || c == FailureClass::connect || c == FailureClass::timeout ||
+         c == FailureClass::tls;
+}
+
+// "scheme://[user@]host[:port]/..." -> "host[:port]"
+inline std::string_view url_host(std::string_view url)
+{
+  size_t scheme = url.find("://");
+  if (scheme != std::string_view::npos)
+    url.remove_prefix(scheme + 3);
+  url = url.substr(0, url.find_first_of("/?#"));
+  if (size_t at = url.rfind('@'); at != std::string_view::npos)
+    url.remove_prefix(at + 1);
+  return url;
+}
+
+class RetryPolicy
+{
+public:
+  // false if spec is malformed; the policy is then unchanged.
+  bool parse(std::string_view spec)
+  {
+    RetryPolicy p;
+    if (spec == "off")
+    {
+      *this = p;
+      return true;
+    }
+    p.enabled_ = true;
+    if (spec == "on")
+    {
+      *this = p;
+      return true;
+    }
+    bool ok = for_each_spec_item(spec, [&p](std::string_view key, std::string_view value) {
+      if (key == "attempts")
+        return parse_spec_number(value, p.attempts_) && p.attempts_ >= 1 && p.attempts_ <= 255;
+      if (key == "base")
+        return parse_spec_number(value, p.base_ms_) && p.base_ms_ > 0;
+      if (key == "cap")
+        return parse_spec_number(value, p.cap_ms_) && p.cap_ms_ > 0;
+      if (key == "breaker")
+        return parse_spec_number(value, p.breaker_failures_);
+      if (key == "open")
+        return parse_spec_number(value, p.open_ms_) && p.open_ms_ > 0;
+      if (key == "on")
+        return parse_classes(value, p.retry_mask_);
+      return false;
+    });
+    if (!ok)
+      return false;
+    *this = p;
+    return true;
+  }
+
+  bool enabled() const { return enabled_; }
+  uint32_t attempts() const { return attempts_; }
+  uint32_t breaker_failures() const { return breaker_failures_; }
+  std::chrono::milliseconds open_time() const { return std::chrono::milliseconds(open_ms_); }
+
+  // Another try after `attempt` tries failed this way?
+  bool retries(FailureClass c, uint32_t attempt) const
+  {
+    return enabled_ && attempt < attempts_ && (retry_mask_ >> static_cast<unsigned>(c) & 1);
+  }
+
+  template <typename Rng>
+  std::chrono::milliseconds backoff(uint32_t attempt, Rng &rng) const
+  {
+    uint64_t ceiling = base_ms_;
+    for (uint32_t i = 1; i < attempt && ceiling < cap_ms_; ++i)
+      ceiling *= 2;
+    ceiling = std::min<uint64_t>(ceiling, cap_ms_);
+    return std::chrono::milliseconds(std::uniform_int_distribution<uint64_t>(0, ceiling)(rng));
+  }
+
+private:
+  static constexpr uint32_t bit(FailureClass c) { return 1u << static_cast<unsigned>(c); }
+
+  static bool parse_classes(std::string_view value, uint32_t &mask)
+  {
+    mask = 0;
+    while (!value.empty())
+    {
+      std::string_view name = next_spec_token(value, "+");
+      bool known = false;
+      for (size_t i = 1; i < FAILURE_CLASSES; ++i)
+        if (name == FAILURE_CLASS_NAMES[i] && static_cast<FailureClass>(i) != FailureClass::aborted)
+        {
+          mask |= bit(static_cast<FailureClass>(i));
+          known = true;
+        }
+      if (!known)
+        return false;
+    }
+    return mask != 0;
+  }
+
+  bool enabled_ = false;
+  uint32_t attempts_ = 4;
+  uint32_t base_ms_ = 100;
+  uint32_t cap_ms_ = 5000;
+  uint32_t retry_mask_ = bit(FailureClass::resolve) | bit(FailureClass::connect) | bit(FailureClass::timeout);
+  uint32_t breaker_failures_ = 5;
+  uint32_t open_ms_ = 2000;
+};
+
+// Binary min-heap of retries by due time, FIFO among equal deadlines.
+template <typename T>
+class RetryQueue
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  void push(clock::time_point when, T value)
+  {
+    heap_.push_back({when, next_++, std::move(value)});
+    std::push_heap(heap_.begin(), heap_.end(), later);
+  }
+
+  std::optional<clock::time_point> next_deadline() const
+  {
+    if (heap_.empty())
+      return std::nullopt;
+    return heap_.front().when;
+  }
+
+  // fire(value) for every entry due by now, earliest first
+  template <typename Fire>
+  void pop_due(clock::time_point now, Fire &&fire)
+  {
+    while (!heap_.empty() && heap_.front().when <= now)
+    {
+      std::pop_heap(heap_.begin(), heap_.end(), later);
+      T value = std::move(heap_.back().value);
+      heap_.pop_back();
+      fire(std::move(value));
+    }
+  }
+
+  size_t size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+
+private:
+  struct Entry
+  {
+    clock::time_point when;
+    uint64_t seq;
+    T value;
+  };
+  static bool later(const Entry &a, const Entry &b) { return a.when != b.when ? a.when > b.when : a.seq > b.seq; }
+
+  std::vector<Entry> heap_;
+  uint64_t next_ = 0;
+};
+
+// Closed: transfers flow. Open: rejected until open_time() has passed, then
+// half-open: one probe goes through, and its outcome closes or reopens it.
+class CircuitBreaker
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit CircuitBreaker(const RetryPolicy &policy)
+      : threshold_(policy.enabled() ? policy.breaker_failures() : 0), open_time_(policy.open_time())
+  {
+  }
+
+  bool enabled() const { return threshold_ > 0; }
+
+  enum class Admission : uint8_t
+  {
+    rejected,
+    allowed,
+    probe, // the transfer carries the host's half-open probe
+  };
+
+  // May a transfer to host start now?
+  Admission allow(std::string_view host, clock::time_point now)
+  {
+    auto it = hosts_.find(host);
+    if (it == hosts_.end() || it->second.state == State::closed)
+      return Admission::allowed;
+    Host &h = it->second;
+    if (h.state == State::open && now < h.open_until)
+      return Admission::rejected;
+    if (h.state == State::half_open && h.probing)
+      return Admission::rejected;
+    h.state = State::half_open;
+    h.probing = true;
+    ++probes_;
+    return Admission::probe;
+  }
+
+  // A transfer to host finished this way. Once the breaker has tripped only
+  // the probe decides on it; transfers started before then are ignored. Our
+  // own progress abort says nothing about the host, so it is a cancel.
+  void record(std::string_view host, FailureClass failure, clock::time_point now, bool probe)
+  {
+    if (failure == FailureClass::aborted)
+      return abandon(host, probe);
+    auto it = hosts_.find(host);
+    if (it != hosts_.end() && it->second.state != State::closed && !probe)
+      return;
+    if (!host_failure(failure))
+    {
+      if (it != hosts_.end())
+        it->second = Host{};
+      return;
+    }
+    if (it == hosts_.end())
+      it = hosts_.emplace(std::string(host), Host{}).first;
+    Host &h = it->second;
+    ++h.failures;
+    if (h.state == State::half_open || (h.state == State::closed && h.failures >= threshold_))
+    {
+      h.state = State::open;
+      h.open_until = now + open_time_;
+      ++trips_;
+    }
+    h.probing = false;
+  }
+
+  // A transfer to host was cancelled before it finished: if it was the
+  // probe, the probe is owed to the next transfer.
+  void abandon(std::string_view host, bool probe)
+  {
+    if (!probe)
+      return;
+    if (auto it = hosts_.find(host); it != hosts_.end())
+      it->second.probing = false;
+  }
+
+  uint64_t trips() const { return trips_; }
+  uint64_t probes() const { return probes_; }
+
+private:
+  enum class State : uint8_t
+  {
+    closed,
+    open,
+    half_open,
+  };
+  struct Host
+  {
+    State state = State::closed;
+    bool probing = false; // half-open: the probe is in flight
+    uint32_t failures = 0; // in a row
+    clock::time_point open_until{};
+  };
+  struct Hash
+  {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+  };
+
+  const uint32_t threshold_;
+  const std::chrono::milliseconds open_time_;
+  std::unordered_map<std::string, Host, Hash, std::equal_to<>> hosts_;
+  uint64_t trips_ = 0;
+  uint64_t probes_ = 0;
+};
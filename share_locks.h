@@ -0,0 +1,125 @@
+// share_locks.h - lock callbacks for a CURLSH shared by all worker threads.
+// curl serialises each shared data type (DNS cache, connection pool, TLS
+// sessions, ...) through one lock, so there is one independent lock per
+// curl_lock_data, each on its own cache line. Either a reader/writer lock
+// (curl asks for shared access where it can) or a test-and-test-and-set
+// spinlock for short critical sections. Acquisitions that found the lock
+// taken are counted together with the time spent waiting.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <curl/curl.h>
+#include <shared_mutex>
+#include <thread>
+
+enum class ShareLockKind
+{
+  rwlock,
+  spin,
+};
+
+class ShareLocks
+{
+public:
+  struct Stats
+  {
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0; // had to wait
+    std::chrono::nanoseconds wait{0};
+  };
+
+  explicit ShareLocks(ShareLockKind kind) : kind_(kind) {}
+
+  ShareLocks(const ShareLocks &) = delete;
+  ShareLocks &operator=(const ShareLocks &) = delete;
+
+  void install(CURLSH *share)
+  {
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_cb);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+  }
+
+  Stats stats(curl_lock_data data) const
+  {
+    const Slot &s = slots_[data];
+    return {s.acquisitions.load(std::memory_order_relaxed), s.contended.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(s.wait_ns.load(std::memory_order_relaxed))};
+  }
+
+private:
+  struct alignas(64) Slot
+  {
+    std::shared_mutex rw;
+    std::atomic<bool> spin{false};
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+  };
+
+  // curl's unlock callback does not say how the lock was taken; remember it
+  // per thread. A thread holds at most one lock per data type at a time.
+  static std::array<bool, CURL_LOCK_DATA_LAST> &held_shared()
+  {
+    static thread_local std::array<bool, CURL_LOCK_DATA_LAST> held{};
+    return held;
+  }
+
+  bool try_lock(Slot &s, bool shared)
+  {
+    if (kind_ == ShareLockKind::spin)
+      return !s.spin.load(std::memory_order_relaxed) && !s.spin.exchange(true, std::memory_order_acquire);
+    return shared ? s.rw.try_lock_shared() : s.rw.try_lock();
+  }
+
+  void lock(Slot &s, bool shared)
+  {
+    if (kind_ == ShareLockKind::spin)
+    {
+      for (int spins = 0; !try_lock(s, shared); ++spins)
+        if (spins >= 64)
+          std::this_thread::yield();
+      return;
+    }
+    if (shared)
+      s.rw.lock_shared();
+    else
+      s.rw.lock();
+  }
+
+  static void lock_cb(CURL *, curl_lock_data data, curl_lock_access access, void *userptr)
+  {
+    auto *self = static_cast<ShareLocks *>(userptr);
+    Slot &s = self->slots_[data];
+    bool shared = access == CURL_LOCK_ACCESS_SHARED && self->kind_ == ShareLockKind::rwlock;
+    s.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (!self->try_lock(s, shared))
+    {
+      auto start = std::chrono::steady_clock::now();
+      self->lock(s, shared);
+      auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+      s.contended.fetch_add(1, std::memory_order_relaxed);
+      s.wait_ns.fetch_add(static_cast<uint64_t>(waited.count()), std::memory_order_relaxed);
+    }
+    held_shared()[data] = shared;
+  }
+
+  static void unlock_cb(CURL *, curl_lock_data data, void *userptr)
+  {
+    auto *self = static_cast<ShareLocks *>(userptr);
+    Slot &s = self->slots_[data];
+    if (self->kind_ == ShareLockKind::spin)
+      s.spin.store(false, std::memory_order_release);
+    else if (held_shared()[data])
+      s.rw.unlock_shared();
+    else
+      s.rw.unlock();
+  }
+
+  const ShareLockKind kind_;
+  std::array<Slot, CURL_LOCK_DATA_LAST> slots_;
+};
@@ -0,0 +1,425 @@
+// socket_faults.cpp - socket-level fault injection for resolver_interpose.
+// With RESOLVER_INTERPOSE_SOCKET set, the backend routes socket, connect,
+// recv/read, send/write and close here. Only TCP sockets created through the
+// hooked socket() are touched; every other descriptor (files, pipes, curl's
+// wakeup socketpair) passes straight through. Each call on a tracked socket
+// draws an outcome from its operation's weighted profile through the same
+// alias tables as the resolver's faults, and recv/send can be shaped by a
+// per-descriptor token bucket.
+//
+// Spec, entries separated like RESOLVER_INTERPOSE_PROFILE's:
+//   OP.OUTCOME=W        OP is connect, recv, send or close; OUTCOME is pass,
+//                       delay, eagain, short or reset (default pass only)
+//   OP.delay_ms=MIN-MAX injected delay (default 10-50)
+//   recv.rate=BYTES     per-descriptor bytes per second, K/M/G suffixes
+//   send.rate=BYTES
+//   burst=BYTES         token bucket depth (default 64K)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "alias_table.h"
+#include "resolver_interpose.h"
+
+socket_fn real_socket = nullptr;
+connect_fn real_connect = nullptr;
+recv_fn real_recv = nullptr;
+read_fn real_read = nullptr;
+send_fn real_send = nullptr;
+write_fn real_write = nullptr;
+close_fn real_close = nullptr;
+
+namespace
+{
+
+constexpr std::array<const char *, SOCKET_OPS> OP_NAMES = {"connect", "recv", "send", "close"};
+constexpr std::array<const char *, SOCKET_OUTCOMES> OUTCOME_NAMES = {"pass", "delay", "eagain", "short", "reset"};
+constexpr size_t MAX_TRACKED_FDS = size_t{1} << 20;
+constexpr int64_t NS = 1'000'000'000;
+constexpr int64_t MAX_BURST = int64_t{1} << 30; // keeps burst * NS within int64
+constexpr int64_t QUANTUM = 16 * 1024;          // smallest shaped transfer worth a wake-up
+
+struct OpProfile
+{
+  std::array<uint64_t, SOCKET_OUTCOMES> weights{1, 0, 0, 0, 0};
+  AliasTable<SOCKET_OUTCOMES> outcomes;
+  int delay_min_ms = 10;
+  int delay_max_ms = 50;
+  bool faulty = false; // an outcome other than pass has weight
+};
+
+// Credit is kept in byte-nanoseconds (bytes * NS), so refilling is one
+// multiply by the rate and no division runs on the I/O path.
+struct Bucket
+{
+  std::atomic<int64_t> credit{0};
+  std::atomic<uint64_t> stamp_ns{0}; // 0 = unused since the socket was made
+  std::atomic<uint64_t> ready_ns{0}; // non-blocking fds: EAGAIN until then
+};
+
+struct FdState
+{
+  std::atomic<bool> tracked{false};
+  Bucket buckets[2]; // recv, send
+};
+
+struct Config
+{
+  bool enabled = false;
+  std::array<OpProfile, SOCKET_OPS> ops{};
+  int64_t rate[2] = {0, 0}; // bytes per second, 0 = unshaped
+  int64_t burst = 64 * 1024;
+  int64_t fill_ns[2] = {0, 0}; // time to refill an empty bucket
+  FdState *fds = nullptr;      // indexed by descriptor, mmap'd and never freed
+  size_t fd_capacity = 0;
+};
+
+// Constant-initialised: hooks can run before any dynamic initialiser.
+constinit Config cfg{};
+
+uint64_t now_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * NS + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void sleep_ns(int64_t ns)
+{
+  timespec ts{static_cast<time_t>(ns / NS), static_cast<long>(ns % NS)};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+  {
+  }
+}
+
+bool parse_bytes(std::string_view text, int64_t &out)
+{
+  auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+  if (ec != std::errc{} || out < 0)
+    return false;
+  std::string_view suffix(ptr, static_cast<size_t>(text.data() + text.size() - ptr));
+  int shift = suffix.empty() ? 0 : suffix == "K" ? 10 : suffix == "M" ? 20 : suffix == "G" ? 30 : -1;
+  if (shift < 0 || out > (INT64_MAX >> shift))
+    return false;
+  out <<= shift;
+  return true;
+}
+
+bool apply_entry(std::string_view key, std::string_view value)
+{
+  if (key == "burst")
+    return parse_bytes(value, cfg.burst) && cfg.burst > 0 && cfg.burst <= MAX_BURST;
+  size_t dot = key.find('.');
+  if (dot == std::string_view::npos)
+    return false;
+  std::string_view op_name = key.substr(0, dot), field = key.substr(dot + 1);
+  auto op = std::find(OP_NAMES.begin(), OP_NAMES.end(), op_name);
+  if (op == OP_NAMES.end())
+    return false;
+  size_t index = static_cast<size_t>(op - OP_NAMES.begin());
+  OpProfile &p = cfg.ops[index];
+
+  if (field == "rate")
+  {
+    if (op_name != "recv" && op_name != "send")
+      return false;
+    return parse_bytes(value, cfg.rate[op_name == "send"]);
+  }
+  auto number = [](std::string_view text, auto &out) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+  };
+  if (field == "delay_ms")
+  {
+    size_t dash = value.find('-');
+    int lo = 0, hi = 0;
+    if (dash == std::string_view::npos || !number(value.substr(0, dash), lo) ||
+        !number(value.substr(dash + 1), hi) || lo < 0 || hi < lo)
+      return false;
+    p.delay_min_ms = lo;
+    p.delay_max_ms = hi;
+    return true;
+  }
+  auto outcome = std::find(OUTCOME_NAMES.begin(), OUTCOME_NAMES.end(), field);
+  uint64_t weight = 0;
+  if (outcome == OUTCOME_NAMES.end() || !number(value, weight))
+    return false;
+  p.weights[static_cast<size_t>(outcome - OUTCOME_NAMES.begin())] = weight;
+  return true;
+}
+
+FdState *tracked(int fd)
+{
+  if (!cfg.enabled || fd < 0 || static_cast<size_t>(fd) >= cfg.fd_capacity)
+    return nullptr;
+  FdState &s = cfg.fds[fd];
+  return s.tracked.load(std::memory_order_relaxed) ? &s : nullptr;
+}
+
+SocketOutcome draw(SocketOp op, int &delay_ms)
+{
+  const OpProfile &p = cfg.ops[static_cast<size_t>(op)];
+  delay_ms = 0;
+  if (!p.faulty)
+    return SocketOutcome::pass;
+  auto outcome = static_cast<SocketOutcome>(p.outcomes.sample(fault_random()));
+  if (outcome == SocketOutcome::delay)
+  {
+    auto span = static_cast<uint64_t>(p.delay_max_ms - p.delay_min_ms + 1);
+    delay_ms = p.delay_min_ms + static_cast<int>(fault_random() % span);
+  }
+  telemetry_socket(op, outcome, static_cast<uint64_t>(delay_ms) * 1000);
+  return outcome;
+}
+
+// Grant up to want bytes from the bucket once it holds at least
+// min(want, QUANTUM), so a drained bucket does not degrade into one-byte
+// calls. Until then a blocking fd sleeps, while a non-blocking one gets 0
+// (EAGAIN) up to a deadline: sleeping there would stall every other
+// transfer its thread drives. The caller charges what was transferred.
+size_t take(int fd, Bucket &b, size_t dir, size_t want)
+{
+  const int64_t rate = cfg.rate[dir];
+  const int64_t cap = cfg.burst * NS;
+  uint64_t now = now_ns();
+  if (b.ready_ns.load(std::memory_order_relaxed) > now)
+    return 0;
+  uint64_t stamp = b.stamp_ns.load(std::memory_order_relaxed);
+  int64_t credit = cap;
+  if (stamp != 0)
+  {
+    auto elapsed = static_cast<int64_t>(std::min<uint64_t>(now - stamp, static_cast<uint64_t>(cfg.fill_ns[dir])));
+    credit = std::min(cap, b.credit.load(std::memory_order_relaxed) + elapsed * rate);
+  }
+  int64_t need = std::min<int64_t>(static_cast<int64_t>(std::min<size_t>(want, QUANTUM)), cfg.burst) * NS;
+  if (credit < need)
+  {
+    int64_t wait = (need - credit + rate - 1) / rate;
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && (flags & O_NONBLOCK))
+    {
+      b.ready_ns.store(now + static_cast<uint64_t>(wait), std::memory_order_relaxed);
+      telemetry_shaping(static_cast<uint64_t>(wait / 1000));
+      return 0;
+    }
+    sleep_ns(wait);
+    telemetry_shaping(static_cast<uint64_t>(wait / 1000));
+    now += static_cast<uint64_t>(wait);
+    credit = need;
+  }
+  b.credit.store(credit, std::memory_order_relaxed);
+  b.stamp_ns.store(now, std::memory_order_relaxed);
+  return std::min<size_t>(want, static_cast<size_t>(credit / NS));
+}
+
+void charge(Bucket &b, ssize_t bytes)
+{
+  if (bytes > 0)
+    b.credit.store(b.credit.load(std::memory_order_relaxed) - bytes * NS, std::memory_order_relaxed);
+}
+
+// The fault and shaping path shared by recv/read (dir 0) and send/write
+// (dir 1); call(length) performs the real operation.
+template <typename Call>
+ssize_t faulty_io(int fd, size_t length, size_t dir, Call &&call)
+{
+  FdState *s = tracked(fd);
+  if (!s)
+    return call(length);
+  int delay_ms = 0;
+  switch (draw(dir ? SocketOp::send : SocketOp::recv, delay_ms))
+  {
+  case SocketOutcome::delay:
+    sleep_ns(int64_t{delay_ms} * 1'000'000);
+    break;
+  case SocketOutcome::eagain:
+    errno = EAGAIN;
+    return -1;
+  case SocketOutcome::short_io:
+    if (length > 1)
+      length = 1 + static_cast<size_t>(fault_random() % (length / 2));
+    break;
+  case SocketOutcome::reset:
+    errno = ECONNRESET;
+    return -1;
+  case SocketOutcome::pass:
+    break;
+  }
+  if (cfg.rate[dir] == 0 || length == 0)
+    return call(length);
+  Bucket &b = s->buckets[dir];
+  size_t granted = take(fd, b, dir, length);
+  if (granted == 0)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  ssize_t n = call(granted);
+  charge(b, n);
+  return n;
+}
+
+} // namespace
+
+const char *socket_op_name(size_t op) { return OP_NAMES[op]; }
+
+extern "C" void resolver_interpose_untrack(int fd)
+{
+  if (FdState *s = tracked(fd))
+    s->tracked.store(false, std::memory_order_relaxed);
+}
+const char *socket_outcome_name(size_t outcome) { return OUTCOME_NAMES[outcome]; }
+
+void socket_faults_configure()
+{
+  const char *spec = std::getenv("RESOLVER_INTERPOSE_SOCKET");
+  if (!spec || !*spec)
+    return;
+  for_each_spec_entry(spec, [](std::string_view entry, std::string_view key, std::string_view value) {
+    if (!apply_entry(key, value))
+      log_interposer("[socket] ignoring invalid entry '", entry, "'");
+  });
+
+  bool active = false;
+  for (OpProfile &p : cfg.ops)
+  {
+    p.outcomes = AliasTable<SOCKET_OUTCOMES>(p.weights);
+    if (!p.outcomes.valid())
+      p.outcomes = AliasTable<SOCKET_OUTCOMES>(p.weights = {1, 0, 0, 0, 0});
+    p.faulty = std::any_of(p.weights.begin() + 1, p.weights.end(), [](uint64_t w) { return w > 0; });
+    active |= p.faulty;
+  }
+  for (size_t dir = 0; dir < 2; ++dir)
+  {
+    if (cfg.rate[dir] > 0)
+      cfg.fill_ns[dir] = cfg.burst * NS / cfg.rate[dir] + 1;
+    active |= cfg.rate[dir] > 0;
+  }
+  if (!active)
+    return;
+
+  rlimit limit{};
+  size_t capacity = MAX_TRACKED_FDS;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    capacity = std::min<size_t>(capacity, static_cast<size_t>(limit.rlim_cur));
+  // Untouched pages stay unbacked, so the table costs what the fds in use touch
+  void *table = mmap(nullptr, capacity * sizeof(FdState), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (table == MAP_FAILED)
+  {
+    log_interposer("[socket] fd table mmap failed, socket faults disabled");
+    return;
+  }
+  cfg.fds = static_cast<FdState *>(table); // zero pages are valid, untracked FdStates
+  cfg.fd_capacity = capacity;
+  cfg.enabled = true;
+  for (size_t op = 0; op < SOCKET_OPS; ++op)
+  {
+    const OpProfile &p = cfg.ops[op];
+    log_interposer("[socket] ", OP_NAMES[op], " pass=", p.weights[0], " delay=", p.weights[1], " eagain=",
+                   p.weights[2], " short=", p.weights[3], " reset=", p.weights[4], " delay_ms=", p.delay_min_ms, "-",
+                   p.delay_max_ms);
+  }
+  log_interposer("[socket] recv.rate=", cfg.rate[0], " send.rate=", cfg.rate[1], " burst=", cfg.burst,
+                 " fds=", capacity);
+}
+
+int hook_socket(int domain, int type, int protocol)
+{
+  int fd = real_socket(domain, type, protocol);
+  if (fd < 0 || !cfg.enabled || static_cast<size_t>(fd) >= cfg.fd_capacity)
+    return fd;
+  int base_type = type;
+#ifdef SOCK_NONBLOCK
+  base_type &= ~(SOCK_NONBLOCK | SOCK_CLOEXEC);
+#endif
+  if ((domain == AF_INET || domain == AF_INET6) && base_type == SOCK_STREAM)
+  {
+    FdState &s = cfg.fds[fd];
+    for (Bucket &b : s.buckets)
+    {
+      b.credit.store(0, std::memory_order_relaxed);
+      b.stamp_ns.store(0, std::memory_order_relaxed);
+      b.ready_ns.store(0, std::memory_order_relaxed);
+    }
+    s.tracked.store(true, std::memory_order_relaxed);
+  }
+  return fd;
+}
+
+int hook_connect(int fd, const struct sockaddr *addr, socklen_t length)
+{
+  if (tracked(fd))
+  {
+    int delay_ms = 0;
+    switch (draw(SocketOp::connect, delay_ms))
+    {
+    case SocketOutcome::delay:
+      sleep_ns(int64_t{delay_ms} * 1'000'000);
+      break;
+    case SocketOutcome::eagain: // what Linux reports when it is out of local ports
+      errno = EAGAIN;
+      return -1;
+    case SocketOutcome::reset:
+      errno = ECONNREFUSED;
+      return -1;
+    case SocketOutcome::pass:
+    case SocketOutcome::short_io:
+      break;
+    }
+  }
+  return real_connect(fd, addr, length);
+}
+
+ssize_t hook_recv(int fd, void *buf, size_t length, int flags)
+{
+  return faulty_io(fd, length, 0, [&](size_t n) { return real_recv(fd, buf, n, flags); });
+}
+
+ssize_t hook_read(int fd, void *buf, size_t length)
+{
+  return faulty_io(fd, length, 0, [&](size_t n) { return real_read(fd, buf, n); });
+}
+
+ssize_t hook_send(int fd, const void *buf, size_t length, int flags)
+{
+  return faulty_io(fd, length, 1, [&](size_t n) { return real_send(fd, buf, n, flags); });
+}
+
+ssize_t hook_write(int fd, const void *buf, size_t length)
+{
+  return faulty_io(fd, length, 1, [&](size_t n) { return real_write(fd, buf, n); });
+}
+
+// delay holds the descriptor open a while longer; reset makes the kernel
+// answer the peer with a RST instead of a FIN.
+int hook_close(int fd)
+{
+  if (FdState *s = tracked(fd))
+  {
+    int delay_ms = 0;
+    SocketOutcome outcome = draw(SocketOp::close, delay_ms);
+    if (outcome == SocketOutcome::delay)
+    {
+      sleep_ns(int64_t{delay_ms} * 1'000'000);
+    }
+    else if (outcome == SocketOutcome::reset)
+    {
+      linger abortive{1, 0};
+      setsockopt(fd, SOL_SOCKET, SO_LINGER, &abortive, sizeof(abortive));
+    }
+    // untrack first: once closed, socket() may hand the number out again
+    s->tracked.store(false, std::memory_order_relaxed);
+  }
+  return real_close(fd);
+}
@@ -0,0 +1,121 @@
+// socket_util.h - socket(), socketpair() and accept() that return close-on-exec
+// descriptors that never raise SIGPIPE, on Linux and macOS alike. macOS has
+// neither SOCK_CLOEXEC nor accept4 nor MSG_NOSIGNAL, so the flags are set with
+// fcntl and SO_NOSIGPIPE there; send with SEND_NOSIGNAL either way. These are
+// crasher's own sockets, so they are kept out of the interposer's socket
+// faults, and their addresses are numeric so opening one never goes through
+// the faulted getaddrinfo.
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstdint>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+inline constexpr int SEND_NOSIGNAL = MSG_NOSIGNAL;
+#else
+inline constexpr int SEND_NOSIGNAL = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+// fd, now close-on-exec and SIGPIPE-free; closed and -1 on failure or fd < 0
+inline int socket_setup(int fd)
+{
+  if (fd < 0)
+    return -1;
+  int flags = fcntl(fd, F_GETFD);
+  bool ok = flags >= 0 && fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == 0;
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  ok = ok && setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one)) == 0;
+#endif
+  if (!ok)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+inline int cloexec_socket(int family, int type, int protocol)
+{
+  int fd = socket_setup(socket(family, type, protocol));
+  using untrack_fn = void (*)(int);
+  static const auto untrack = reinterpret_cast<untrack_fn>(dlsym(RTLD_DEFAULT, "resolver_interpose_untrack"));
+  if (fd >= 0 && untrack)
+    untrack(fd);
+  return fd;
+}
+
+inline int cloexec_socketpair(int family, int type, int fds[2])
+{
+  if (socketpair(family, type, 0, fds) != 0)
+    return -1;
+  fds[0] = socket_setup(fds[0]);
+  fds[1] = socket_setup(fds[1]);
+  if (fds[0] >= 0 && fds[1] >= 0)
+    return 0;
+  if (fds[0] >= 0)
+    close(fds[0]);
+  if (fds[1] >= 0)
+    close(fds[1]);
+  return -1;
+}
+
+inline int cloexec_accept(int listen_fd)
+{
+  return socket_setup(accept(listen_fd, nullptr, nullptr));
+}
+
+// "PORT", "HOST:PORT" or "[V6]:PORT" with a numeric HOST; no HOST is any
+// IPv4 address. False with error set if spec is malformed.
+inline bool parse_numeric_address(std::string_view spec, sockaddr_storage &address, socklen_t &length,
+                                  std::string &error)
+{
+  std::string host;
+  std::string_view port = spec;
+  if (size_t colon = spec.rfind(':'); colon != std::string_view::npos)
+  {
+    host = spec.substr(0, colon);
+    port = spec.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+      host = host.substr(1, host.size() - 2);
+  }
+  uint16_t number = 0;
+  auto [end, ec] = std::from_chars(port.data(), port.data() + port.size(), number);
+  if (ec != std::errc{} || end != port.data() + port.size())
+  {
+    error = std::string(spec) + ": bad port";
+    return false;
+  }
+  address = {};
+  auto *v4 = reinterpret_cast<sockaddr_in *>(&address);
+  auto *v6 = reinterpret_cast<sockaddr_in6 *>(&address);
+  if (host.empty() || inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+  {
+    v4->sin_family = AF_INET;
+    v4->sin_port = htons(number);
+    if (host.empty())
+      v4->sin_addr.s_addr = htonl(INADDR_ANY);
+    length = sizeof(*v4);
+  }
+  else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+  {
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port = htons(number);
+    length = sizeof(*v6);
+  }
+  else
+  {
+    error = std::string(spec) + ": host must be a numeric address";
+    return false;
+  }
+  return true;
+}
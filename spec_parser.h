@@ -0,0 +1,42 @@
+// spec_parser.h - the pieces crasher's option and environment parsers share:
+// splitting a list into tokens, splitting "key=value,key=value" into items
+// and reading a plain number. Each parser keeps its own keys and its
+// "off"/"on" words.
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+// Removes and returns spec's first token, ended by any of seps
+inline std::string_view next_spec_token(std::string_view &spec, std::string_view seps)
+{
+  size_t at = spec.find_first_of(seps);
+  std::string_view token = spec.substr(0, at);
+  spec = at == std::string_view::npos ? std::string_view{} : spec.substr(at + 1);
+  return token;
+}
+
+// Calls item(key, value) for each comma-separated key=value entry; false on
+// an entry without '=' or as soon as item returns false.
+template <typename Item>
+bool for_each_spec_item(std::string_view spec, Item &&item)
+{
+  while (!spec.empty())
+  {
+    std::string_view entry = next_spec_token(spec, ",");
+    size_t eq = entry.find('=');
+    if (eq == std::string_view::npos || !item(entry.substr(0, eq), entry.substr(eq + 1)))
+      return false;
+  }
+  return true;
+}
+
+// All of value, in decimal
+template <typename T>
+bool parse_spec_number(std::string_view value, T &out)
+{
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+  return ec == std::errc{} && ptr == value.data() + value.size();
+}
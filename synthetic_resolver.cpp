@@ -0,0 +1,512 @@
+// synthetic_resolver.cpp - in-memory getaddrinfo for resolver_interpose.
+// With RESOLVER_INTERPOSE_SYNTHETIC set, lookups that pass the fault
+// profile are answered from a preloaded host table (or generated addresses)
+// instead of the system resolver. Answers are carved from one mmap'd arena
+// of fixed-size slots, so the hooked freeaddrinfo recognises its own chains
+// by address and recycles the slot through a per-thread cache.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+#include "prng.h"
+#include "resolver_interpose.h"
+#include "spec_parser.h"
+
+namespace
+{
+
+constexpr size_t MAX_ADDRS = 16;          // per answer
+constexpr size_t DEFAULT_SLOTS = 65536;   // concurrent live answers
+constexpr size_t THREAD_CACHE_SLOTS = 64; // per-thread free slots before spilling
+
+#ifdef EAI_ADDRFAMILY
+constexpr int WRONG_FAMILY = EAI_ADDRFAMILY;
+#else
+constexpr int WRONG_FAMILY = EAI_NONAME;
+#endif
+
+struct SynthAddr
+{
+  int family;
+  union
+  {
+    in_addr v4;
+    in6_addr v6;
+  };
+};
+
+// One answer; ai[0] is the head handed to the caller.
+struct Slot
+{
+  addrinfo ai[MAX_ADDRS];
+  sockaddr_in6 addr[MAX_ADDRS]; // large enough for either family
+  char canon[256];
+};
+
+struct HostHash
+{
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+};
+
+struct Config
+{
+  bool enabled = false;
+  size_t v4 = 1; // generated addresses per family for hosts not in the table
+  size_t v6 = 1;
+  bool v6_first = false;
+  bool unknown_noname = false; // hosts not in the table fail with EAI_NONAME
+  std::unordered_map<std::string, std::vector<SynthAddr>, HostHash, std::equal_to<>> hosts;
+};
+
+// Filled from the interposer's constructor, which may run before this
+// file's dynamic initialisers; hence a function-local static.
+Config &config()
+{
+  static Config c;
+  return c;
+}
+
+// ---- arena ----
+Slot *arena = nullptr;
+size_t arena_slots = 0;
+// Global free pool, refilled from thread caches. Leaked: resolver threads
+// can still exit (and spill their caches) during static destruction. When it
+// runs dry, alloc_slot steals from the other threads' caches before failing, so
+// every cache is listed here. Lock order: the pool, then a cache.
+struct SlotCache;
+
+struct FreePool
+{
+  std::mutex mutex;
+  std::vector<uint32_t> slots;
+  SlotCache *caches = nullptr;
+};
+
+FreePool &free_pool()
+{
+  static FreePool *pool = new FreePool;
+  return *pool;
+}
+
+struct SlotCache
+{
+  std::mutex mutex; // uncontended except while another thread steals
+  uint32_t slots[THREAD_CACHE_SLOTS];
+  size_t count = 0;
+  SlotCache *prev = nullptr, *next = nullptr;
+
+  SlotCache()
+  {
+    FreePool &pool = free_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    next = pool.caches;
+    if (next)
+      next->prev = this;
+    pool.caches = this;
+  }
+
+  // Resolver threads are short-lived; hand their slots back on exit.
+  ~SlotCache()
+  {
+    FreePool &pool = free_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    (prev ? prev->next : pool.caches) = next;
+    if (next)
+      next->prev = prev;
+    std::lock_guard<std::mutex> own(mutex);
+    pool.slots.insert(pool.slots.end(), slots, slots + count);
+  }
+};
+
+thread_local SlotCache slot_cache;
+
+// Moves half of every other cache (at least one slot) into the pool; under pool.mutex
+void steal_slots(FreePool &pool, const SlotCache *self)
+{
+  for (SlotCache *c = pool.caches; c; c = c->next)
+  {
+    if (c == self)
+      continue;
+    std::lock_guard<std::mutex> lock(c->mutex);
+    size_t take = (c->count + 1) / 2;
+    pool.slots.insert(pool.slots.end(), c->slots + c->count - take, c->slots + c->count);
+    c->count -= take;
+  }
+}
+
+Slot *alloc_slot()
+{
+  SlotCache &cache = slot_cache;
+  {
+    std::lock_guard<std::mutex> own(cache.mutex);
+    if (cache.count > 0)
+      return &arena[cache.slots[--cache.count]];
+  }
+  FreePool &pool = free_pool();
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  if (pool.slots.empty())
+    steal_slots(pool, &cache);
+  std::lock_guard<std::mutex> own(cache.mutex);
+  size_t take = std::min(pool.slots.size(), THREAD_CACHE_SLOTS / 2);
+  std::copy(pool.slots.end() - static_cast<ptrdiff_t>(take), pool.slots.end(), cache.slots + cache.count);
+  pool.slots.resize(pool.slots.size() - take);
+  cache.count += take;
+  if (cache.count == 0)
+    return nullptr;
+  return &arena[cache.slots[--cache.count]];
+}
+
+void free_slot(uint32_t index)
+{
+  SlotCache &cache = slot_cache;
+  {
+    std::lock_guard<std::mutex> own(cache.mutex);
+    if (cache.count < THREAD_CACHE_SLOTS)
+    {
+      cache.slots[cache.count++] = index;
+      return;
+    }
+  }
+  FreePool &pool = free_pool();
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  std::lock_guard<std::mutex> own(cache.mutex);
+  size_t spill = cache.count == THREAD_CACHE_SLOTS ? THREAD_CACHE_SLOTS / 2 : 0; // unless stolen from meanwhile
+  pool.slots.insert(pool.slots.end(), cache.slots + cache.count - spill, cache.slots + cache.count);
+  cache.count -= spill;
+  cache.slots[cache.count++] = index;
+}
+
+bool map_arena(size_t slots)
+{
+  void *mem = mmap(nullptr, slots * sizeof(Slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (mem == MAP_FAILED)
+    return false;
+  arena = static_cast<Slot *>(mem);
+  arena_slots = slots;
+  FreePool &pool = free_pool();
+  pool.slots.reserve(slots);
+  for (size_t i = slots; i-- > 0;)
+    pool.slots.push_back(static_cast<uint32_t>(i));
+  return true;
+}
+
+// ---- configuration ----
+size_t env_count(const char *name, size_t fallback)
+{
+  const char *value = std::getenv(name);
+  if (!value || !*value)
+    return fallback;
+  size_t out = fallback;
+  auto [ptr, ec] = std::from_chars(value, value + std::strlen(value), out);
+  return ec == std::errc{} && *ptr == '\0' ? out : fallback;
+}
+
+bool parse_addr(std::string_view text, SynthAddr &out)
+{
+  char buf[INET6_ADDRSTRLEN];
+  if (text.size() >= sizeof(buf))
+    return false;
+  std::memcpy(buf, text.data(), text.size());
+  buf[text.size()] = '\0';
+  if (inet_pton(AF_INET, buf, &out.v4) == 1)
+  {
+    out.family = AF_INET;
+    return true;
+  }
+  if (inet_pton(AF_INET6, buf, &out.v6) == 1)
+  {
+    out.family = AF_INET6;
+    return true;
+  }
+  return false;
+}
+
+// "v4=N,v6=N,order=v4|v6,unknown=synth|noname"; "1" keeps the defaults.
+void parse_mode(std::string_view spec)
+{
+  while (!spec.empty())
+  {
+    std::string_view entry = next_spec_token(spec, ",; ");
+    if (entry.empty() || entry == "1")
+      continue;
+
+    size_t eq = entry.find('=');
+    std::string_view key = entry.substr(0, eq);
+    std::string_view value = eq == std::string_view::npos ? std::string_view{} : entry.substr(eq + 1);
+    size_t n = 0;
+    bool numeric = parse_spec_number(value, n);
+    if (key == "v4" && numeric)
+      config().v4 = n;
+    else if (key == "v6" && numeric)
+      config().v6 = n;
+    else if (key == "order" && (value == "v4" || value == "v6"))
+      config().v6_first = value == "v6";
+    else if (key == "unknown" && (value == "synth" || value == "noname"))
+      config().unknown_noname = value == "noname";
+    else
+      log_interposer("[synthetic] ignoring invalid entry '", entry, "'");
+  }
+  if (config().v4 + config().v6 > MAX_ADDRS)
+  {
+    config().v6 = std::min(config().v6, MAX_ADDRS);
+    config().v4 = MAX_ADDRS - config().v6;
+  }
+}
+
+// /etc/hosts format: "address name [name...]", '#' starts a comment. A name
+// listed on several lines gets a multi-address answer in file order.
+void load_hosts(const char *path)
+{
+  FILE *f = std::fopen(path, "r");
+  if (!f)
+  {
+    log_interposer("[synthetic] cannot read ", path);
+    return;
+  }
+  char line[1024];
+  while (std::fgets(line, sizeof(line), f))
+  {
+    std::string_view rest(line);
+    rest = rest.substr(0, rest.find('#'));
+    auto next_word = [&rest] {
+      size_t start = rest.find_first_not_of(" \t\r\n");
+      if (start == std::string_view::npos)
+        return std::string_view{};
+      size_t end = rest.find_first_of(" \t\r\n", start);
+      std::string_view word = rest.substr(start, end - start);
+      rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end);
+      return word;
+    };
+
+    std::string_view addr_text = next_word();
+    SynthAddr addr{};
+    if (addr_text.empty())
+      continue;
+    if (!parse_addr(addr_text, addr))
+    {
+      log_interposer("[synthetic] bad address '", addr_text, "'");
+      continue;
+    }
+    for (std::string_view name = next_word(); !name.empty(); name = next_word())
+    {
+      auto &list = config().hosts[std::string(name)];
+      if (list.size() < MAX_ADDRS)
+        list.push_back(addr);
+    }
+  }
+  std::fclose(f);
+}
+
+// ---- answers ----
+// Generated answers come from the benchmarking ranges 198.18.0.0/15
+// (RFC 2544) and 2001:2::/48 (RFC 5180), so nothing real is ever reached.
+size_t generate(std::string_view host, int family, SynthAddr *out)
+{
+  uint32_t h = fnv1a32(host);
+  size_t n = 0;
+  auto add_v4 = [&] {
+    for (size_t i = 0; i < config().v4; ++i)
+    {
+      uint32_t ip = (198u << 24) | (18u << 16) | ((h + static_cast<uint32_t>(i)) & 0x1FFFF);
+      out[n].family = AF_INET;
+      out[n].v4.s_addr = htonl(ip);
+      ++n;
+    }
+  };
+  auto add_v6 = [&] {
+    for (size_t i = 0; i < config().v6; ++i)
+    {
+      out[n].family = AF_INET6;
+      std::memset(&out[n].v6, 0, sizeof(in6_addr));
+      const uint8_t prefix[6] = {0x20, 0x01, 0x00, 0x02, 0x00, 0x00};
+      std::memcpy(out[n].v6.s6_addr, prefix, sizeof(prefix));
+      uint32_t low = h + static_cast<uint32_t>(i);
+      std::memcpy(out[n].v6.s6_addr + 12, &low, sizeof(low));
+      ++n;
+    }
+  };
+  bool want_v4 = family != AF_INET6;
+  bool want_v6 = family != AF_INET;
+  if (config().v6_first && want_v6)
+    add_v6();
+  if (want_v4)
+    add_v4();
+  if (!config().v6_first && want_v6)
+    add_v6();
+  return n;
+}
+
+int parse_port(const char *service, const addrinfo *hints, uint16_t &port)
+{
+  port = 0;
+  if (!service)
+    return 0;
+  unsigned value = 0;
+  size_t len = std::strlen(service);
+  auto [ptr, ec] = std::from_chars(service, service + len, value);
+  if (ec == std::errc{} && ptr == service + len && value <= 65535)
+  {
+    port = static_cast<uint16_t>(value);
+    return 0;
+  }
+  if (hints && (hints->ai_flags & AI_NUMERICSERV))
+    return EAI_NONAME;
+  std::string_view name(service, len);
+  if (name == "http")
+    port = 80;
+  else if (name == "https")
+    port = 443;
+  else
+    return EAI_SERVICE; // the synthetic resolver has no services database
+  return 0;
+}
+
+} // namespace
+
+bool synthetic_enabled() { return config().enabled; }
+
+void synthetic_configure()
+{
+  const char *mode = std::getenv("RESOLVER_INTERPOSE_SYNTHETIC");
+  if (!mode || !*mode || std::string_view(mode) == "0")
+    return;
+  parse_mode(mode);
+  if (const char *hosts = std::getenv("RESOLVER_INTERPOSE_HOSTS_FILE"); hosts && *hosts)
+    load_hosts(hosts);
+
+  size_t slots = std::clamp<size_t>(env_count("RESOLVER_INTERPOSE_SYNTHETIC_SLOTS", DEFAULT_SLOTS), 1, UINT32_MAX);
+  if (!map_arena(slots))
+  {
+    log_interposer("[synthetic] arena mmap failed, using the real resolver");
+    return;
+  }
+  config().enabled = true;
+  log_interposer("[synthetic] v4=", config().v4, " v6=", config().v6, " order=", (config().v6_first ? "v6" : "v4"),
+                 " unknown=", (config().unknown_noname ? "noname" : "synth"), " hosts=", config().hosts.size(),
+                 " slots=", arena_slots);
+}
+
+int synthetic_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                          struct addrinfo **res)
+{
+  int family = hints ? hints->ai_family : AF_UNSPEC;
+  int flags = hints ? hints->ai_flags : 0;
+  if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+    return EAI_FAMILY;
+  if (!node && !service)
+    return EAI_NONAME;
+
+  uint16_t port = 0;
+  if (int err = parse_port(service, hints, port); err != 0)
+    return err;
+
+  SynthAddr addrs[MAX_ADDRS];
+  size_t count = 0;
+  if (!node)
+  {
+    // wildcard for AI_PASSIVE, loopback otherwise
+    bool passive = flags & AI_PASSIVE;
+    if (family != AF_INET6)
+    {
+      addrs[count].family = AF_INET;
+      addrs[count++].v4.s_addr = htonl(passive ? INADDR_ANY : INADDR_LOOPBACK);
+    }
+    if (family != AF_INET)
+    {
+      addrs[count].family = AF_INET6;
+      addrs[count++].v6 = passive ? in6addr_any : in6addr_loopback;
+    }
+  }
+  else if (SynthAddr literal{}; parse_addr(node, literal))
+  {
+    if (family != AF_UNSPEC && family != literal.family)
+      return WRONG_FAMILY;
+    addrs[count++] = literal;
+  }
+  else if (flags & AI_NUMERICHOST)
+  {
+    return EAI_NONAME;
+  }
+  else if (auto it = config().hosts.find(std::string_view(node)); it != config().hosts.end())
+  {
+    for (const SynthAddr &a : it->second)
+      if (family == AF_UNSPEC || family == a.family)
+        addrs[count++] = a;
+  }
+  else if (!config().unknown_noname)
+  {
+    count = generate(node, family, addrs);
+  }
+  if (count == 0)
+    return EAI_NONAME;
+
+  Slot *slot = alloc_slot();
+  if (!slot)
+    return EAI_MEMORY;
+
+  int socktype = hints && hints->ai_socktype ? hints->ai_socktype : SOCK_STREAM;
+  int protocol = hints && hints->ai_protocol ? hints->ai_protocol
+                 : socktype == SOCK_DGRAM   ? IPPROTO_UDP
+                                            : IPPROTO_TCP;
+  for (size_t i = 0; i < count; ++i)
+  {
+    addrinfo &ai = slot->ai[i];
+    std::memset(&ai, 0, sizeof(ai));
+    std::memset(&slot->addr[i], 0, sizeof(slot->addr[i]));
+    ai.ai_family = addrs[i].family;
+    ai.ai_socktype = socktype;
+    ai.ai_protocol = protocol;
+    if (addrs[i].family == AF_INET)
+    {
+      auto *sin = reinterpret_cast<sockaddr_in *>(&slot->addr[i]);
+      sin->sin_family = AF_INET;
+      sin->sin_port = htons(port);
+      sin->sin_addr = addrs[i].v4;
+      ai.ai_addrlen = sizeof(sockaddr_in);
+    }
+    else
+    {
+      sockaddr_in6 *sin6 = &slot->addr[i];
+      sin6->sin6_family = AF_INET6;
+      sin6->sin6_port = htons(port);
+      sin6->sin6_addr = addrs[i].v6;
+      ai.ai_addrlen = sizeof(sockaddr_in6);
+    }
+#ifdef __APPLE__
+    reinterpret_cast<sockaddr *>(&slot->addr[i])->sa_len = static_cast<uint8_t>(ai.ai_addrlen);
+#endif
+    ai.ai_addr = reinterpret_cast<sockaddr *>(&slot->addr[i]);
+    ai.ai_next = i + 1 < count ? &slot->ai[i + 1] : nullptr;
+  }
+  if ((flags & AI_CANONNAME) && node)
+  {
+    std::snprintf(slot->canon, sizeof(slot->canon), "%s", node);
+    slot->ai[0].ai_canonname = slot->canon;
+  }
+  *res = &slot->ai[0];
+  return 0;
+}
+
+bool synthetic_freeaddrinfo(struct addrinfo *ai)
+{
+  auto *p = reinterpret_cast<const char *>(ai);
+  auto *base = reinterpret_cast<const char *>(arena);
+  if (!arena || p < base || p >= base + arena_slots * sizeof(Slot))
+    return false;
+  free_slot(static_cast<uint32_t>(static_cast<size_t>(p - base) / sizeof(Slot)));
+  return true;
+}
@@ -0,0 +1,137 @@
+// teardown_bench.h - the --teardown benchmark's plan and what each trial
+// reports. A trial is a forked child that fills its workers' multi handles
+// with transfers, drives them until their resolves are under way, then shuts
+// down the way a deploy would: remove and clean up every handle,
+// curl_multi_cleanup, join the workers, curl_global_cleanup, exit. The child
+// sends a TeardownSample up a pipe before it exits; the parent adds the exit
+// time and the wait status.
+//
+// Spec: "off", "on", or comma-separated key=value entries, all optional:
+//   inflight=N                  transfers in flight across all workers (default 1000)
+//   quick_exit=on|off|both      CURLOPT_QUICK_EXIT on every handle (default both)
+//   cleanup=serial|parallel|both  who tears the multis down: the main thread one
+//                               after another, or each worker its own (default both)
+//   trials=N                    trials per combination (default 3)
+//   settle=MS                   how long the workers drive before teardown (default 200)
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+#include "spec_parser.h"
+
+enum class TeardownCleanup : uint8_t
+{
+  serial,   // the main thread cleans up every worker's handles and multi in turn
+  parallel, // every worker cleans up its own before it is joined
+};
+
+inline constexpr const char *TEARDOWN_CLEANUP_NAMES[] = {"serial", "parallel"};
+
+class TeardownPlan
+{
+public:
+  struct Variant
+  {
+    bool quick_exit;
+    TeardownCleanup cleanup;
+  };
+
+  // false if spec is malformed; the plan is then unchanged.
+  bool parse(std::string_view spec)
+  {
+    TeardownPlan p;
+    if (spec == "off")
+    {
+      *this = p;
+      return true;
+    }
+    p.enabled_ = true;
+    if (spec == "on")
+    {
+      *this = p;
+      return true;
+    }
+    bool ok = for_each_spec_item(spec, [&p](std::string_view key, std::string_view value) {
+      if (key == "inflight")
+        return parse_spec_number(value, p.inflight_) && p.inflight_ > 0;
+      if (key == "trials")
+        return parse_spec_number(value, p.trials_) && p.trials_ > 0;
+      if (key == "settle")
+        return parse_spec_number(value, p.settle_ms_);
+      if (key == "quick_exit")
+        return parse_choice(value, {"off", "on"}, p.quick_exit_mask_);
+      if (key == "cleanup")
+        return parse_choice(value, {"serial", "parallel"}, p.cleanup_mask_);
+      return false;
+    });
+    if (!ok)
+      return false;
+    *this = p;
+    return true;
+  }
+
+  bool enabled() const { return enabled_; }
+  uint32_t inflight() const { return inflight_; }
+  uint32_t trials() const { return trials_; }
+  std::chrono::milliseconds settle() const { return std::chrono::milliseconds(settle_ms_); }
+
+  // The combinations to run: QUICK_EXIT on before off, serial before parallel
+  std::vector<Variant> variants() const
+  {
+    std::vector<Variant> out;
+    for (bool quick : {true, false})
+      for (TeardownCleanup cleanup : {TeardownCleanup::serial, TeardownCleanup::parallel})
+        if ((quick_exit_mask_ >> (quick ? 1 : 0) & 1) && (cleanup_mask_ >> static_cast<unsigned>(cleanup) & 1))
+          out.push_back({quick, cleanup});
+    return out;
+  }
+
+private:
+  // names[i] sets bit i, "both" sets both
+  static bool parse_choice(std::string_view value, std::initializer_list<std::string_view> names, uint32_t &mask)
+  {
+    if (value == "both")
+    {
+      mask = 3;
+      return true;
+    }
+    uint32_t bit = 1;
+    for (std::string_view name : names)
+    {
+      if (value == name)
+      {
+        mask = bit;
+        return true;
+      }
+      bit <<= 1;
+    }
+    return false;
+  }
+
+  bool enabled_ = false;
+  uint32_t inflight_ = 1000;
+  uint32_t trials_ = 3;
+  uint32_t settle_ms_ = 200;
+  uint32_t quick_exit_mask_ = 3; // bit 0 off, bit 1 on
+  uint32_t cleanup_mask_ = 3;    // bit per TeardownCleanup
+};
+
+// What a trial's child measured. Times are microseconds from the start of
+// teardown, each one when that step had finished for every worker.
+struct TeardownSample
+{
+  int64_t start_ns = 0;     // steady_clock at the start of teardown, for the parent's exit time
+  uint32_t handles = 0;     // transfers in flight when teardown started
+  uint32_t resolving = 0;   // of those, still without a resolved name
+  int32_t threads_busy = 0; // threads besides main and the workers then (resolver threads); -1 unknown
+  int32_t threads_left = 0; // threads besides main after curl_global_cleanup; -1 unknown
+  uint64_t removed_us = 0;  // every easy handle removed and cleaned up
+  uint64_t multi_us = 0;    // every curl_multi_cleanup returned
+  uint64_t joined_us = 0;   // every worker joined
+  uint64_t global_us = 0;   // curl_global_cleanup returned
+};
@@ -25,6 +25,7 @@
 
 #include <dlfcn.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -54,28 +55,97 @@ typedef struct nlist nlist_t;
 #define SEG_DATA_CONST  "__DATA_CONST"
 #endif
 
+#define EMPTY_SLOT UINT32_MAX
+
+// Open-addressing set of one entry's names. Each symbol is hashed once and
+// probed, instead of strcmp against every rebinding of every entry.
+struct rebinding_slot {
+  uint32_t hash;
+  uint32_t index; // into rebindings, EMPTY_SLOT if unused
+};
+
 struct rebindings_entry {
   struct rebinding *rebindings;
   size_t rebindings_nel;
+  struct rebinding_slot *slots;
+  size_t slots_mask;
   struct rebindings_entry *next;
 };
 
 static struct rebindings_entry *_rebindings_head;
 
+// FNV-1a
+static uint32_t hash_name(const char *name) {
+  uint32_t h = 2166136261u;
+  for (; *name; name++) {
+    h ^= (unsigned char)*name;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// The first of several rebindings with the same name wins, as before.
+static void index_rebindings(struct rebindings_entry *entry) {
+  for (size_t i = 0; i <= entry->slots_mask; i++) {
+    entry->slots[i].index = EMPTY_SLOT;
+  }
+  for (uint32_t j = 0; j < entry->rebindings_nel; j++) {
+    uint32_t hash = hash_name(entry->rebindings[j].name);
+    size_t pos = hash & entry->slots_mask;
+    while (entry->slots[pos].index != EMPTY_SLOT &&
+           (entry->slots[pos].hash != hash ||
+            strcmp(entry->rebindings[entry->slots[pos].index].name, entry->rebindings[j].name) != 0)) {
+      pos = (pos + 1) & entry->slots_mask;
+    }
+    if (entry->slots[pos].index == EMPTY_SLOT) {
+      entry->slots[pos].hash = hash;
+      entry->slots[pos].index = j;
+    }
+  }
+}
+
+static struct rebinding *find_rebinding(struct rebindings_entry *entry, const char *name, uint32_t hash) {
+  for (size_t pos = hash & entry->slots_mask; entry->slots[pos].index != EMPTY_SLOT;
+       pos = (pos + 1) & entry->slots_mask) {
+    struct rebinding *r = &entry->rebindings[entry->slots[pos].index];
+    if (entry->slots[pos].hash == hash && strcmp(r->name, name) == 0) {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+static void free_rebindings_entry(struct rebindings_entry *entry) {
+  free(entry->slots);
+  free(entry->rebindings);
+  free(entry);
+}
+
 static int prepend_rebindings(struct rebindings_entry **rebindings_head,
                               struct rebinding rebindings[],
                               size_t nel) {
-  struct rebindings_entry *new_entry = (struct rebindings_entry *) malloc(sizeof(struct rebindings_entry));
+  if (nel >= EMPTY_SLOT / 2) {
+    return -1;
+  }
+  struct rebindings_entry *new_entry = (struct rebindings_entry *) calloc(1, sizeof(struct rebindings_entry));
   if (!new_entry) {
     return -1;
   }
-  new_entry->rebindings = (struct rebinding *) malloc(sizeof(struct rebinding) * nel);
-  if (!new_entry->rebindings) {
-    free(new_entry);
+  // At most half full, so probes stay short and always reach an empty slot
+  size_t slots = 2;
+  while (slots < nel * 2) {
+    slots <<= 1;
+  }
+  new_entry->rebindings = (struct rebinding *) malloc(sizeof(struct rebinding) * (nel ? nel : 1));
+  new_entry->slots = (struct rebinding_slot *) malloc(sizeof(struct rebinding_slot) * slots);
+  if (!new_entry->rebindings || !new_entry->slots) {
+    free_rebindings_entry(new_entry);
     return -1;
   }
   memcpy(new_entry->rebindings, rebindings, sizeof(struct rebinding) * nel);
   new_entry->rebindings_nel = nel;
+  new_entry->slots_mask = slots - 1;
+  index_rebindings(new_entry);
   new_entry->next = *rebindings_head;
   *rebindings_head = new_entry;
   return 0;
@@ -119,6 +189,8 @@ static void perform_rebinding_with_section(struct rebindings_entry *rebindings,
                                            uint32_t *indirect_symtab) {
   uint32_t *indirect_symbol_indices = indirect_symtab + section->reserved1;
   void **indirect_symbol_bindings = (void **)((uintptr_t)slide + section->addr);
+  // The section is made writable once, on its first match: untried, done or failed
+  enum { PROTECT_UNTRIED, PROTECT_WRITABLE, PROTECT_FAILED } protect = PROTECT_UNTRIED;
 
   for (uint i = 0; i < section->size / sizeof(void *); i++) {
     uint32_t symtab_index = indirect_symbol_indices[i];
@@ -129,38 +201,42 @@ static void perform_rebinding_with_section(struct rebindings_entry *rebindings,
     uint32_t strtab_offset = symtab[symtab_index].n_un.n_strx;
     char *symbol_name = strtab + strtab_offset;
     bool symbol_name_longer_than_1 = symbol_name[0] && symbol_name[1];
-    struct rebindings_entry *cur = rebindings;
-    while (cur) {
-      for (uint j = 0; j < cur->rebindings_nel; j++) {
-        if (symbol_name_longer_than_1 && strcmp(&symbol_name[1], cur->rebindings[j].name) == 0) {
-          kern_return_t err;
-
-          if (cur->rebindings[j].replaced != NULL && indirect_symbol_bindings[i] != cur->rebindings[j].replacement)
-            *(cur->rebindings[j].replaced) = indirect_symbol_bindings[i];
+    if (!symbol_name_longer_than_1) {
+      continue;
+    }
+    uint32_t hash = hash_name(&symbol_name[1]);
+    for (struct rebindings_entry *cur = rebindings; cur; cur = cur->next) {
+      struct rebinding *match = find_rebinding(cur, &symbol_name[1], hash);
+      if (!match) {
+        continue;
+      }
+      if (match->replaced != NULL && indirect_symbol_bindings[i] != match->replacement)
+        *(match->replaced) = indirect_symbol_bindings[i];
 
-          /**
-           * 1. Moved the vm protection modifying codes to here to reduce the
-           *    changing scope.
-           * 2. Adding VM_PROT_WRITE mode unconditionally because vm_region
-           *    API on some iOS/Mac reports mismatch vm protection attributes.
-           * -- Lianfu Hao Jun 16th, 2021
-           **/
-          err = vm_protect (mach_task_self (), (uintptr_t)indirect_symbol_bindings, section->size, 0, VM_PROT_READ | VM_PROT_WRITE | VM_PROT_COPY);
-          if (err == KERN_SUCCESS) {
-            /**
-             * Once we failed to change the vm protection, we
-             * MUST NOT continue the following write actions!
-             * iOS 15 has corrected the const segments prot.
-             * -- Lionfore Hao Jun 11th, 2021
-             **/
-            indirect_symbol_bindings[i] = cur->rebindings[j].replacement;
-          }
-          goto symbol_loop;
-        }
+      /**
+       * 1. Moved the vm protection modifying codes to here to reduce the
+       *    changing scope.
+       * 2. Adding VM_PROT_WRITE mode unconditionally because vm_region
+       *    API on some iOS/Mac reports mismatch vm protection attributes.
+       * -- Lianfu Hao Jun 16th, 2021
+       *
+       * The whole section is covered, so one call serves every slot in it.
+       **/
+      if (protect == PROTECT_UNTRIED) {
+        kern_return_t err = vm_protect (mach_task_self (), (uintptr_t)indirect_symbol_bindings, section->size, 0, VM_PROT_READ | VM_PROT_WRITE | VM_PROT_COPY);
+        protect = err == KERN_SUCCESS ? PROTECT_WRITABLE : PROTECT_FAILED;
+      }
+      if (protect == PROTECT_WRITABLE) {
+        /**
+         * Once we failed to change the vm protection, we
+         * MUST NOT continue the following write actions!
+         * iOS 15 has corrected the const segments prot.
+         * -- Lionfore Hao Jun 11th, 2021
+         **/
+        indirect_symbol_bindings[i] = match->replacement;
       }
-      cur = cur->next;
+      break;
     }
-  symbol_loop:;
   }
 }
 
@@ -239,9 +315,8 @@ int rebind_symbols_image(void *header,
     int retval = prepend_rebindings(&rebindings_head, rebindings, rebindings_nel);
     rebind_symbols_for_image(rebindings_head, (const struct mach_header *) header, slide);
     if (rebindings_head) {
-      free(rebindings_head->rebindings);
+      free_rebindings_entry(rebindings_head);
     }
-    free(rebindings_head);
     return retval;
 }
 
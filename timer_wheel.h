@@ -0,0 +1,111 @@
+// timer_wheel.h - single-threaded hashed timing wheel.
+// Deadlines are bucketed into power-of-two slots of one tick each; entries
+// further out than one revolution share a slot with nearer ones and simply
+// stay until their own tick comes round. schedule() is O(1), advance() costs
+// one slot visit per elapsed tick (at most one revolution).
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class TimerWheel
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  // slots must be a power of two; tick is the firing granularity.
+  TimerWheel(clock::duration tick, size_t slots, clock::time_point origin = clock::now())
+      : tick_(tick), origin_(origin), mask_(slots - 1), slots_(slots)
+  {
+  }
+
+  // Deadlines already in the past fire on the next advance().
+  void schedule(clock::time_point when, T value)
+  {
+    uint64_t t = tick_of(when);
+    if (t < cursor_)
+      t = cursor_;
+    slots_[t & mask_].push_back(Entry{when, t, std::move(value)});
+    ++size_;
+  }
+
+  // Fire every entry whose tick is <= now as fire(when, value), in tick
+  // order (unless more than a whole revolution has elapsed since the last
+  // call, in which case order across slots is not guaranteed).
+  template <typename Fire>
+  void advance(clock::time_point now, Fire &&fire)
+  {
+    uint64_t target = tick_of(now);
+    if (target < cursor_ || size_ == 0)
+    {
+      cursor_ = target < cursor_ ? cursor_ : target + 1;
+      return;
+    }
+    uint64_t last = target - cursor_ > mask_ ? cursor_ + mask_ : target;
+    for (uint64_t t = cursor_; t <= last && size_ > 0; ++t)
+    {
+      std::vector<Entry> &slot = slots_[t & mask_];
+      size_t keep = 0;
+      for (size_t i = 0; i < slot.size(); ++i)
+      {
+        if (slot[i].tick <= target)
+        {
+          fire(slot[i].when, std::move(slot[i].value));
+          --size_;
+        }
+        else
+        {
+          if (keep != i)
+            slot[keep] = std::move(slot[i]);
+          ++keep;
+        }
+      }
+      slot.resize(keep);
+    }
+    cursor_ = target + 1;
+  }
+
+  // Start of the earliest non-empty slot; may be early when that slot only
+  // holds entries for a later revolution. Empty when nothing is pending.
+  std::optional<clock::time_point> next_deadline() const
+  {
+    if (size_ == 0)
+      return std::nullopt;
+    for (uint64_t t = cursor_; t <= cursor_ + mask_; ++t)
+      if (!slots_[t & mask_].empty())
+        return origin_ + tick_ * static_cast<clock::rep>(t);
+    return std::nullopt;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // How far ahead schedule() can place entries without wrapping.
+  clock::duration horizon() const { return tick_ * static_cast<clock::rep>(mask_ + 1); }
+
+private:
+  struct Entry
+  {
+    clock::time_point when;
+    uint64_t tick;
+    T value;
+  };
+
+  uint64_t tick_of(clock::time_point when) const
+  {
+    return when <= origin_ ? 0 : static_cast<uint64_t>((when - origin_) / tick_);
+  }
+
+  clock::duration tick_;
+  clock::time_point origin_;
+  uint64_t mask_;
+  uint64_t cursor_ = 0; // first tick not yet processed
+  size_t size_ = 0;
+  std::vector<std::vector<Entry>> slots_;
+};
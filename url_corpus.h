@@ -0,0 +1,213 @@
+// url_corpus.h - the URLs a run draws from. Every URL is a NUL-terminated C
+// string that stays put for the whole run (string literals, or lines of a
+// corpus file mapped into one arena and terminated in place), grouped by a
+// category tag. sample() picks a category through an alias table and then a
+// URL within it uniformly: two 64-bit random draws, no allocation, O(1).
+//
+// Corpus file format, one URL per line, optionally tagged:
+//   # comment
+//   large https://cdn.example/100MB.bin
+//   https://example.com/          (untagged: category "default")
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "alias_table.h"
+#include "spec_parser.h"
+
+class UrlCorpus
+{
+public:
+  struct Category
+  {
+    std::string name;
+    std::vector<const char *> urls;
+    uint64_t weight = 0; // set by finalize()
+  };
+
+  UrlCorpus() = default;
+  ~UrlCorpus()
+  {
+    for (auto [base, length] : arenas_)
+      munmap(base, length);
+  }
+
+  UrlCorpus(const UrlCorpus &) = delete;
+  UrlCorpus &operator=(const UrlCorpus &) = delete;
+
+  // url must outlive the corpus: a literal, owned(), or arena memory.
+  void add(std::string_view category, const char *url)
+  {
+    auto [it, inserted] = index_.try_emplace(std::string(category), categories_.size());
+    if (inserted)
+      categories_.push_back(Category{std::string(category), {}, 0});
+    categories_[it->second].urls.push_back(url);
+    ++size_;
+  }
+
+  // Keeps a composed URL alive for the corpus' lifetime.
+  const char *owned(std::string url) { return owned_.emplace_back(std::move(url)).c_str(); }
+
+  // Map path privately, past its end into zeroed anonymous memory, so every
+  // line (the last one included) can be terminated in place.
+  bool load_file(const std::string &path, std::string &error)
+  {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+      error = path + ": " + std::strerror(errno);
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t length = (size + 1 + page - 1) / page * page;
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED && size > 0 &&
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      munmap(base, length);
+      base = MAP_FAILED;
+    }
+    int saved = errno;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+      error = path + ": mmap: " + std::strerror(saved);
+      return false;
+    }
+    arenas_.emplace_back(base, length);
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    char *p = static_cast<char *>(base);
+    char *const end = p + size;
+    while (p < end)
+    {
+      char *eol = static_cast<char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+      if (!eol)
+        eol = end; // the byte at end is the zeroed reserve
+      *eol = '\0';
+      add_line(p, eol);
+      p = eol + 1;
+    }
+    return true;
+  }
+
+  // Category weights "name=W,name=W"; categories not named get no traffic.
+  // Empty spec: weight = URL count, i.e. uniform over all URLs.
+  bool finalize(std::string_view spec, std::string &error)
+  {
+    for (Category &c : categories_)
+      c.weight = spec.empty() ? c.urls.size() : 0;
+    while (!spec.empty())
+    {
+      std::string_view item = next_spec_token(spec, ",");
+      std::string_view name = next_spec_token(item, "=");
+      uint64_t weight = 0;
+      auto it = index_.find(std::string(name));
+      if (it == index_.end())
+      {
+        error = "unknown URL category '" + std::string(name) + "'";
+        return false;
+      }
+      if (!parse_spec_number(item, weight) || weight > UINT32_MAX)
+      {
+        error = "invalid weight '" + std::string(item) + "' for URL category '" + std::string(name) + "'";
+        return false;
+      }
+      categories_[it->second].weight = weight;
+    }
+
+    std::vector<uint64_t> weights;
+    for (const Category &c : categories_)
+      weights.push_back(c.weight);
+    picker_ = DynamicAliasTable(weights);
+    if (!picker_.valid())
+    {
+      error = size_ == 0 ? "URL corpus is empty" : "every URL category has weight 0";
+      return false;
+    }
+    return true;
+  }
+
+  struct Pick
+  {
+    uint32_t category;
+    uint32_t index; // within the category
+    const char *url;
+  };
+
+  // rng must produce full 64-bit values (Xoshiro256ss, std::mt19937_64).
+  template <typename Rng>
+  Pick pick(Rng &rng) const
+  {
+    size_t category = picker_.sample(rng());
+    const Category &c = categories_[category];
+    __extension__ typedef unsigned __int128 u128;
+    size_t index = static_cast<size_t>((static_cast<u128>(rng()) * c.urls.size()) >> 64);
+    return {static_cast<uint32_t>(category), static_cast<uint32_t>(index), c.urls[index]};
+  }
+
+  template <typename Rng>
+  const char *sample(Rng &rng) const
+  {
+    return pick(rng).url;
+  }
+
+  // The URL a Pick named, nullptr if this corpus has no such entry.
+  const char *at(uint32_t category, uint32_t index) const
+  {
+    if (category >= categories_.size() || index >= categories_[category].urls.size())
+      return nullptr;
+    return categories_[category].urls[index];
+  }
+
+  size_t size() const { return size_; }
+  const std::vector<Category> &categories() const { return categories_; }
+
+private:
+  static bool blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  // [p, eol) is one line, *eol already '\0'.
+  void add_line(char *p, char *eol)
+  {
+    while (p < eol && blank(*p))
+      ++p;
+    while (eol > p && blank(eol[-1]))
+      *--eol = '\0';
+    if (p == eol || *p == '#')
+      return;
+    char *sep = p;
+    while (sep < eol && !blank(*sep))
+      ++sep;
+    if (sep == eol)
+      return add("default", p);
+    *sep = '\0';
+    char *url = sep + 1;
+    while (url < eol && blank(*url))
+      ++url;
+    add(std::string_view(p, static_cast<size_t>(sep - p)), url);
+  }
+
+  std::vector<Category> categories_;
+  std::unordered_map<std::string, size_t> index_;
+  std::vector<std::pair<void *, size_t>> arenas_;
+  std::deque<std::string> owned_; // stable c_str() across growth
+  DynamicAliasTable picker_;
+  size_t size_ = 0;
+};